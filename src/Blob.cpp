@@ -0,0 +1,70 @@
+#include "Blob.h"
+#include "FileManager.h"
+#include "PageAllocator.h"
+#include "PageCache.h"
+#include "SnapshotManager.h"
+
+namespace bptdb {
+
+Blob::Ref Blob::write(std::string_view val) {
+    Ref ref{0, (u32)val.size()};
+    ref.pos = g_pa->allocPage(pages(ref));
+    auto buf = image(val);
+    g_pc->write(ref.pos, pages(ref), buf.data());
+    return ref;
+}
+
+bool Blob::rewrite(Ref &ref, std::string_view val) {
+    if(byte2page(val.size()) != pages(ref)) {
+        return false;
+    }
+    ref.len = val.size();
+    auto buf = image(val);
+    g_pc->write(ref.pos, pages(ref), buf.data());
+    return true;
+}
+
+std::string Blob::image(std::string_view val) {
+    std::string buf(page2off(byte2page(val.size())), 0);
+    std::memcpy(buf.data(), val.data(), val.size());
+    return buf;
+}
+
+std::string_view Blob::read(const Ref &ref, std::string &buf) {
+    if(g_fm->mapped()) {
+        return std::string_view(g_fm->at(page2off(ref.pos)), ref.len);
+    }
+    buf.resize(page2off(pages(ref)));
+    if(auto seq = SnapshotManager::current()) {
+        for(u32 i = 0; i < pages(ref); i++) {
+            g_snap->read(ref.pos + i, seq, buf.data() + page2off(i));
+        }
+    }else {
+        g_pc->read(ref.pos, pages(ref), buf.data());
+    }
+    buf.resize(ref.len);
+    return buf;
+}
+
+void Blob::free(const Ref &ref) {
+    g_pa->freePage(ref.pos, pages(ref));
+}
+
+bool Blob::move(Ref &ref, pgid_t end) {
+    u32 n = pages(ref);
+    if(ref.pos + n <= end) {
+        return false;
+    }
+    pgid_t to = g_pa->allocBelow(n, ref.pos);
+    if(!to) {
+        return false;
+    }
+    std::string buf(page2off(n), 0);
+    g_pc->read(ref.pos, n, buf.data());
+    g_pc->write(to, n, buf.data());
+    free(ref);
+    ref.pos = to;
+    return true;
+}
+
+}// namespace bptdb
@@ -0,0 +1,60 @@
+#ifndef __BLOB_H
+#define __BLOB_H
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "common.h"
+
+namespace bptdb {
+
+// a value too long for a leaf, on a run of pages of its own, the leaf
+// keeps a ref to it in place of the value. the pages have no header and
+// are reached only by the ref, through cache and log as nodes are.
+class Blob {
+public:
+    struct Ref {
+        pgid_t pos;
+        u32    len;  ///< bytes of value
+    };
+
+    // if a value of len bytes goes to pages of its own.
+    static bool large(u32 len) {
+        return g_option.blob_size &&
+            len > std::max<u32>(g_option.blob_size, sizeof(Ref));
+    }
+    // bytes a value of len takes in a leaf.
+    static u32 stored(u32 len) {
+        return large(len) ? sizeof(Ref) : len;
+    }
+    static u32 pages(const Ref &ref) {
+        return byte2page(ref.len);
+    }
+    // refs lie unaligned in records.
+    static Ref load(const char *at) {
+        Ref ref;
+        std::memcpy(&ref, at, sizeof(Ref));
+        return ref;
+    }
+    static std::string_view bytes(const Ref &ref) {
+        return std::string_view((const char *)&ref, sizeof(Ref));
+    }
+
+    // put val on new pages.
+    static Ref write(std::string_view val);
+    // put val on the pages of ref instead, if it takes as many of them.
+    static bool rewrite(Ref &ref, std::string_view val);
+    // val padded to whole pages, for bulk load, which writes the file.
+    static std::string image(std::string_view val);
+    // the value of ref, in buf unless the file is mapped, then in place.
+    static std::string_view read(const Ref &ref, std::string &buf);
+    static void free(const Ref &ref);
+    // move the pages of ref to free ones before them if they reach end,
+    // false if they stay.
+    static bool move(Ref &ref, pgid_t end);
+};
+
+}// namespace bptdb
+
+#endif
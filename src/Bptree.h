@@ -1,7 +1,12 @@
 #ifndef __BPTREE_H
 #define __BPTREE_H
 
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <mutex>
+#include <numeric>
+#include <thread>
 #include <iostream>
 #include <vector>
 #include <type_traits>
@@ -10,8 +15,10 @@
 #include "LeafNode.h"
 #include "InnerNode.h"
 #include "LockHelper.h"
+#include "SnapshotManager.h"
 #include "DBImpl.h"
 #include "IteratorBase.h"
+#include "Wal.h"
 
 namespace bptdb {
 
@@ -25,87 +32,762 @@ public:
     class Iterator: public IteratorBase {
         friend class Bptree;
     public:    
-        Iterator() = default;
+        Iterator(Bptree *tree): _tree(tree) {}
         std::string_view key()    { return it.key(); }
-        std::string_view val()    { return it.val(); }
+        // a long val is read with its leaf, as the key is, but in a
+        // mapped file, which is read in place now.
+        std::string_view val() {
+            auto scope = _tree->scope();
+            return it.val();
+        }
         bool  done() { return _done; }
         void next() {
             if(_done) {
                 throw "out of range";
             }
+            auto scope = _tree->scope();
+            std::shared_lock gate(_tree->_gate);
+            EpochGuard epoch;
             it.next();
-            // if we reach the last elem
-            if(it.done()) {
-                if(!(node = node->next())) {
+            skipEmpty();
+            checkUpper();
+        }
+        void prev() {
+            if(_done) {
+                throw "out of range";
+            }
+            auto scope = _tree->scope();
+            std::shared_lock gate(_tree->_gate);
+            EpochGuard epoch;
+            if(it.pos() > 0) {
+                it.prev();
+            }else {
+                std::string target(key());
+                seekBefore(&target);
+            }
+            checkLower();
+        }
+    private:
+        // go to the first key not less than key, the first of all if null.
+        void seekAfter(std::string *key) {
+            if(!key) {
+                load(_tree->_first, true);
+            }else {
+                load(_tree->down(_tree->_height, _tree->_root, *key), true);
+                it = impl->seek(*key);
+                if(!impl->size()) {
+                    _resume = *key;
+                    _after = false;
+                }
+            }
+            skipEmpty();
+        }
+
+        // go to the last key before key, the last of all if null. when the
+        // leaf found has none before key, it must be left of the least key
+        // the leaf may hold.
+        void seekBefore(std::string *key) {
+            std::string bound;
+            while(true) {
+                std::string low;
+                bool haslow;
+                load(_tree->downBefore(key, low, haslow), false);
+                it = key ? impl->seek(*key) : impl->end();
+                if(it.pos() > 0) {
+                    it.prev();
+                    return;
+                }
+                if(!haslow) {
                     _done = true;
                     return;
                 }
-                std::tie(it, impl) = node->begin();
+                bound = std::move(low);
+                key = &bound;
             }
         }
-    private:
+
+        // if we reach the last elem, go on to a leaf not empty. once nodes
+        // are moved the next of leaf may be gone, go down again from the
+        // last key seen.
+        void skipEmpty() {
+            while(it.done()) {
+                if(_moves != _tree->_moves.load() && !_resume.empty()) {
+                    std::string key = _resume;
+                    bool after = _after;
+                    load(_tree->down(_tree->_height, _tree->_root, key), true);
+                    it = impl->seek(key);
+                    if(after && !it.done() && !_tree->_cmp(key, it.key())) {
+                        it.next();
+                    }
+                    continue;
+                }
+                auto next = impl->next();
+                if(!next) {
+                    _done = true;
+                    return;
+                }
+                load(next, true);
+            }
+        }
+
+        void load(pgid_t id, bool forward) {
+            std::tie(it, impl) = _tree->_leaf_map.get(id)->begin();
+            _moves = _tree->_moves.load();
+            if(impl->size()) {
+                _resume = impl->key(impl->size() - 1);
+                _after = true;
+            }
+            readAhead(forward);
+        }
+
+        // load the leaves ahead in background, again once half of them
+        // are passed.
+        void readAhead(bool forward) {
+            u32 n = g_option.scan_readahead;
+            if(!n || !impl->size()) {
+                return;
+            }
+            if(_forward == forward && _ahead > n / 2) {
+                _ahead--;
+                return;
+            }
+            _forward = forward;
+            auto first = impl->key(0);
+            auto ids = _tree->around(first, n, forward);
+            _ahead = ids.size();
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [](pgid_t id) {
+                return g_pc->contains(id);
+            }), ids.end());
+            if(ids.empty()) {
+                return;
+            }
+            // only advice to the kernel, it never blocks.
+            if(g_fm->mapped()) {
+                g_pc->prefetch(std::move(ids));
+                return;
+            }
+            if(_fetch.valid()) {
+                _fetch.wait();
+            }
+            _fetch = std::async(std::launch::async, 
+                [ids = std::move(ids)]() mutable {
+                    g_pc->prefetch(std::move(ids));
+                });
+        }
+
+        void checkUpper() {
+            if(!_done && _has_upper && !_tree->_cmp(key(), _upper)) {
+                _done = true;
+            }
+        }
+        void checkLower() {
+            if(!_done && _has_lower && _tree->_cmp(key(), _lower)) {
+                _done = true;
+            }
+        }
+
+        Bptree *_tree{nullptr};
         bool _done{false};
-        LeafNode *node{nullptr};
         Iter_t it;
         LeafNodeImplPtr impl;
+        // keys in [_lower, _upper) only, if set.
+        bool _has_lower{false};
+        bool _has_upper{false};
+        std::string _lower;
+        std::string _upper;
+        // leaves ahead already asked for.
+        bool _forward{true};
+        u32  _ahead{0};
+        std::future<void> _fetch;
+        // where to go down again if nodes are moved, after it or from it.
+        u64  _moves{0};
+        std::string _resume;
+        bool _after{false};
     };
 
     // ====================================================
 
     std::shared_ptr<IteratorBase> begin() {
-        auto node = _leaf_map.get(_first);
-        auto it = std::make_shared<Iterator>();
-        it->node = node;
-        std::tie(it->it, it->impl) = node->begin();
+        auto scope = this->scope();
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
+        auto it = std::make_shared<Iterator>(this);
+        it->seekAfter(nullptr);
         return it;
     }
 
+    // at key, done if there is no key.
     std::shared_ptr<IteratorBase> at(std::string &key) {
-        auto nodeid = down(_height, _root, key);
-        auto node = _leaf_map.get(nodeid);
-        auto it = std::make_shared<Iterator>();
-        it->node = node;
-        std::tie(it->it, it->impl) = node->at(key);
+        auto scope = this->scope();
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
+        auto it = std::make_shared<Iterator>(this);
+        it->seekAfter(&key);
+        if(!it->_done && _cmp(key, it->key())) {
+            it->_done = true;
+        }
+        return it;
+    }
+
+    // at the first key not less than key.
+    std::shared_ptr<IteratorBase> seek(std::string &key) {
+        auto scope = this->scope();
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
+        auto it = std::make_shared<Iterator>(this);
+        it->seekAfter(&key);
+        return it;
+    }
+
+    // at the last key, to go with prev().
+    std::shared_ptr<IteratorBase> last() {
+        auto scope = this->scope();
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
+        auto it = std::make_shared<Iterator>(this);
+        it->seekBefore(nullptr);
+        return it;
+    }
+
+    // keys in [lower, upper), at the first or the last if reverse.
+    std::shared_ptr<IteratorBase> range(std::string &lower, 
+            std::string &upper, bool reverse) {
+        auto scope = this->scope();
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
+        auto it = std::make_shared<Iterator>(this);
+        it->_has_lower = it->_has_upper = true;
+        it->_lower = lower;
+        it->_upper = upper;
+        if(reverse) {
+            it->seekBefore(&upper);
+            it->checkLower();
+        }else {
+            it->seekAfter(&lower);
+            it->checkUpper();
+        }
         return it;
     }
+
     // ====================================================
 
-    Bptree(std::string name, BptreeMeta meta, comparator_t cmp):
-    _leaf_map(meta.order, cmp), _inner_map(meta.order, cmp){
+    // a tree of snap is read only. keys of a typed tree sort as bytes.
+    Bptree(std::string name, BptreeMeta meta, comparator_t cmp,
+           std::shared_ptr<SnapshotRef> snap = nullptr, 
+           BucketType type = BucketType()):
+    _leaf_map(leafOrder(meta.order, type), cmp, type), 
+    _inner_map(meta.order, cmp), _snap(snap){
         _name   = name;
         _order  = meta.order;
         _height = meta.height;
         _root   = meta.root;
         _first  = meta.first;
         _cmp    = cmp;
+        _type   = type;
     }
 
     static void newOnDisk(pgid_t id) {
         LeafNode::newOnDisk(id);
     }
 
+    // a leaf of a typed tree holds as many records as a page has room
+    // for, they are smaller than those of others.
+    static u32 leafOrder(u32 order, BucketType type) {
+        if(!type.typed()) {
+            return order;
+        }
+        u32 room = g_option.page_size - sizeof(PageHeader) - 
+            sizeof(LeafNodeImpl::Header) - type.keysize;
+        return std::max(room / (type.keysize + type.valsize), 4u) - 1;
+    }
+
+    const BucketType &type() {
+        return _type;
+    }
+    // if key and val, if any, are of the type of tree.
+    bool fits(const std::string &key, const std::string *val = nullptr) {
+        if(!_type.typed()) {
+            return true;
+        }
+        return key.size() == _type.keysize && 
+            (!val || val->size() == _type.valsize);
+    }
+
+    // shared by ops, exclusive by compaction and batches.
+    TreeGate &gate() {
+        return _gate;
+    }
+
+    bool readOnly() {
+        return _snap != nullptr || g_option.read_only;
+    }
+
+    // convert the nodes under nodeid from format version to current, in
+    // preorder. seq counts the nodes seen, the first skip of all are done
+    // before and read as now. each node is rewritten by a txn of its own,
+    // done(seq) is called in it.
+    static void upgrade(pgid_t nodeid, u32 height, u32 version, u32 &seq,
+                        u32 skip, const std::function<void(u32)> &done) {
+        bool redo = seq++ >= skip;
+        if(height == 1) {
+            // leaves are the same since 2.
+            if(redo && version < 2) {
+                WalTxn txn;
+                LeafNodeImpl::upgrade(nodeid, version);
+                done(seq);
+            }
+            return;
+        }
+        std::vector<pgid_t> children;
+        if(redo) {
+            WalTxn txn;
+            children = InnerNodeImpl::upgrade(nodeid, version);
+            done(seq);
+        }else {
+            children = InnerNodeImpl::children(nodeid);
+        }
+        for(auto child: children) {
+            upgrade(child, height - 1, version, seq, skip, done);
+        }
+    }
+
     //====================================================================
 
     std::tuple<Status, std::string> get(std::string &key) {
-        _root_mtx.lock_shared();
-        auto [nodeid, mutex] = down(_height, _root, key, _root_mtx);
+        if(!fits(key)) {
+            return std::make_tuple(Status(error::bucketTypeErr), 
+                    std::string());
+        }
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
         std::string val;
-        auto stat = _leaf_map.get(nodeid)->get(key, val, mutex);
-        return std::make_tuple(stat, val);
+        if(readOnly()) {
+            // pages of a snapshot or a mapped file never change, no latch.
+            auto scope = this->scope();
+            LeafNodeImpl impl(down(_height, _root, key), _cmp, 
+                    PageMode::Copy, _type);
+            if(!impl.get(key, val)) {
+                return std::make_tuple(Status(error::keyNotFind), val);
+            }
+            return std::make_tuple(Status(), val);
+        }
+        if(g_option.split_mode == SplitMode::blink) {
+            auto nodeid = linkDown(key);
+            while(true) {
+                auto [done, stat] = 
+                    _leaf_map.get(nodeid)->linkGet(key, val, nodeid);
+                if(done) {
+                    return std::make_tuple(stat, val);
+                }
+            }
+        }
+        while(true) {
+            pgid_t nodeid;
+            auto par = downLeaf(key, nodeid);
+            auto [done, stat] = _leaf_map.get(nodeid)->get(key, val, par);
+            if(done) {
+                return std::make_tuple(stat, val);
+            }
+        }
     }
 
     Status update(std::string &key, std::string &val) {
-        _root_mtx.lock_shared();
-        auto [nodeid, mutex] = down(_height, _root, key, _root_mtx);
-        return  _leaf_map.get(nodeid)->update(key, val, mutex);
+        if(readOnly()) {
+            return Status(error::readOnly);
+        }
+        if(!fits(key, &val)) {
+            return Status(error::bucketTypeErr);
+        }
+        WriteScope scope;
+        WalTxn txn;
+        Status stat;
+        {
+            std::shared_lock gate(_gate);
+            EpochGuard epoch;
+            stat = doUpdate(key, val);
+        }
+        return txn.commit(stat);
     }
 
     Status put(std::string &key, std::string &val) {
+        if(readOnly()) {
+            return Status(error::readOnly);
+        }
+        if(!fits(key, &val)) {
+            return Status(error::bucketTypeErr);
+        }
+        WriteScope scope;
+        // declared first, commit after all latches are released.
+        WalTxn txn;
+        Status stat;
+        {
+            std::shared_lock gate(_gate);
+            EpochGuard epoch;
+            stat = doPut(key, val);
+        }
+        return txn.commit(stat);
+    }
+
+    Status del(std::string &key) {
+        if(readOnly()) {
+            return Status(error::readOnly);
+        }
+        if(!fits(key)) {
+            return Status(error::bucketTypeErr);
+        }
+        WriteScope scope;
+        WalTxn txn;
+        Status stat;
+        {
+            std::shared_lock gate(_gate);
+            EpochGuard epoch;
+            stat = doDel(key);
+        }
+        return txn.commit(stat);
+    }
+
+    // look up many keys at once. keys are sorted, a parent of leaves is
+    // visited once for all keys under it, and a leaf once for its keys.
+    std::vector<std::tuple<Status, std::string>> 
+    multiGet(std::vector<std::string> &keys) {
+        std::shared_lock gate(_gate);
+        EpochGuard epoch;
+        std::vector<std::tuple<Status, std::string>> rets(keys.size());
+        std::vector<u32> idx(keys.size());
+        std::iota(idx.begin(), idx.end(), 0);
+        std::sort(idx.begin(), idx.end(), [&](u32 a, u32 b) {
+            return _cmp(keys[a], keys[b]);
+        });
+        std::vector<std::string *> skeys;
+        Rets srets;
+        for(auto i: idx) {
+            if(!fits(keys[i])) {
+                std::get<0>(rets[i]) = Status(error::bucketTypeErr);
+                continue;
+            }
+            skeys.push_back(&keys[i]);
+            srets.push_back(&rets[i]);
+        }
+        if(_snap) {
+            for(u32 i = 0; i < keys.size(); i++) {
+                rets[i] = get(keys[i]);
+            }
+            return rets;
+        }
+        u32 pos = 0;
+        while(pos < skeys.size()) {
+            pos = g_option.split_mode == SplitMode::blink ? 
+                linkMultiGet(skeys, srets, pos) : 
+                multiGet(skeys, srets, pos);
+        }
+        return rets;
+    }
+
+    // apply ops of a batch to this tree, the caller holds the txn and the
+    // gate exclusive, so no op of others is seen between them. ops in the
+    // same leaf are done under one latch and one write of the leaf, an op
+    // which splits or merges goes alone by the usual way. return the
+    // status of the first op failed, the ones after are not applied.
+    Status write(std::vector<WriteBatch::Op *> &ops) {
+        EpochGuard epoch;
+        // the last op on a key wins.
+        std::stable_sort(ops.begin(), ops.end(), 
+            [this](WriteBatch::Op *a, WriteBatch::Op *b) {
+                return _cmp(a->key, b->key);
+            });
+        bool blink = g_option.split_mode == SplitMode::blink;
+        u32 pos = 0;
+        while(pos < ops.size()) {
+            pgid_t nodeid;
+            Coupling par;
+            if(blink) {
+                nodeid = linkDown(ops[pos]->key);
+            }else {
+                par = downLeaf(ops[pos]->key, nodeid);
+            }
+            while(true) {
+                pgid_t right = 0;
+                auto [done, next] = _leaf_map.get(nodeid)->apply(
+                    ops, pos, par, !blink, right);
+                if(done) {
+                    if(next == pos) {
+                        auto stat = apply(*ops[pos]);
+                        if(!stat.ok()) {
+                            return stat;
+                        }
+                        next++;
+                    }
+                    pos = next;
+                    break;
+                }
+                // only a leaf in blink mode may be left for its right.
+                if(!blink || !right) {
+                    break;
+                }
+                nodeid = right;
+            }
+        }
+        return Status();
+    }
+
+    // move nodes to free pages before them, at most budget of them, the
+    // tree is held from other ops meanwhile. nodes with pages from end on
+    // are moved, and all leaves in key order if sort, each right after
+    // the one before if it can. leaves not moved are read for their extra
+    // pages only if deep. a pass out of budget goes on from where cursor
+    // tells, which is 0 once the pass is done. return the nodes moved.
+    u32 compact(u32 budget, pgid_t end, bool sort, bool deep, u32 &cursor) {
+        WriteScope scope;
+        WalTxn txn;
+        std::lock_guard gate(_gate);
+        EpochGuard epoch;
+        Pass pass{budget, 0, end, sort, deep};
+        pgid_t root = _root, first = _first;
+        if(_height == 1) {
+            place(1, _root, 0, 0, 0, pass);
+            cursor = 0;
+        }else {
+            compact(pass, cursor);
+        }
+        if(pass.moved) {
+            _moves++;
+        }
+        if(_root != root || _first != first) {
+            g_db->updateRoot(_name, _root, _height, _first);
+        }
+        return pass.moved;
+    }
+
+private:
+
+    using Rets = std::vector<std::tuple<Status, std::string> *>;
+
+    // compaction, the caller holds the gate exclusive. a node moved goes
+    // with its parent and left node pointing to it, its extra pages stay
+    // where they are unless they are moved too.
+    // ===================================================================
+
+    struct Pass {
+        u32    budget;
+        u32    moved;
+        pgid_t end;
+        bool   sort;
+        bool   deep;
+    };
+
+    // nodes of each level in key order and their parents, down to the
+    // parents of leaves. those from cursor - 1 on go with their leaves.
+    void compact(Pass &pass, u32 &cursor) {
+        std::vector<std::pair<pgid_t, pgid_t>> level{{_root, 0}};
+        for(u32 h = _height; h > 2; h--) {
+            std::vector<std::pair<pgid_t, pgid_t>> below;
+            pgid_t left = 0;
+            for(auto [id, parent]: level) {
+                left = place(h, id, parent, left, 0, pass);
+                for(auto child: InnerNodeImpl(left, _cmp).children()) {
+                    below.emplace_back(child, left);
+                }
+            }
+            level = std::move(below);
+        }
+        // the parents were changed since, start over.
+        u32 start = cursor ? cursor - 1 : 0;
+        if(start >= level.size()) {
+            start = 0;
+        }
+        pgid_t left = 0, leaf = 0;
+        if(start) {
+            left = level[start - 1].first;
+            leaf = InnerNodeImpl(left, _cmp).children().back();
+        }
+        for(u32 i = start; i < level.size(); i++) {
+            auto [id, parent] = level[i];
+            left = place(2, id, parent, left, 0, pass);
+            for(auto child: InnerNodeImpl(left, _cmp).children()) {
+                // the rest of leaves go in next batch, with their parent.
+                if(pass.moved >= pass.budget) {
+                    cursor = i + 1;
+                    return;
+                }
+                leaf = place(1, child, left, leaf, leaf, pass);
+            }
+        }
+        cursor = 0;
+    }
+
+    // move node id at height h if it should, return where it is then.
+    // after is the leaf before it in sort.
+    pgid_t place(u32 h, pgid_t id, pgid_t parent, pgid_t left, 
+                 pgid_t after, Pass &pass) {
+        bool leaf = h == 1;
+        bool sort = pass.sort && leaf && after && id != after + 1 && 
+                    after + 1 < pass.end;
+        if(pass.moved >= pass.budget || 
+                (leaf && id < pass.end && !sort && !pass.deep)) {
+            return id;
+        }
+        PageHelper pg(id);
+        auto hdr = (PageHeader *)pg.read();
+        u32 hdrpages = hdr->hdrpages;
+        u32 extra = hdr->realpages - hdrpages;
+        pgid_t to = 0, res = 0;
+        if(sort && g_pa->allocAt(after + 1, hdrpages)) {
+            to = after + 1;
+        }else if(id >= pass.end) {
+            to = g_pa->allocBelow(hdrpages, id);
+        }
+        if(extra && hdr->res + extra > pass.end) {
+            res = g_pa->allocBelow(extra, hdr->res);
+        }
+        pgid_t from = hdr->res;
+        if(res) {
+            hdr->res = res;
+        }
+        if(to) {
+            PageHelper moved(to, hdrpages + extra);
+            std::memcpy(moved.data(), pg.data(), page2off(hdrpages + extra));
+            moved.write();
+            link(h, id, to, parent, left);
+            g_pa->freePage(id, hdrpages);
+            pass.moved++;
+        }else if(res) {
+            pg.write();
+        }
+        if(res) {
+            g_pa->freePage(from, extra);
+            pass.moved++;
+        }
+        pgid_t at = to ? to : id;
+        // long vals of a leaf go down too, each counts as a node.
+        if(leaf) {
+            LeafNodeImpl impl(at, _cmp, PageMode::Write, _type);
+            if(u32 n = impl.moveBlobs(pass.end)) {
+                impl.write();
+                pass.moved += n;
+            }
+        }
+        return at;
+    }
+
+    // node at id is moved to to.
+    void link(u32 h, pgid_t id, pgid_t to, pgid_t parent, pgid_t left) {
+        if(parent) {
+            InnerNodeImpl impl(parent, _cmp, PageMode::Write);
+            impl.moveChild(id, to);
+            impl.write();
+        }else {
+            _root = to;
+        }
+        // a node of the level before, its next may not be set.
+        if(left && h == 1) {
+            LeafNodeImpl impl(left, _cmp, PageMode::Write, _type);
+            if(impl.next() == id) {
+                impl.setNext(to);
+                impl.write();
+            }
+        }else if(left) {
+            InnerNodeImpl impl(left, _cmp, PageMode::Write);
+            if(impl.next() == id) {
+                impl.setNext(to);
+                impl.write();
+            }
+        }
+        if(h == 1) {
+            if(id == _first) {
+                _first = to;
+            }
+            _leaf_map.del(id);
+        }else {
+            _inner_map.del(id);
+        }
+    }
+
+    // keys from pos on under one parent of leaves. the parent is latched
+    // until its leaves are read, none of them splits or merges meanwhile.
+    u32 multiGet(std::vector<std::string *> &keys, Rets &rets, u32 pos) {
+        _root_mtx.lock_shared();
+        std::vector<std::tuple<pgid_t, u32>> runs;
+        if(_height == 1) {
+            runs.emplace_back(_root, keys.size());
+            pos = getRuns(keys, rets, pos, runs);
+            _root_mtx.unlock_shared();
+            return pos;
+        }
+        auto [nodeid, mutex] = down(_height, _root, *keys[pos], _root_mtx, 2);
+        auto node = _inner_map.get(nodeid);
+        node->route(keys, pos, mutex, runs);
+        pos = getRuns(keys, rets, pos, runs);
+        node->getMutex().unlock_shared();
+        return pos;
+    }
+
+    u32 linkMultiGet(std::vector<std::string *> &keys, Rets &rets, u32 pos) {
+        u32 height;
+        auto nodeid = linkDown(*keys[pos], 2, nullptr, &height);
+        std::vector<std::tuple<pgid_t, u32>> runs;
+        if(height == 1) {
+            runs.emplace_back(nodeid, keys.size());
+        }else {
+            pgid_t right;
+            while(!_inner_map.get(nodeid)->linkRoute(keys, pos, runs, right)) {
+                nodeid = right;
+            }
+        }
+        return getRuns(keys, rets, pos, runs);
+    }
+
+    // read the leaves of runs, their first pages are loaded all at once.
+    // keys gone right by split are followed by the right link.
+    u32 getRuns(std::vector<std::string *> &keys, Rets &rets, u32 pos, 
+            std::vector<std::tuple<pgid_t, u32>> &runs) {
+        if(runs.size() > 1) {
+            std::vector<pgid_t> ids;
+            for(auto &run: runs) {
+                ids.push_back(std::get<0>(run));
+            }
+            g_pc->prefetch(std::move(ids));
+        }
+        for(auto [nodeid, end]: runs) {
+            while(pos < end) {
+                pos = _leaf_map.get(nodeid)->get(keys, pos, end, rets, nodeid);
+            }
+        }
+        return pos;
+    }
+
+    // the ops themselves, the caller holds the scope, the txn and the gate.
+    // ===================================================================
+
+    Status doUpdate(std::string &key, std::string &val) {
+        if(g_option.split_mode == SplitMode::blink) {
+            auto nodeid = linkDown(key);
+            while(true) {
+                auto [done, stat] = 
+                    _leaf_map.get(nodeid)->linkUpdate(key, val, nodeid);
+                if(done) {
+                    return stat;
+                }
+            }
+        }
+        while(true) {
+            pgid_t nodeid;
+            auto par = downLeaf(key, nodeid);
+            auto [done, stat] = _leaf_map.get(nodeid)->update(key, val, par);
+            if(done) {
+                return stat;
+            }
+        }
+    }
+
+    Status doPut(std::string &key, std::string &val) {
+        if(g_option.split_mode == SplitMode::blink) {
+            return linkPut(key, val);
+        }
         {
             //try put at first.
-            _root_mtx.lock_shared();
-            auto [nodeid, mutex] = down(_height, _root, key, _root_mtx);
-            auto [success, stat] = _leaf_map.get(nodeid)->tryPut(key, val, mutex);
+            pgid_t nodeid;
+            auto par = downLeaf(key, nodeid);
+            auto [success, stat] = _leaf_map.get(nodeid)->tryPut(key, val, par);
             // success! only change the leafnode.
             if(success) {
                 return stat;
@@ -129,7 +811,7 @@ public:
         }
 
         // must be locked here.
-        auto prev = _root;
+        pgid_t prev = _root;
         _root = g_pa->allocPage(1);
         //std::cout << "root " << prev << " change to " << _root << "\n";
         InnerNode::newOnDisk(_root, entry.key, prev, entry.val, _cmp);
@@ -139,12 +821,21 @@ public:
         return stat;
     }
 
-    Status del(std::string &key) {
+    Status doDel(std::string &key) {
+        if(g_option.split_mode == SplitMode::blink) {
+            auto nodeid = linkDown(key);
+            while(true) {
+                auto [done, stat] = _leaf_map.get(nodeid)->linkDel(key, nodeid);
+                if(done) {
+                    return stat;
+                }
+            }
+        }
         {
             //try put at first.
-            _root_mtx.lock_shared();
-            auto [nodeid, mutex] = down(_height, _root, key, _root_mtx);
-            auto [success, stat] = _leaf_map.get(nodeid)->tryDel(key, mutex);
+            pgid_t nodeid;
+            auto par = downLeaf(key, nodeid);
+            auto [success, stat] = _leaf_map.get(nodeid)->tryDel(key, par);
             // success! only change the leafnode.
             if(success) {
                 return stat;
@@ -170,7 +861,7 @@ public:
             // only one child in node
             if(root->empty()) {
                 DEBUGOUT("=====> root change");
-                auto old = _root;
+                pgid_t old = _root;
                 _root = root->tochild();
                 _height--;
                 g_db->updateRoot(_name, _root, _height);
@@ -182,7 +873,115 @@ public:
         return stat;
     }
 
-private:
+    // no other op is on the tree, the key stays as found.
+    Status apply(WriteBatch::Op &op) {
+        if(op.del) {
+            auto stat = doDel(op.key);
+            return stat.getErrmsg() == error::keyNotFind ? Status() : stat;
+        }
+        auto stat = doPut(op.key, op.val);
+        if(stat.getErrmsg() == error::keyRepeat) {
+            return doUpdate(op.key, op.val);
+        }
+        return stat;
+    }
+
+    // blink mode (Lehman and Yao), each node has a high key and a link to
+    // its right. a split moves the upper half right and is seen through the
+    // link before its parent knows, so only the node changed is latched
+    // and the new key goes up level by level after.
+    // ===================================================================
+
+    // find the node for key at height level. path[h] gets the node passed
+    // at height h, the parent of a node split later is it or right of it.
+    pgid_t linkDown(std::string &key, u32 level = 1, 
+            std::vector<pgid_t> *path = nullptr, u32 *at = nullptr) {
+        u64 v;
+        pgid_t nodeid;
+        u32 height;
+        do {
+            _root_mtx.readVersion(v);
+            nodeid = _root;
+            height = _height;
+        }while(!_root_mtx.validate(v));
+
+        if(path) {
+            path->assign(height + 1, 0);
+        }
+        while(height > level) {
+            pgid_t id;
+            if(!_inner_map.get(nodeid)->linkGet(key, id)) {
+                nodeid = id;
+                continue;
+            }
+            if(path) {
+                (*path)[height] = nodeid;
+            }
+            nodeid = id;
+            height--;
+        }
+        if(at) {
+            *at = height;
+        }
+        return nodeid;
+    }
+
+    Status linkPut(std::string &key, std::string &val) {
+        std::vector<pgid_t> path;
+        auto nodeid = linkDown(key, 1, &path);
+        PutEntry entry;
+        while(true) {
+            auto [done, stat] = 
+                _leaf_map.get(nodeid)->linkPut(key, val, entry, nodeid);
+            if(!done) {
+                continue;
+            }
+            if(!stat.ok()) {
+                return stat;
+            }
+            break;
+        }
+        // nodeid at height h is split, put its new right node to parent.
+        for(u32 h = 1; entry.update; h++) {
+            pgid_t parent;
+            if(h + 1 < path.size()) {
+                parent = path[h + 1];
+            }else if(growRoot(h, nodeid, entry)) {
+                break;
+            }else {
+                parent = linkDown(entry.key, h + 1);
+            }
+            PutEntry upper;
+            while(!_inner_map.get(parent)->linkPut(
+                        entry.key, entry.val, upper, parent)) {}
+            nodeid = parent;
+            entry = upper;
+        }
+        return Status();
+    }
+
+    // node at height h was the root when we came down, make a new root
+    // over it if it still is. false if the tree has grown by others.
+    bool growRoot(u32 h, pgid_t nodeid, PutEntry &entry) {
+        while(true) {
+            {
+                std::lock_guard lg(_root_mtx);
+                if(_height > h) {
+                    return false;
+                }
+                if(_root == nodeid) {
+                    pgid_t root = g_pa->allocPage(1);
+                    InnerNode::newOnDisk(root, entry.key, nodeid, entry.val, _cmp);
+                    _root = root;
+                    _height++;
+                    g_db->updateRoot(_name, _root, _height);
+                    return true;
+                }
+            }
+            // the root is split too, wait for its writer to grow the tree.
+            std::this_thread::yield();
+        }
+    }
 
     Status _del(u32 height, pgid_t nodeid, std::string &key,
                 DelEntry &entry, 
@@ -232,54 +1031,142 @@ private:
                          entry, lg_tlb);
     }
 
-    std::tuple<pgid_t, std::shared_mutex &> down(
+    // find the leaf for key, return the parent to release once the leaf
+    // is latched.
+    Coupling downLeaf(std::string &key, pgid_t &leaf) {
+        if(g_option.latch_mode == LatchMode::pessimistic) {
+            _root_mtx.lock_shared();
+            auto [nodeid, mutex] = down(_height, _root, key, _root_mtx);
+            leaf = nodeid;
+            return Coupling(mutex);
+        }
+        Coupling par;
+        while(!optDown(key, leaf, par)) {}
+        return par;
+    }
+
+    // go down without latch on any inner node, each child id is trusted
+    // only after the version of its node is validated. false if a writer
+    // came on the way, start over.
+    bool optDown(std::string &key, pgid_t &leaf, Coupling &par) {
+        VersionLatch *plock = &_root_mtx;
+        u64 pv, v;
+        plock->readVersion(pv);
+        pgid_t nodeid = _root;
+        u32 height = _height;
+        if(!plock->validate(pv)) {
+            return false;
+        }
+        for(; height > 1; height--) {
+            auto node = _inner_map.get(nodeid);
+            auto &latch = node->getMutex();
+            if(!latch.readVersion(v) || !plock->validate(pv)) {
+                return false;
+            }
+            bool right;
+            if(!node->optGet(key, nodeid, right) || !latch.validate(v) 
+                    || right) {
+                return false;
+            }
+            plock = &latch;
+            pv = v;
+        }
+        leaf = nodeid;
+        par = Coupling(*plock, pv);
+        return true;
+    }
+
+    // the node for key at height level, and the latch of its parent which
+    // is left latched shared.
+    std::tuple<pgid_t, VersionLatch &> down(
         u32 height, pgid_t nodeid , std::string &key, 
-        std::shared_mutex &par_mtx) {
+        VersionLatch &par_mtx, u32 level = 1) {
 
-        if(height == 1) {
+        if(height == level) {
             return std::forward_as_tuple(nodeid, par_mtx);
         }
         auto node = _inner_map.get(nodeid);
         auto [id, pos] = node->get(key, par_mtx);
         (void)pos;
-        if(height == 2) {
+        if(height == level + 1) {
             return std::forward_as_tuple(id, node->getMutex());
         }
-        return down(height - 1, id, key, node->getMutex()); 
+        return down(height - 1, id, key, node->getMutex(), level); 
     }
 
-    pgid_t down(u32 height, pgid_t nodeid, std::string &key) {
-        if(height == 1) {
+    pgid_t down(u32 height, pgid_t nodeid, std::string &key, u32 level = 1) {
+        if(height <= level) {
             return nodeid;
         }
         auto node = _inner_map.get(nodeid);
         auto [id, pos] = node->get(key);
         (void)pos;
-        if(height == 2) {
-            return id;
+        return down(height - 1, id, key, level); 
+    }
+
+    // !!!without lock, only used by iterator.
+    // ==================================================================
+
+    // page reads in it see the snapshot of tree, if any.
+    SnapshotScope scope() {
+        return SnapshotScope(_snap ? _snap->seq() : 0);
+    }
+
+    // the leaf of keys before key, the last leaf if key is null. low is the
+    // least key the leaf may hold, haslow is false for the first leaf.
+    pgid_t downBefore(std::string *key, std::string &low, bool &haslow) {
+        haslow = false;
+        pgid_t nodeid = _root;
+        for(u32 h = _height; h > 1; h--) {
+            nodeid = _inner_map.get(nodeid)->before(key, low, haslow);
+        }
+        return nodeid;
+    }
+
+    // up to n leaves right of the leaf of key, or left of it, for read
+    // ahead. left ones are taken from its parent only.
+    std::vector<pgid_t> around(std::string &key, u32 n, bool forward) {
+        std::vector<pgid_t> ids;
+        if(_height == 1) {
+            return ids;
+        }
+        auto nodeid = down(_height, _root, key, 2);
+        std::string *from = &key;
+        while(nodeid && ids.size() < n) {
+            nodeid = _inner_map.get(nodeid)->children(from, n, forward, ids);
+            if(!forward) {
+                break;
+            }
+            from = nullptr;
         }
-        return down(height - 1, id, key); 
+        return ids;
     }
 
-    std::shared_mutex &mutex() {
+    VersionLatch &mutex() {
         return _root_mtx;
     }
 
     void debug() {
+        EpochGuard epoch;
         if(_height > 1) {
             _inner_map.get(_root)->debug(_height);
         }
     }
 
     u32           _order{0};
-    u32           _height{0};
-    pgid_t        _root{0};
+    // read by optimistic lookups without latch.
+    std::atomic<u32>    _height{0};
+    std::atomic<pgid_t> _root{0};
     pgid_t        _first{0};
     std::string   _name;
     comparator_t  _cmp;
-    std::shared_mutex  _root_mtx;
+    BucketType    _type;
+    VersionLatch  _root_mtx; // also guards _root and _height
+    TreeGate      _gate;     // shared by ops, exclusive by compaction
+    std::atomic<u64> _moves{0}; // batches of nodes moved
     NodeMap <LeafNode>  _leaf_map;
     NodeMap <InnerNode> _inner_map;
+    std::shared_ptr<SnapshotRef> _snap; // the snapshot of a read only tree
 };
 
 }// namespace bptdb
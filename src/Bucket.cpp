@@ -8,6 +8,11 @@ std::tuple<Status, std::string> Bucket::get(std::string &key) {
     return _impl->get(key);
 }
 
+std::vector<std::tuple<Status, std::string>> 
+Bucket::multiGet(std::vector<std::string> &keys) {
+    return _impl->multiGet(keys);
+}
+
 Status Bucket::update(std::string &key, std::string &val) {
     return _impl->update(key, val);
 }
@@ -28,6 +33,19 @@ std::shared_ptr<IteratorBase> Bucket::at(std::string &key) {
     return _impl->at(key);
 }
 
+std::shared_ptr<IteratorBase> Bucket::seek(std::string &key) {
+    return _impl->seek(key);
+}
+
+std::shared_ptr<IteratorBase> Bucket::last() {
+    return _impl->last();
+}
+
+std::shared_ptr<IteratorBase> Bucket::range(std::string &lower, 
+        std::string &upper, bool reverse) {
+    return _impl->range(lower, upper, reverse);
+}
+
 Bucket::Bucket(std::shared_ptr<Bptree> impl) {
     _impl = impl;
 }
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include "Status.h"
 #include "IteratorBase.h"
@@ -17,12 +19,23 @@ public:
     Bucket(std::shared_ptr<Bptree> impl);
     ~Bucket();
     std::tuple<Status, std::string> get(std::string &key);
+    // get many keys at once, results are in order of keys.
+    std::vector<std::tuple<Status, std::string>> 
+    multiGet(std::vector<std::string> &keys);
     Status update(std::string &key, std::string &val);
     Status put(std::string &key, std::string &val);
     Status del(std::string &key);
     std::shared_ptr<IteratorBase> begin();
     std::shared_ptr<IteratorBase> at(std::string &key);
+    // at the first key not less than key.
+    std::shared_ptr<IteratorBase> seek(std::string &key);
+    // at the last key, go back by prev().
+    std::shared_ptr<IteratorBase> last();
+    // keys in [lower, upper), from the first, or from the last if reverse.
+    std::shared_ptr<IteratorBase> range(std::string &lower, 
+            std::string &upper, bool reverse = false);
 private:
+    friend class WriteBatch;
     std::shared_ptr<Bptree> _impl;
 };
 
@@ -0,0 +1,206 @@
+#ifndef __BULK_LOADER_H
+#define __BULK_LOADER_H
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "Blob.h"
+#include "FileManager.h"
+#include "InnerNodeImpl.h"
+#include "LeafNodeImpl.h"
+#include "PageAllocator.h"
+#include "Status.h"
+
+namespace bptdb {
+
+// build a b+tree from keys in order. nodes are filled left to right to
+// fill percent of order, each level up is built as the one below finishes
+// its nodes. pages come fresh from the end of file and are written to it
+// straight, neither cache nor log has a copy of them.
+class BulkLoader {
+public:
+    BulkLoader(u32 order, u32 fill, comparator_t cmp): _cmp(cmp) {
+        _order = order;
+        _cap = std::max(2u, order * std::min(fill, 100u) / 100);
+        _levels.emplace_back();
+    }
+
+    Status add(std::string &key, std::string &val) {
+        if(_count && !_cmp(_last, key)) {
+            return Status(error::keyNotSorted);
+        }
+        _last = key;
+        _count++;
+        auto &kvs = _levels[0].kvs;
+        bool large = Blob::large(val.size());
+        if(large) {
+            // written ahead of its leaf, the leaf keeps the ref.
+            Blob::Ref ref{0, (u32)val.size()};
+            ref.pos = g_pa->allocTail(Blob::pages(ref));
+            _extents.emplace_back(ref.pos, Blob::pages(ref));
+            auto img = Blob::image(val);
+            emit(ref.pos, img);
+            kvs.emplace_back(key, Blob::bytes(ref));
+        }else {
+            kvs.emplace_back(key, val);
+        }
+        _levels[0].blobs.push_back(large);
+        if(kvs.size() > _cap + _cap / 2) {
+            finish(0, _cap);
+        }
+        return Status();
+    }
+
+    // finish all levels, data is durable on return.
+    BptreeMeta finish() {
+        for(u32 h = 0; h < _levels.size(); h++) {
+            auto &l = _levels[h];
+            u32 n = h == 0 ? l.kvs.size() : l.ents.size();
+            // split what is left in two, never leave a node nearly empty.
+            if(n > _cap) {
+                finish(h, n / 2);
+                n = h == 0 ? _levels[h].kvs.size() : _levels[h].ents.size();
+            }
+            finish(h, n);
+            emit(_levels[h].pending_id, _levels[h].pending);
+        }
+        flush();
+        g_fm->sync();
+
+        BptreeMeta meta;
+        meta.root   = _levels.back().first;
+        meta.first  = _levels[0].first;
+        meta.height = _levels.size();
+        meta.order  = _order;
+        return meta;
+    }
+
+    // give back all pages taken.
+    void abort() {
+        for(auto &[id, len]: _extents) {
+            g_pa->freePage(id, len);
+        }
+        _extents.clear();
+    }
+
+private:
+    // the nodes being built at a height.
+    struct Level {
+        u32 nodes{0};       // nodes finished
+        pgid_t first{0};    // the first node
+        std::string sep;    // key before the node being filled
+        // records not in a node yet, kvs on leaf, head and ents on inner.
+        std::vector<std::pair<std::string, std::string>> kvs;
+        std::vector<bool> blobs; // vals of kvs that are refs
+        pgid_t head{0};
+        std::vector<std::pair<std::string, pgid_t>> ents;
+        // the last node finished, waits for the id of its next.
+        std::string pending;
+        pgid_t pending_id{0};
+    };
+
+    // node child at height h - 1 is finished, sep is the key before it.
+    void put(u32 h, std::string &sep, pgid_t child) {
+        if(h == _levels.size()) {
+            _levels.emplace_back();
+        }
+        auto &l = _levels[h];
+        if(!l.head) {
+            l.head = child;
+            return;
+        }
+        l.ents.emplace_back(sep, child);
+        if(l.ents.size() > _cap + _cap / 2) {
+            finish(h, _cap);
+        }
+    }
+
+    // make a node of the first n records at height h. the key after them,
+    // or the shortest one above the last of them for leaves, is its high
+    // key and goes up with the node right of it.
+    void finish(u32 h, u32 n) {
+        auto &l = _levels[h];
+        std::string high;
+        std::string img;
+        if(h == 0) {
+            bool last = n == l.kvs.size();
+            if(!last && bytewise(_cmp)) {
+                high = SlotDir<LeafNodeImpl::Elem>::between(
+                        l.kvs[n - 1].first, l.kvs[n].first);
+            }else if(!last) {
+                high = l.kvs[n].first;
+            }
+            img = LeafNodeImpl::image(l.kvs, l.blobs, n, 
+                    last ? nullptr : &high, bytewise(_cmp));
+            l.kvs.erase(l.kvs.begin(), l.kvs.begin() + n);
+            l.blobs.erase(l.blobs.begin(), l.blobs.begin() + n);
+        }else {
+            bool last = n == l.ents.size();
+            if(!last) {
+                high = l.ents[n].first;
+            }
+            img = InnerNodeImpl::image(l.head, l.ents, n,
+                    last ? nullptr : &high, bytewise(_cmp));
+            l.head = last ? 0 : l.ents[n].second;
+            l.ents.erase(l.ents.begin(), l.ents.begin() + (last ? n : n + 1));
+        }
+        u32 len = img.size() / g_option.page_size;
+        pgid_t id = g_pa->allocTail(len);
+        _extents.emplace_back(id, len);
+        if(l.nodes) {
+            ((PageHeader *)l.pending.data())->next = id;
+            emit(l.pending_id, l.pending);
+        }
+        l.pending = std::move(img);
+        l.pending_id = id;
+        std::string sep = std::move(l.sep);
+        l.sep = std::move(high);
+        if(++l.nodes == 1) {
+            l.first = id;
+            return;
+        }
+        // a second node at h, so there is a level above.
+        if(l.nodes == 2) {
+            std::string none;
+            put(h + 1, none, l.first);
+        }
+        put(h + 1, sep, id);
+    }
+
+    // write img at id, consecutive pages are written at once.
+    void emit(pgid_t id, std::string &img) {
+        if(!_buf.empty() && (_buf_id + _buf.size() / g_option.page_size != id
+                    || _buf.size() >= BUF_SIZE)) {
+            flush();
+        }
+        if(_buf.empty()) {
+            _buf_id = id;
+        }
+        _buf.append(img);
+    }
+
+    void flush() {
+        if(!_buf.empty()) {
+            g_fm->write(_buf.data(), _buf.size(), page2off(_buf_id));
+            _buf.clear();
+        }
+    }
+
+    static constexpr u32 BUF_SIZE = 1 << 20;
+
+    comparator_t _cmp;
+    u32  _order{0};
+    u32  _cap{0};
+    u64  _count{0};
+    std::string _last;
+    std::vector<Level> _levels;
+    std::vector<std::pair<pgid_t, u32>> _extents;
+    std::string _buf;
+    pgid_t _buf_id{0};
+};
+
+}// namespace bptdb
+
+#endif
@@ -1,18 +1,26 @@
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string_view>
 #include <algorithm>
 #include <cstdlib>
 #include <thread>
+#include <chrono>
+#include <climits>
 #include <cstring>
+#include <map>
 #include "DB.h"
 #include "DBImpl.h"
 #include "PageAllocator.h"
 #include "PageCache.h"
 #include "FileManager.h"
+#include "IoEngine.h"
 #include "Bucket.h"
 #include "common.h"
 #include "Bptree.h"
+#include "BulkLoader.h"
+#include "SnapshotManager.h"
+#include "Wal.h"
 
 namespace bptdb {
 DBImpl *g_db;
@@ -24,9 +32,21 @@ DB::DB() {
 }
 
 DB::~DB() {
-    g_pc->stop();
+    // pages go to disk first, then log can be dropped.
+    if(g_pa) {
+        g_pa->drain();
+    }
+    if(g_pc) {
+        g_pc->stop();
+    }
+    if(g_wal) {
+        g_wal->stop();
+    }
     g_pc.reset();
+    g_wal.reset();
+    g_snap.reset();
     g_pa.reset();
+    g_io.reset();
     g_fm.reset();    
 }
 
@@ -48,9 +68,48 @@ DB::getBucket(std::string name, comparator_t cmp) {
     return _impl->getBucket(name, cmp);
 }
 
+std::tuple<Status, Bucket>
+DB::getBucket(std::string name, Snapshot &snap, comparator_t cmp) {
+    return _impl->getBucket(name, snap, cmp);
+}
+
+std::tuple<Status, Bucket>
+DB::createBucket(std::string name, BucketType type) {
+    return _impl->createBucket(name, std::less<std::string_view>(), type);
+}
+
+std::tuple<Status, Bucket>
+DB::getBucket(std::string name, BucketType type) {
+    return _impl->getBucket(name, std::less<std::string_view>(), type);
+}
+
+std::tuple<Status, Bucket>
+DB::getBucket(std::string name, Snapshot &snap, BucketType type) {
+    return _impl->getBucket(name, snap, std::less<std::string_view>(), type);
+}
+
+Snapshot DB::snapshot() {
+    return _impl->snapshot();
+}
+
+std::tuple<Status, Bucket>
+DB::bulkLoadBucket(std::string name, BulkSource src, std::uint32_t fill,
+                   comparator_t cmp) {
+    return _impl->bulkLoadBucket(name, src, fill, cmp);
+}
+
+Status DB::write(WriteBatch &batch) {
+    return _impl->write(batch);
+}
+
+Status DB::compact(std::uint32_t budget, bool sort) {
+    return _impl->compact(budget, sort);
+}
+
 Status DBImpl::open(std::string path, bool creat, Option option) {
     // FIXME check meta if file exist
     g_option = option;
+    _trees.clear();
     // test file
     std::fstream file(path, std::ios::in);
     // file is not exist
@@ -67,21 +126,105 @@ Status DBImpl::open(std::string path, bool creat, Option option) {
     // database exist
     // init member data
     _path = path;
+    if(option.read_only) {
+        return openReadOnly();
+    }
     g_fm = std::make_unique<FileManager>(_path, option.sync);
+    g_io = IoEngine::make(_path, g_fm->fd(), option);
+    // redo the txns left in log before anything is read.
+    Wal::replay(_path);
+    g_snap = std::make_unique<SnapshotManager>(_path);
     // read meta
     g_fm->read((char *)&_meta, sizeof(Meta), 0);
-    g_pc = std::make_unique<PageCache>(_meta.max_buffer_pages);
+    startWal(option);
+    g_pc = std::make_unique<PageCache>(
+        _meta.max_buffer_pages, option.cache_policy);
     g_pc->start();
     g_pa = std::make_unique<PageAllocator>(_meta.freelist_id);
+    if(_meta.version < FORMAT_VERSION) {
+        upgrade();
+    }
     _buckets = std::make_shared<Bptree>(
         "__BUCKET_TREE__", _meta.bucket_tree_meta, std::less<std::string_view>());
 
     return Status();
 }
 
+// the file is mapped and never written, there is no log. a file left
+// with records in log or made by an older version is refused.
+Status DBImpl::openReadOnly() {
+    if(Wal::pending(_path)) {
+        return Status(error::needWrite);
+    }
+    g_fm = std::make_unique<FileManager>(_path, false, true);
+    std::memcpy(&_meta, g_fm->at(0), sizeof(Meta));
+    if(_meta.version < FORMAT_VERSION) {
+        g_fm.reset();
+        return Status(error::needWrite);
+    }
+    g_snap = std::make_unique<SnapshotManager>(_path);
+    g_pc = std::make_unique<PageCache>(
+        _meta.max_buffer_pages, g_option.cache_policy);
+    g_pc->start();
+    g_pa = std::make_unique<PageAllocator>(_meta.freelist_id);
+    _buckets = std::make_shared<Bptree>(
+        "__BUCKET_TREE__", _meta.bucket_tree_meta, std::less<std::string_view>());
+    return Status();
+}
+
+// rewrite every node of a file made by an older version. each node goes
+// in a txn with the count of nodes done so far in meta, a crash in the
+// middle goes on from there once opened again, the version is bumped at
+// last. with no log nothing is atomic, a crash may leave nodes of both
+// formats and the file broken, as a crash in any write does then.
+void DBImpl::upgrade() {
+    DEBUGOUT("upgrade format %u to %u from node %u", _meta.version,
+            FORMAT_VERSION, _meta.upgraded);
+    u32 seq = 0, skip = _meta.upgraded;
+    auto done = [this](u32 seq) {
+        _meta.upgraded = seq;
+        writeMeta();
+    };
+    auto &tree_meta = _meta.bucket_tree_meta;
+    Bptree::upgrade(tree_meta.root, tree_meta.height, _meta.version,
+            seq, skip, done);
+
+    // the bucket tree is readable now, walk all buckets.
+    Bptree buckets("__BUCKET_TREE__", tree_meta, std::less<std::string_view>());
+    for(auto it = buckets.begin(); !it->done(); it->next()) {
+        BptreeMeta meta;
+        std::memcpy(&meta, it->val().data(), sizeof(BptreeMeta));
+        Bptree::upgrade(meta.root, meta.height, _meta.version,
+                seq, skip, done);
+    }
+
+    WalTxn txn;
+    _meta.version = FORMAT_VERSION;
+    _meta.upgraded = 0;
+    writeMeta();
+}
+
+void DBImpl::writeMeta() {
+    std::string buf(g_option.page_size, 0);
+    std::memcpy(buf.data(), &_meta, sizeof(_meta));
+    g_pc->write(0, buf.data());
+}
+
+void DBImpl::startWal(Option option) {
+    if(option.commit_mode == CommitMode::none) {
+        return;
+    }
+    g_wal = std::make_unique<Wal>(_path, option.commit_mode, option.wal_limit);
+    g_wal->start();
+}
+
 Status DBImpl::create(std::string path, Option option) {
 
     g_option = option;
+    _trees.clear();
+    if(option.read_only) {
+        return Status(error::DbCreatFailed);
+    }
     // create file 
     std::fstream file(path, std::ios::out);
     if(!file.is_open()) {
@@ -101,6 +244,8 @@ void DBImpl::init(Option option) {
     _meta.page_size = option.page_size;
     _meta.max_buffer_pages = option.max_buffer_pages;
     _meta.freelist_id = 1;
+    _meta.version = FORMAT_VERSION;
+    _meta.upgraded = 0;
     auto tree_meta = &_meta.bucket_tree_meta;
     tree_meta->root = 2;
     tree_meta->first = 2;
@@ -109,12 +254,20 @@ void DBImpl::init(Option option) {
 
     // create filemanager firstly
     g_fm = std::make_unique<FileManager>(_path, option.sync);
-    // write meta
-    g_fm->write((char *)&_meta, sizeof(_meta), 0);
+    g_io = IoEngine::make(_path, g_fm->fd(), option);
+    // a log of the file removed before is of no use.
+    Wal::remove(_path);
+    g_snap = std::make_unique<SnapshotManager>(_path);
+    startWal(option);
     // create pagecache 
-    g_pc = std::make_unique<PageCache>(_meta.max_buffer_pages);
+    g_pc = std::make_unique<PageCache>(
+        _meta.max_buffer_pages, option.cache_policy);
     g_pc->start();
 
+    WalTxn txn;
+    // write meta
+    writeMeta();
+
     // init pageAllocator on disk
     PageAllocator::newOnDisk(_meta.freelist_id, _meta.freelist_id + 2);
     g_pa = std::make_unique<PageAllocator>(_meta.freelist_id);
@@ -129,17 +282,23 @@ void DBImpl::init(Option option) {
 }
 
 std::tuple<Status, Bucket> 
-DBImpl::createBucket(std::string name, comparator_t cmp) {
+DBImpl::createBucket(std::string name, comparator_t cmp, BucketType type) {
 
+    if(g_option.read_only) {
+        return std::forward_as_tuple(Status(error::readOnly), Bucket());
+    }
+    // a snapshot never sees the bucket before its root is on disk.
+    WriteScope scope;
+    WalTxn txn;
     BptreeMeta meta;
     auto id = g_pa->allocPage(1);
     meta.root = id;
     meta.first = id;
     meta.height = 1;
     // TODO set right order
-    meta.order = 128;
+    meta.order = BUCKET_ORDER;
 
-    std::string val((char *)&meta, sizeof(BptreeMeta));
+    std::string val = bucketVal(meta, type);
 
     auto stat =  _buckets->put(name, val);
     if(!stat.ok()) {
@@ -148,27 +307,244 @@ DBImpl::createBucket(std::string name, comparator_t cmp) {
         return std::forward_as_tuple(stat, Bucket());
     }
     Bptree::newOnDisk(meta.root);
-    return std::forward_as_tuple(
-        stat, Bucket(std::make_shared<Bptree>(name, meta, cmp)));
+    stat = txn.commit(stat);
+    if(!stat.ok()) {
+        return std::forward_as_tuple(stat, Bucket());
+    }
+    return std::forward_as_tuple(stat, Bucket(tree(name, meta, cmp, type)));
 }
 
 std::tuple<Status, Bucket> 
-DBImpl::getBucket(std::string name, comparator_t cmp) {
-
+DBImpl::getBucket(std::string name, comparator_t cmp, BucketType type) {
+    std::lock_guard lg(_trees_mtx);
+    if(auto it = _trees.find(name); it != _trees.end()) {
+        if(!(it->second->type() == type)) {
+            return std::forward_as_tuple(Status(error::bucketTypeErr), 
+                    Bucket());
+        }
+        return std::forward_as_tuple(Status(), Bucket(it->second));
+    }
     BptreeMeta meta;
     auto [stat, val] =  _buckets->get(name);
     if(!stat.ok()) {
         return std::forward_as_tuple(stat, Bucket());
     }
+    if(!(bucketType(val) == type)) {
+        return std::forward_as_tuple(Status(error::bucketTypeErr), Bucket());
+    }
     std::memcpy(&meta, val.data(), sizeof(BptreeMeta));
-    return std::forward_as_tuple(
-        stat, Bucket(std::make_shared<Bptree>(name, meta, cmp)));
+    auto &ret = _trees[name];
+    ret = std::make_shared<Bptree>(name, meta, cmp, nullptr, type);
+    return std::forward_as_tuple(stat, Bucket(ret));
+}
+
+// the meta on page 0 and the bucket tree are read as snap sees them, so
+// is the tree of bucket after.
+std::tuple<Status, Bucket> 
+DBImpl::getBucket(std::string name, Snapshot &snap, comparator_t cmp, 
+                  BucketType type) {
+    if(!snap._ref) {
+        return std::forward_as_tuple(Status(error::noSnapshot), Bucket());
+    }
+    Meta meta;
+    std::string buf(g_option.page_size, 0);
+    g_snap->read(0, snap._ref->seq(), buf.data());
+    std::memcpy(&meta, buf.data(), sizeof(Meta));
+    Bptree buckets("__BUCKET_TREE__", meta.bucket_tree_meta, 
+            std::less<std::string_view>(), snap._ref);
+    auto [stat, val] = buckets.get(name);
+    if(!stat.ok()) {
+        return std::forward_as_tuple(stat, Bucket());
+    }
+    if(!(bucketType(val) == type)) {
+        return std::forward_as_tuple(Status(error::bucketTypeErr), Bucket());
+    }
+    BptreeMeta tree_meta;
+    std::memcpy(&tree_meta, val.data(), sizeof(BptreeMeta));
+    return std::forward_as_tuple(stat, Bucket(
+        std::make_shared<Bptree>(name, tree_meta, cmp, snap._ref, type)));
+}
+
+Snapshot DBImpl::snapshot() {
+    Snapshot snap;
+    snap._ref = std::make_shared<SnapshotRef>(g_snap->take());
+    return snap;
+}
+
+std::tuple<Status, Bucket> 
+DBImpl::bulkLoadBucket(std::string name, BulkSource src, u32 fill,
+                       comparator_t cmp) {
+    if(g_option.read_only) {
+        return std::forward_as_tuple(Status(error::readOnly), Bucket());
+    }
+    {
+        auto [stat, val] = _buckets->get(name);
+        if(stat.ok()) {
+            return std::forward_as_tuple(Status(error::keyRepeat), Bucket());
+        }
+    }
+    BulkLoader loader(BUCKET_ORDER, fill, cmp);
+    std::string key, val;
+    while(src(key, val)) {
+        auto stat = loader.add(key, val);
+        if(!stat.ok()) {
+            loader.abort();
+            return std::forward_as_tuple(stat, Bucket());
+        }
+    }
+    // the tree is on disk, it is seen once the bucket tree has it.
+    auto meta = loader.finish();
+    // the scope goes first, a txn never waits for a snapshot to be taken.
+    WriteScope scope;
+    WalTxn txn;
+    std::string metaval((char *)&meta, sizeof(BptreeMeta));
+    auto stat = _buckets->put(name, metaval);
+    if(!stat.ok()) {
+        loader.abort();
+        return std::forward_as_tuple(stat, Bucket());
+    }
+    stat = txn.commit(stat);
+    if(!stat.ok()) {
+        return std::forward_as_tuple(stat, Bucket());
+    }
+    return std::forward_as_tuple(stat, Bucket(tree(name, meta, cmp)));
+}
+
+std::shared_ptr<Bptree> 
+DBImpl::tree(std::string &name, BptreeMeta &meta, comparator_t cmp,
+             BucketType type) {
+    std::lock_guard lg(_trees_mtx);
+    auto &ret = _trees[name];
+    if(!ret) {
+        ret = std::make_shared<Bptree>(name, meta, cmp, nullptr, type);
+    }
+    return ret;
 }
 
-void DBImpl::updateRoot(std::string &name, pgid_t newroot, u32 height) {
+std::string DBImpl::bucketVal(BptreeMeta &meta, BucketType type) {
+    std::string val((char *)&meta, sizeof(BptreeMeta));
+    if(type.typed()) {
+        val.append((char *)&type, sizeof(BucketType));
+    }
+    return val;
+}
+
+BucketType DBImpl::bucketType(std::string &val) {
+    BucketType type;
+    if(val.size() >= sizeof(BptreeMeta) + sizeof(BucketType)) {
+        std::memcpy(&type, val.data() + sizeof(BptreeMeta), 
+                sizeof(BucketType));
+    }
+    return type;
+}
+
+Status DBImpl::write(WriteBatch &batch) {
+    // one txn for all, a crash keeps the whole batch or none of it. it
+    // runs alone, or its pages and those of other txns may wait on each
+    // other at commit. the trees are held exclusive in address order, so
+    // no reader sees part of it.
+    std::map<Bptree *, std::vector<WriteBatch::Op *>> groups;
+    for(auto &[tree, op]: batch._ops) {
+        if(tree->readOnly()) {
+            return Status(error::readOnly);
+        }
+        if(!tree->fits(op.key, op.del ? nullptr : &op.val)) {
+            return Status(error::bucketTypeErr);
+        }
+        groups[tree.get()].push_back(&op);
+    }
+    WriteScope scope;
+    WalTxn txn(true);
+    std::vector<std::unique_lock<TreeGate>> gates;
+    for(auto &[tree, ops]: groups) {
+        gates.emplace_back(tree->gate());
+    }
+    Status stat;
+    for(auto &[tree, ops]: groups) {
+        stat = tree->write(ops);
+        if(!stat.ok()) {
+            break;
+        }
+    }
+    gates.clear();
+    return txn.commit(stat);
+}
+
+// a pass over all buckets moves the nodes past the pages in use, then
+// one reads the leaves too if their extra pages are still in the way.
+// the file is cut at last, not while a snapshot may read a page cut.
+Status DBImpl::compact(u32 budget, bool sort) {
+    if(g_option.read_only) {
+        return Status(error::readOnly);
+    }
+    g_pa->drain();
+    std::vector<std::string> names{"__BUCKET_TREE__"};
+    for(auto it = _buckets->begin(); !it->done(); it->next()) {
+        names.emplace_back(it->key());
+    }
+    u32 left = budget ? budget : UINT32_MAX;
+    for(bool deep: {false, true}) {
+        if(deep && g_pa->tail() <= g_pa->used()) {
+            break;
+        }
+        for(auto &name: names) {
+            u32 cursor = 0;
+            do {
+                u32 batch = std::min(left, std::max(g_option.compact_batch, 1u));
+                left -= std::min(left, compact(name, batch, sort, deep, cursor));
+                if(cursor && left) {
+                    std::this_thread::sleep_for(
+                        std::chrono::milliseconds(g_option.compact_pause));
+                }
+            }while(cursor && left);
+        }
+        // leaves are in order after one pass.
+        sort = false;
+    }
+    if(g_wal && g_wal->failed()) {
+        return Status(error::logFailed);
+    }
+    WriteScope scope;
+    if(!g_snap->active()) {
+        g_pa->drain();
+        g_pc->flushAll();
+        g_fm->sync();
+        g_pa->shrink();
+    }
+    return Status();
+}
+
+u32 DBImpl::compact(std::string &name, u32 budget, bool sort, bool deep,
+                    u32 &cursor) {
+    auto end = g_pa->used();
+    if(name == "__BUCKET_TREE__") {
+        return _buckets->compact(budget, end, sort, deep, cursor);
+    }
+    // a bucket not opened is left, its comparator is known only to the
+    // one who opens it, and nodes are rewritten by it.
+    std::shared_ptr<Bptree> tree;
+    {
+        std::lock_guard lg(_trees_mtx);
+        if(auto it = _trees.find(name); it != _trees.end()) {
+            tree = it->second;
+        }
+    }
+    if(!tree) {
+        cursor = 0;
+        return 0;
+    }
+    return tree->compact(budget, end, sort, deep, cursor);
+}
+
+void DBImpl::updateRoot(std::string &name, pgid_t newroot, u32 height, 
+                        pgid_t first) {
     if(name == "__BUCKET_TREE__") {
         _meta.bucket_tree_meta.root = newroot;
         _meta.bucket_tree_meta.height = height;
+        if(first) {
+            _meta.bucket_tree_meta.first = first;
+        }
+        writeMeta();
         return;    
     }
     auto [stat, val] = _buckets->get(name);
@@ -176,6 +552,9 @@ void DBImpl::updateRoot(std::string &name, pgid_t newroot, u32 height) {
     BptreeMeta *meta = (BptreeMeta *)val.data();
     meta->root = newroot;
     meta->height = height;
+    if(first) {
+        meta->first = first;
+    }
     stat = _buckets->update(name, val);
     assert(stat.ok());
 }
@@ -4,10 +4,15 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <functional>
 
 #include "Option.h"
+#include "KeySearch.h"
 #include "Status.h"
 #include "Bucket.h"
+#include "TypedBucket.h"
+#include "Snapshot.h"
+#include "WriteBatch.h"
 
 namespace bptdb {
 
@@ -15,6 +20,9 @@ class DBImpl;
 
 constexpr bool DB_CREATE = true;
 
+// gives the next pair of a bulk load in key order, false at the end.
+using BulkSource = std::function<bool(std::string &key, std::string &val)>;
+
 class DB {
 public:
     DB();
@@ -28,6 +36,90 @@ public:
 
     std::tuple<Status, Bucket>
     getBucket(std::string name, comparator_t cmp = std::less<std::string_view>());
+
+    // bucket name as it is in snap, read only.
+    std::tuple<Status, Bucket>
+    getBucket(std::string name, Snapshot &snap, 
+              comparator_t cmp = std::less<std::string_view>());
+
+    // the same with cmp kept as its own type, nodes are searched by a
+    // KeySearchOf<Cmp> with each compare inline. a comparator_t is the
+    // fallback, called through std::function.
+    template <typename Cmp, std::enable_if_t<isKeyOrder<Cmp>, int> = 0>
+    std::tuple<Status, Bucket> createBucket(std::string name, Cmp cmp) {
+        return createBucket(name, searchable(std::move(cmp)));
+    }
+
+    template <typename Cmp, std::enable_if_t<isKeyOrder<Cmp>, int> = 0>
+    std::tuple<Status, Bucket> getBucket(std::string name, Cmp cmp) {
+        return getBucket(name, searchable(std::move(cmp)));
+    }
+
+    template <typename Cmp, std::enable_if_t<isKeyOrder<Cmp>, int> = 0>
+    std::tuple<Status, Bucket>
+    getBucket(std::string name, Snapshot &snap, Cmp cmp) {
+        return getBucket(name, snap, searchable(std::move(cmp)));
+    }
+
+    // a bucket of fixed size records, see BucketType. its keys sort as
+    // bytes, a bucket of another type is not opened by it.
+    std::tuple<Status, Bucket>
+    createBucket(std::string name, BucketType type);
+
+    std::tuple<Status, Bucket>
+    getBucket(std::string name, BucketType type);
+
+    std::tuple<Status, Bucket>
+    getBucket(std::string name, Snapshot &snap, BucketType type);
+
+    // the same with keys of K and vals of V, see TypedBucket.
+    template <typename K, typename V>
+    std::tuple<Status, TypedBucket<K, V>> createBucket(std::string name) {
+        auto [stat, bucket] = createBucket(name, TypedBucket<K, V>::type());
+        return std::make_tuple(stat, TypedBucket<K, V>(bucket));
+    }
+
+    template <typename K, typename V>
+    std::tuple<Status, TypedBucket<K, V>> getBucket(std::string name) {
+        auto [stat, bucket] = getBucket(name, TypedBucket<K, V>::type());
+        return std::make_tuple(stat, TypedBucket<K, V>(bucket));
+    }
+
+    template <typename K, typename V>
+    std::tuple<Status, TypedBucket<K, V>> 
+    getBucket(std::string name, Snapshot &snap) {
+        auto [stat, bucket] = getBucket(name, snap, TypedBucket<K, V>::type());
+        return std::make_tuple(stat, TypedBucket<K, V>(bucket));
+    }
+
+    // a view of all buckets as they are now, later writes are not seen
+    // through it. pages changed are kept in memory until it is released.
+    Snapshot snapshot();
+
+    // build a new bucket from src, nodes are filled to fill percent and
+    // written to file straight.
+    std::tuple<Status, Bucket>
+    bulkLoadBucket(std::string name, BulkSource src, std::uint32_t fill = 90,
+                   comparator_t cmp = std::less<std::string_view>());
+
+    template <typename Cmp, std::enable_if_t<isKeyOrder<Cmp>, int> = 0>
+    std::tuple<Status, Bucket>
+    bulkLoadBucket(std::string name, BulkSource src, std::uint32_t fill,
+                   Cmp cmp) {
+        return bulkLoadBucket(name, src, fill, searchable(std::move(cmp)));
+    }
+
+    // apply all ops of batch, one record in log for all of them. readers
+    // of its buckets wait till it is done and never see part of it. a
+    // crash keeps all or none of it only with a log, under
+    // CommitMode::none it is no safer than the ops one by one.
+    Status write(WriteBatch &batch);
+
+    // move nodes to the free pages before them and cut the file, writes
+    // go on meanwhile. at most budget nodes are moved if not 0, all
+    // leaves are put in key order if sort. only the buckets opened are
+    // compacted, the comparator of others is not known.
+    Status compact(std::uint32_t budget = 0, bool sort = false);
 private:
     DBImpl *_impl{nullptr};
 };
@@ -6,6 +6,8 @@
 #include <string_view>
 #include <thread>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
 
 #include "DB.h"
 #include "Status.h"
@@ -14,12 +16,24 @@
 #include "PageCache.h"
 #include "FileManager.h"
 #include "Bucket.h"
+#include "Snapshot.h"
+#include "WriteBatch.h"
 #include "common.h"
 
 namespace bptdb {
  
 class Bptree;
 
+// on disk format, bump it when the layout of page changes.
+// 0: records packed after the node header.
+// 1: nodes carry a slot directory.
+// 2: keys of a node keep their shared prefix once.
+// 3: inner nodes keep the heads of keys after the slots.
+constexpr u32 FORMAT_VERSION = 3;
+
+// order of the nodes of a bucket.
+constexpr u32 BUCKET_ORDER = 128;
+
 class DBImpl {
 public:
     struct Meta {
@@ -28,26 +42,64 @@ public:
         pgid_t freelist_id;
         BptreeMeta bucket_tree_meta;
         u32 checksum;
+        u32 version;
+        u32 upgraded; ///< nodes of an upgrade done, while version is old
     };
     ~DBImpl() {
     }
     Status open(std::string path, bool creat, Option option);
     Status create(std::string path, Option option);
 
+    // a bucket is opened only by the type it was made of.
     std::tuple<Status, Bucket>
-    createBucket(std::string name, comparator_t cmp);
+    createBucket(std::string name, comparator_t cmp, 
+                 BucketType type = BucketType());
 
     std::tuple<Status, Bucket>
-    getBucket(std::string name, comparator_t cmp);
+    getBucket(std::string name, comparator_t cmp, 
+              BucketType type = BucketType());
+
+    std::tuple<Status, Bucket>
+    getBucket(std::string name, Snapshot &snap, comparator_t cmp, 
+              BucketType type = BucketType());
+
+    Snapshot snapshot();
+
+    std::tuple<Status, Bucket>
+    bulkLoadBucket(std::string name, BulkSource src, u32 fill, 
+                   comparator_t cmp);
+
+    Status write(WriteBatch &batch);
+
+    Status compact(u32 budget, bool sort);
 
-    void updateRoot(std::string &name, pgid_t newroot, u32 height);
+    void updateRoot(std::string &name, pgid_t newroot, u32 height, 
+                    pgid_t first = 0);
 
 private:
     void init(Option option);
+    Status openReadOnly();
+    void upgrade();
+    // write meta to page 0 through cache.
+    void writeMeta();
+    void startWal(Option option);
+    // one batch of compaction on bucket name, see Bptree::compact.
+    u32 compact(std::string &name, u32 budget, bool sort, bool deep, 
+                u32 &cursor);
+    // the tree of bucket name, made once so all handles share its latches.
+    std::shared_ptr<Bptree> tree(std::string &name, BptreeMeta &meta, 
+                                 comparator_t cmp, 
+                                 BucketType type = BucketType());
+    // the val of a bucket in the bucket tree is its BptreeMeta, and its
+    // type after it if typed.
+    static std::string bucketVal(BptreeMeta &meta, BucketType type);
+    static BucketType bucketType(std::string &val);
 
     std::shared_ptr<Bptree>        _buckets;
     std::string                    _path;
     Meta                           _meta;
+    std::mutex                     _trees_mtx;
+    std::unordered_map<std::string, std::shared_ptr<Bptree>> _trees;
 };
 
 extern DBImpl *g_db;
@@ -0,0 +1,78 @@
+#include "Epoch.h"
+
+namespace bptdb {
+
+EpochManager g_epoch;
+
+EpochManager::Local::~Local() {
+    if(slot) {
+        std::lock_guard lg(mgr->_mtx);
+        slot->used = false;
+    }
+}
+
+EpochManager::Local &EpochManager::local() {
+    thread_local Local t_local;
+    if(t_local.slot) {
+        return t_local;
+    }
+    std::lock_guard lg(_mtx);
+    for(auto &slot: _slots) {
+        if(!slot->used) {
+            t_local.slot = slot.get();
+            break;
+        }
+    }
+    if(!t_local.slot) {
+        t_local.slot = _slots.emplace_back(std::make_unique<Slot>()).get();
+    }
+    t_local.slot->used = true;
+    t_local.mgr = this;
+    return t_local;
+}
+
+void EpochManager::enter() {
+    auto &t = local();
+    if(t.depth++) {
+        return;
+    }
+    t.slot->epoch.store(_epoch.load(), std::memory_order_relaxed);
+    // the reads in guard never go before the slot is seen.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochManager::exit() {
+    auto &t = local();
+    if(--t.depth) {
+        return;
+    }
+    t.slot->epoch.store(0, std::memory_order_release);
+}
+
+u64 EpochManager::retire() {
+    return _epoch.fetch_add(1);
+}
+
+u64 EpochManager::safe() {
+    // a slot not seen here is set after the objects were taken out.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    u64 ret = _epoch.load();
+    std::lock_guard lg(_mtx);
+    for(auto &slot: _slots) {
+        u64 e = slot->epoch.load(std::memory_order_acquire);
+        if(e && e < ret) {
+            ret = e;
+        }
+    }
+    return ret;
+}
+
+EpochGuard::EpochGuard() {
+    g_epoch.enter();
+}
+
+EpochGuard::~EpochGuard() {
+    g_epoch.exit();
+}
+
+}// namespace bptdb
@@ -0,0 +1,55 @@
+#ifndef __EPOCH_H
+#define __EPOCH_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "common.h"
+
+namespace bptdb {
+
+// epoch based reclamation. a thread in a guard may hold objects it found
+// in structures read without lock. one taken out of them is tagged with
+// the epoch then, which goes up at once, and is freed only when every
+// thread in a guard came in after that.
+class EpochManager {
+public:
+    // nested guards of a thread count once.
+    void enter();
+    void exit();
+    // the tag of an object taken out just now.
+    u64 retire();
+    // objects of tag below it are no longer held by anyone.
+    u64 safe();
+private:
+    struct alignas(64) Slot {
+        std::atomic<u64> epoch{0}; // 0 if not in a guard
+        bool used{false};
+    };
+    // the slot of the calling thread, given back when it exits.
+    struct Local {
+        EpochManager *mgr{nullptr};
+        Slot *slot{nullptr};
+        u32 depth{0};
+        ~Local();
+    };
+    Local &local();
+
+    std::atomic<u64> _epoch{1};
+    std::mutex _mtx;
+    std::vector<std::unique_ptr<Slot>> _slots;
+};
+
+// the calling thread may hold objects of NodeMap in scope.
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+};
+
+extern EpochManager g_epoch;
+
+}// namespace bptdb
+
+#endif
@@ -4,4 +4,59 @@ namespace bptdb {
 
 std::unique_ptr<FileManager> g_fm;
 
+FileManager::~FileManager() {
+    for(auto &[id, view]: _views) {
+        ::munmap(view.first, view.second);
+    }
+    if(_map) {
+        ::munmap(_map, _maplen);
+    }
+    ::close(_fd);
+}
+
+void FileManager::map() {
+    _syspage = ::sysconf(_SC_PAGESIZE);
+    _maplen = fileSize();
+    auto p = ::mmap(nullptr, _maplen, PROT_READ, MAP_SHARED, _fd, 0);
+    assert(p != MAP_FAILED);
+    _map = (char *)p;
+}
+
+// the two runs are mapped side by side in a range reserved. if a page is
+// not aligned to the pages of system, they are copied there once.
+char *FileManager::view(pgid_t id, u32 cnt, pgid_t res, u32 rescnt) {
+    {
+        std::shared_lock lg(_views_mtx);
+        auto it = _views.find(id);
+        if(it != _views.end()) {
+            return it->second.first;
+        }
+    }
+    std::lock_guard lg(_views_mtx);
+    auto it = _views.find(id);
+    if(it != _views.end()) {
+        return it->second.first;
+    }
+    u64 len = page2off(cnt), reslen = page2off(rescnt);
+    u64 total = (len + reslen + _syspage - 1) / _syspage * _syspage;
+    bool aligned = page2off(1) % _syspage == 0;
+    auto p = (char *)::mmap(nullptr, total, 
+            aligned ? PROT_NONE : PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(p != MAP_FAILED);
+    if(aligned) {
+        auto a = ::mmap(p, len, PROT_READ, MAP_SHARED | MAP_FIXED,
+                _fd, page2off(id));
+        auto b = ::mmap(p + len, reslen, PROT_READ, MAP_SHARED | MAP_FIXED,
+                _fd, page2off(res));
+        assert(a != MAP_FAILED && b != MAP_FAILED);
+    }else {
+        std::memcpy(p, _map + page2off(id), len);
+        std::memcpy(p + len, _map + page2off(res), reslen);
+        ::mprotect(p, total, PROT_READ);
+    }
+    _views.emplace(id, std::make_pair(p, total));
+    return p;
+}
+
 }// namespace bptdb
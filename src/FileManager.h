@@ -1,51 +1,148 @@
 #ifndef __FILEMANAGER_H
 #define __FILEMANAGER_H
 
+#include <algorithm>
+#include <climits>
 #include <string>
-#include <iostream>
-#include <fstream>
-#include <mutex>
+#include <memory>
+#include <vector>
 #include <cassert>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "common.h"
 
 namespace bptdb {
 
+// positional io on the data file, threads never wait for each other here.
 class FileManager {
 public:
-    FileManager(std::string path, bool sync): _file(path, 
-        std::ios::binary | std::ios::out | std::ios::in) {
-
-        assert(_file.is_open());
+    FileManager(std::string path, bool sync, bool readonly = false) {
+        // sync: every write reaches the disk before return.
+        _fd = ::open(path.c_str(), readonly ? O_RDONLY : 
+                O_RDWR | (sync ? O_DSYNC : 0));
+        assert(_fd >= 0);
         _path = path;
-        _sync = sync;
+        if(readonly) {
+            map();
+        }
     }
 
-    ~FileManager() { 
-        _file.close(); 
+    ~FileManager();
+    // read past the end of file gives zero.
+    void read(char *p, u32 cnt, u64 pos) {
+        while (cnt > 0) {
+            auto n = ::pread(_fd, p, cnt, pos);
+            assert(n >= 0);
+            if (n == 0) {
+                std::memset(p, 0, cnt);
+                return;
+            }
+            p += n;
+            cnt -= n;
+            pos += n;
+        }
+    }
+    void write(char *p, u32 cnt, u64 pos) {
+        while (cnt > 0) {
+            auto n = ::pwrite(_fd, p, cnt, pos);
+            assert(n > 0);
+            p += n;
+            cnt -= n;
+            pos += n;
+        }
+    }
+    // read consecutive bytes at pos into buffers of iov, iov is consumed.
+    void readv(std::vector<iovec> &iov, u64 pos) {
+        u32 i = 0;
+        while (i < iov.size()) {
+            u32 cnt = std::min<std::size_t>(iov.size() - i, IOV_MAX);
+            auto n = ::preadv(_fd, &iov[i], cnt, pos);
+            assert(n >= 0);
+            if (n == 0) {
+                for (; i < iov.size(); i++) {
+                    std::memset(iov[i].iov_base, 0, iov[i].iov_len);
+                }
+                return;
+            }
+            pos += n;
+            // skip the buffers filled, a short read leaves one in half.
+            while (n > 0 && (std::size_t)n >= iov[i].iov_len) {
+                n -= iov[i].iov_len;
+                i++;
+            }
+            if (n > 0) {
+                iov[i].iov_base = (char *)iov[i].iov_base + n;
+                iov[i].iov_len -= n;
+            }
+        }
     }
-    void read(char *p, u32 cnt, u32 pos) {
-        std::lock_guard lg(_mtx);
-        _file.seekg(pos);
-        _file.read(p, cnt);
-        _file.clear();
+    // write buffers of iov to consecutive bytes at pos, iov is consumed.
+    void writev(std::vector<iovec> &iov, u64 pos) {
+        u32 i = 0;
+        while (i < iov.size()) {
+            u32 cnt = std::min<std::size_t>(iov.size() - i, IOV_MAX);
+            auto n = ::pwritev(_fd, &iov[i], cnt, pos);
+            assert(n > 0);
+            pos += n;
+            while (i < iov.size() && (std::size_t)n >= iov[i].iov_len) {
+                n -= iov[i].iov_len;
+                i++;
+            }
+            if (n > 0) {
+                iov[i].iov_base = (char *)iov[i].iov_base + n;
+                iov[i].iov_len -= n;
+            }
+        }
     }
-    void write(char *p, u32 cnt, u32 pos) {
-        std::lock_guard lg(_mtx);
-        _file.seekp(pos);
-        _file.write(p, cnt);
-        if(_sync) _file.flush();
+    // make all writes so far durable.
+    void sync() {
+        ::fsync(_fd);
     }
-    u32 fileSize() {
-        std::lock_guard lg(_mtx);
-        _file.seekg(0, std::ios_base::end);
-        std::streampos sp = _file.tellg();
-        return sp;
+    // cut the file to len bytes, if it is longer.
+    void truncate(u64 len) {
+        if(fileSize() > len) {
+            int ret = ::ftruncate(_fd, len);
+            assert(ret == 0);
+            (void)ret;
+        }
+    }
+    u64 fileSize() {
+        struct stat st;
+        ::fstat(_fd, &st);
+        return st.st_size;
+    }
+
+    int fd() { return _fd; }
+    std::string &path() { return _path; }
+
+    // the file is mapped read only, it never changes while mapped.
+    bool mapped() { return _map != nullptr; }
+    char *at(u64 pos) { return _map + pos; }
+    // cnt pages at id followed by rescnt pages at res, in one piece.
+    char *view(pgid_t id, u32 cnt, pgid_t res, u32 rescnt);
+    // tell the kernel cnt pages at id are read soon.
+    void willNeed(pgid_t id, u32 cnt) {
+        ::madvise(_map + page2off(id) / _syspage * _syspage, 
+                page2off(cnt) + page2off(id) % _syspage, MADV_WILLNEED);
     }
 private:
+    void map();
+
     std::string  _path;
-    std::fstream _file;
-    std::mutex   _mtx;
-    bool         _sync;
+    int          _fd{-1};
+    char        *_map{nullptr};
+    u64          _maplen{0};
+    u64          _syspage{4096};
+    // views of nodes over pages not adjacent, built once.
+    std::shared_mutex _views_mtx;
+    std::unordered_map<pgid_t, std::pair<char *, u64>> _views;
 };
 
 extern std::unique_ptr<FileManager> g_fm;
@@ -0,0 +1,175 @@
+#ifndef __FIXED_DIR_H
+#define __FIXED_DIR_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string_view>
+#include "common.h"
+
+namespace bptdb {
+
+// layout of a leaf of a typed bucket, see BucketType.
+//
+// | PageHeader | node header | rec[0] ... rec[n-1] | free | high key |
+//
+// a record is the key of keysize bytes and the val of valsize right after
+// it, records are packed in key order from the start with no hole, so the
+// bytes of node tell where each is. the high key, if any, is the last
+// keysize bytes of node. keys of at most 8 bytes are searched as big
+// endian numbers, others as bytes.
+class FixedDir {
+public:
+    void reset(char *base, u32 cap, u32 start, u32 *size, u32 *bytes,
+               u32 *high, BucketType type) {
+        _base   = base;
+        _cap    = cap;
+        _start  = start;
+        _size   = size;
+        _bytes  = bytes;
+        _high   = high;
+        _keylen = type.keysize;
+        _vallen = type.valsize;
+    }
+
+    // bytes of a record.
+    u32 stride() { return _keylen + _vallen; }
+    char *rec(u32 pos) { return _base + _start + pos * stride(); }
+    std::string_view key(u32 pos) {
+        return std::string_view(rec(pos), _keylen);
+    }
+    std::string_view val(u32 pos) {
+        return std::string_view(rec(pos) + _keylen, _vallen);
+    }
+    void setVal(u32 pos, std::string_view val) {
+        assert(val.size() == _vallen);
+        std::memcpy(rec(pos) + _keylen, val.data(), _vallen);
+    }
+
+    // put a record at pos, the caller made room of stride() bytes.
+    void insert(u32 pos, std::string_view key, std::string_view val) {
+        assert(pos <= *_size);
+        assert(key.size() == _keylen && val.size() == _vallen);
+        assert(_start + (*_size + 1) * stride() <= limit());
+        std::memmove(rec(pos + 1), rec(pos), (*_size - pos) * stride());
+        std::memcpy(rec(pos), key.data(), _keylen);
+        std::memcpy(rec(pos) + _keylen, val.data(), _vallen);
+        (*_size)++;
+        (*_bytes) += stride();
+    }
+    void erase(u32 pos) {
+        assert(pos < *_size);
+        std::memmove(rec(pos), rec(pos + 1), (*_size - pos - 1) * stride());
+        (*_size)--;
+        (*_bytes) -= stride();
+    }
+    // drop records from pos to the end.
+    void truncate(u32 pos) {
+        (*_bytes) -= (*_size - pos) * stride();
+        *_size = pos;
+    }
+
+    bool hasHigh() {
+        return *_high != 0;
+    }
+    std::string_view high() {
+        return std::string_view(_base + *_high, _keylen);
+    }
+    // the caller made room of keysize bytes if there was no high key.
+    void setHigh(std::string_view key) {
+        assert(key.size() == _keylen);
+        if(!*_high) {
+            *_high = _cap - _keylen;
+            (*_bytes) += _keylen;
+        }
+        std::memcpy(_base + *_high, key.data(), _keylen);
+    }
+    void dropHigh() {
+        if(*_high) {
+            (*_bytes) -= _keylen;
+            *_high = 0;
+        }
+    }
+
+    // the buffer has grown from oldcap to cap, the high key goes to the
+    // new end.
+    void grow(u32 oldcap) {
+        if(*_high && _cap != oldcap) {
+            std::memmove(_base + _cap - _keylen, _base + *_high, _keylen);
+            *_high = _cap - _keylen;
+        }
+    }
+
+    // the pos of first key not less than key.
+    u32 lowerBound(std::string_view key) {
+        if(key.size() != _keylen || _keylen > 8) {
+            return bound([&](u32 pos) { return this->key(pos) < key; });
+        }
+        switch(_keylen) {
+        case 8:
+            return number<8>(key);
+        case 4:
+            return number<4>(key);
+        default:
+            u64 k = load(key.data(), _keylen);
+            return bound([&](u32 pos) { return load(rec(pos), _keylen) < k; });
+        }
+    }
+
+private:
+    // records end where the high key is, or the end of node.
+    u32 limit() {
+        return *_high ? *_high : _cap;
+    }
+    // the first pos at which less is false, the loop has no branch on
+    // the result of less.
+    template <typename Less>
+    u32 bound(Less less) {
+        u32 lo = 0, len = *_size;
+        while(len) {
+            u32 half = len / 2;
+            bool go = less(lo + half);
+            lo = go ? lo + half + 1 : lo;
+            len = go ? len - half - 1 : half;
+        }
+        return lo;
+    }
+    template <u32 N>
+    u32 number(std::string_view key) {
+        u64 k = load(key.data(), N);
+        return bound([&](u32 pos) { return load(rec(pos), N) < k; });
+    }
+    // n bytes at p as a big endian number.
+    static u64 load(const char *p, u32 n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if(n == 8) {
+            u64 x;
+            std::memcpy(&x, p, 8);
+            return __builtin_bswap64(x);
+        }
+        if(n == 4) {
+            u32 x;
+            std::memcpy(&x, p, 4);
+            return __builtin_bswap32(x);
+        }
+#endif
+        u64 x = 0;
+        for(u32 i = 0; i < n; i++) {
+            x = x << 8 | (u8)p[i];
+        }
+        return x;
+    }
+
+    char *_base{nullptr};
+    u32  _cap{0};
+    u32  _start{0};
+    u32  *_size{nullptr};
+    u32  *_bytes{nullptr};
+    u32  *_high{nullptr};
+    u32  _keylen{0};
+    u32  _vallen{0};
+};
+
+}// namespace bptdb
+
+#endif
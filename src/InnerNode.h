@@ -12,21 +12,38 @@ class InnerNode: public Node {
 public:
     //using UnRLockGuardVec_t = std::vector<UnReadLockGuard>;
     using UnWLockGuardVec_t = UnLockGuardArray<UnWriteLockGuard>;
-    using Mutex_t = std::shared_mutex;
+    using Mutex_t = VersionLatch;
 
     InnerNode(pgid_t id, u32 maxsize, 
-            NodeMap<InnerNode> *map, comparator_t cmp): 
-        Node(id, maxsize), _cmp(cmp), _map(map){}
+            NodeMap<InnerNode> *map, const comparator_t &cmp): 
+        Node(id, maxsize), _cmp(cmp), _order(keyOrder(cmp)), _map(map){
+        // searched in place without latch, the frame must stay.
+        if(g_option.latch_mode == LatchMode::optimistic) {
+            _frame = g_pc->pin(id);
+            _pinned = true;
+        }
+    }
+    ~InnerNode() {
+        retire();
+    }
+    void retire() {
+        Node::retire();
+        if(_pinned) {
+            // keep the memory, a lookup may still read it.
+            _frame->unpin();
+            _pinned = false;
+        }
+    }
 
     // ==================================================================
 
     void split(PutEntry &entry, InnerNodeImpl &impl) {
 
         auto new_id = g_pa->allocPage(1);
-        PageHeader::newOnDisk(new_id, 1, impl.next());
+        InnerNodeImpl::newOnDisk(new_id, impl.next());
         impl.setNext(new_id);
 
-        auto next_node = InnerNodeImpl(new_id, _cmp);
+        auto next_node = InnerNodeImpl(new_id, _cmp, PageMode::Write);
         entry.val = new_id;
         entry.key = impl.splitTo(next_node);
         entry.update = true;
@@ -36,7 +53,8 @@ public:
 
     bool borrow(DelEntry &entry, InnerNodeImpl &impl) {
 
-        auto next_node = InnerNodeImpl(impl.next(), _cmp);
+        std::lock_guard lg(_map->get(impl.next())->getMutex());
+        auto next_node = InnerNodeImpl(impl.next(), _cmp, PageMode::Write);
         if(!hasmore(next_node.size())) {
             return false;
         }
@@ -51,18 +69,24 @@ public:
 
     void merge(DelEntry &entry, InnerNodeImpl &impl) {
 
-        auto next_node = InnerNodeImpl(impl.next(), _cmp);
-
-        // diff with leafnode. here we add entry.delim.
-
-        impl.mergeFrom(next_node, entry.delim);
-        entry.del = true;
-
         auto ret = impl.next();
-        // set next
-        impl.setNext(next_node.next());
-        // 1. free page buffer on memory and page id on disk
-        next_node.free();
+        auto sib = _map->get(ret);
+        {
+            // a lookup may be on it, latch it before it goes.
+            std::lock_guard lg(sib->getMutex());
+            auto next_node = InnerNodeImpl(ret, _cmp, PageMode::Write);
+
+            // diff with leafnode. here we add entry.delim.
+
+            impl.mergeFrom(next_node, entry.delim);
+            entry.del = true;
+
+            // set next
+            impl.setNext(next_node.next());
+            // 1. free page buffer on memory and page id on disk
+            next_node.free();
+            sib->getMutex().markObsolete();
+        }
         // 2. del page at cache
         // _db->getPageCache()->del(ret);
         // 3. del node on map
@@ -75,7 +99,7 @@ public:
     Status put(u32 pos, std::string &key, pgid_t &val, 
             PutEntry &entry, UnWLockGuardVec_t &lg_tlb) {
 
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Write);
         impl.putat(pos, key, val);
 
         if(ifsplit(impl.size())) {
@@ -92,7 +116,7 @@ public:
     void del(u32 pos, DelEntry &entry,
             UnWLockGuardVec_t &lg_tlb) {
 
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Write);
         impl.delat(pos);
 
         // if legal or we are the last child of parent
@@ -117,7 +141,7 @@ done:
     void update(u32 pos, std::string &newkey, 
             UnWLockGuardVec_t &lg_tlb) {
 
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Write);
         impl.updateKeyat(pos, newkey);
 
         impl.write();
@@ -130,7 +154,7 @@ done:
 
         _shmtx.lock();
         // keep page alive.
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         if(safetoput(impl.size())) {
             lg_tlb.clear();
         }
@@ -145,7 +169,7 @@ done:
 
         _shmtx.lock();
         // keep page alive.
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         if(safetodel(impl.size())) {
             lg_tlb.clear();
         }
@@ -161,18 +185,126 @@ done:
         _shmtx.lock_shared();
         par_mtx.unlock_shared();
 
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         // keep page alive.
         return impl.get(key);
     }
 
+    // for multi get, lock self shared and release parent. self is left
+    // latched until the caller has read the children.
+    void route(std::vector<std::string *> &keys, u32 pos, Mutex_t &par_mtx,
+            std::vector<std::tuple<pgid_t, u32>> &runs) {
+        _shmtx.lock_shared();
+        par_mtx.unlock_shared();
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
+        impl.route(keys, pos, runs);
+    }
+
+    // for search without latch, the caller validates the version after.
+    // right is set if key has gone right by split, child is the right node.
+    bool optGet(std::string &key, pgid_t &child, bool &right) {
+        auto page = (char *)_frame->data();
+        if(((PageHeader *)page)->realpages != 1) {
+            // spread over pages, read it under latch.
+            std::shared_lock lg(_shmtx);
+            auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
+            right = !impl.covers(key);
+            child = right ? impl.next() : std::get<0>(impl.get(key));
+            return true;
+        }
+        return withOrder(_order, _cmp, [&](const auto &cmp) {
+            return InnerNodeImpl::optGet(page, key, cmp, child, right);
+        });
+    }
+
+    // for search in blink mode, no parent is latched. false and the right
+    // node if key has gone right by split, else true and the child.
+    bool linkGet(std::string &key, pgid_t &id) {
+        if(g_option.latch_mode == LatchMode::optimistic) {
+            u64 v;
+            bool right;
+            while(true) {
+                _shmtx.readVersion(v);
+                if(optGet(key, id, right) && _shmtx.validate(v)) {
+                    return !right;
+                }
+            }
+        }
+        std::shared_lock lg(_shmtx);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
+        if(!impl.covers(key)) {
+            id = impl.next();
+            return false;
+        }
+        id = std::get<0>(impl.get(key));
+        return true;
+    }
+
+    // multi get in blink mode, no parent is latched. false and the right
+    // node if keys[pos] has gone right by split.
+    bool linkRoute(std::vector<std::string *> &keys, u32 pos, 
+            std::vector<std::tuple<pgid_t, u32>> &runs, pgid_t &right) {
+        std::shared_lock lg(_shmtx);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
+        if(!impl.covers(*keys[pos])) {
+            right = impl.next();
+            return false;
+        }
+        impl.route(keys, pos, runs);
+        return true;
+    }
+
+    // put the key and id of a split child in blink mode, only this node
+    // is latched. false and the right node if key has gone right by split.
+    bool linkPut(std::string &key, pgid_t val, PutEntry &entry, 
+            pgid_t &right) {
+        std::lock_guard lg(_shmtx);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Write);
+        if(!impl.covers(key)) {
+            right = impl.next();
+            return false;
+        }
+        auto [child, pos] = impl.get(key);
+        (void)child;
+        impl.putat(pos, key, val);
+        if(ifsplit(impl.size())) {
+            DEBUGOUT("===> innernode split");
+            split(entry, impl);
+        }
+        impl.write();
+        return true;
+    }
+
     // without lock, only used by iterator.
     std::tuple<pgid_t, u32> 
     get(std::string &key) {
         // keep page alive.
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         return impl.get(key);
     }
+    pgid_t before(std::string *key, std::string &low, bool &haslow) {
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
+        return impl.before(key, low, haslow);
+    }
+    // children right of the child of key, or left of it, until there are
+    // n. from the first child if key is null. return the right node.
+    pgid_t children(std::string *key, u32 n, bool forward, 
+            std::vector<pgid_t> &ids) {
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
+        auto child = [&](u32 i) { return i ? impl.val(i - 1) : impl.head(); };
+        if(!forward) {
+            u32 i = std::get<1>(impl.get(*key));
+            for(; i > 0 && ids.size() < n; i--) {
+                ids.push_back(child(i - 1));
+            }
+            return impl.next();
+        }
+        u32 i = key ? std::get<1>(impl.get(*key)) + 1 : 0;
+        for(; i <= impl.size() && ids.size() < n; i++) {
+            ids.push_back(child(i));
+        }
+        return impl.next();
+    }
 
     //==================================================
 
@@ -180,10 +312,10 @@ done:
         pgid_t id, std::string &key, 
         pgid_t child1, pgid_t child2, comparator_t cmp) {
 
-        PageHeader::newOnDisk(id);
+        InnerNodeImpl::newOnDisk(id);
 
         // 初始化容器
-        InnerNodeImpl impl(id, cmp);
+        InnerNodeImpl impl(id, cmp, PageMode::Write);
         impl.init(key, child1, child2);
         impl.write();
     }
@@ -196,28 +328,30 @@ done:
     // return the only child in node
     pgid_t tochild() {
         //std::cout << "tochild\n";
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Write);
         assert(impl.next() == 0);
         auto ret =  impl.head();
         // free self page
         impl.free();
+        // the caller holds the latch.
+        _shmtx.markObsolete();
         // _db->getPageCache()->del(ret);
         
         return ret;
     }
 
     std::string maxkey() {
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         return std::string(impl.maxkey());
     }
 
     std::string minkey() {
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         return std::string(impl.minkey());
     }
 
     void show() {
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         std::cout << "size " << impl.size() << "\n";
         for(auto it = impl.begin(); !it.done(); it.next()) {
             std::cout << "key " << std::string(it.key()) << "\n";
@@ -225,7 +359,7 @@ done:
     }
 
     void debug(u32 height) {
-        auto impl = InnerNodeImpl(_id, _cmp);
+        auto impl = InnerNodeImpl(_id, _cmp, PageMode::Read);
         if(height == 2) {
             return;
         }
@@ -244,8 +378,11 @@ done:
         }
     }
 private:
-    comparator_t       _cmp;
+    const comparator_t  &_cmp; // the one of map
+    KeyOrder           _order;
     NodeMap<InnerNode> *_map;
+    PagePtr            _frame; // pinned in optimistic mode
+    bool               _pinned{false};
 };
 
 }// namespace bptdb
@@ -17,6 +17,7 @@
 #include "Option.h"
 #include "PageHeader.h"
 #include "PageHelper.h"
+#include "SlotDir.h"
 
 namespace bptdb {
 
@@ -30,10 +31,17 @@ public:
     struct Elem {
         u32 keylen;
         pgid_t val;
+        u32 size() { return sizeof(Elem) + keylen; }
+    };
+    // follow the PageHeader.
+    struct Header {
+        pgid_t head;    ///< the child before first key
+        u32    low;     ///< start of record area
+        u32    prefix;  ///< offset of the prefix of keys, 0 if none
     };
 
     pgid_t head() {
-        return *_head;
+        return _nodehdr->head;
     }
 
     class Iterator {
@@ -47,8 +55,8 @@ public:
         void next() {
             _pos++;
         }
-        std::string_view key() { return _con->_keys[_pos]; }
-        pgid_t val() { return _con->key2val(key());  }
+        std::string_view key() { return _con->_dir.full(_pos); }
+        pgid_t val() { return _con->val(_pos);  }
         bool done() {
             return _pos == *(_con->_size);    
         }
@@ -62,36 +70,34 @@ public:
     }
 
     std::string_view minkey() {
-        return _keys[0];
+        return _dir.full(0);
     }
     std::string_view maxkey() {
-        return _keys[_keys.size() - 1];
+        return _dir.full(*_size - 1);
     }
 
     // =======================================
     //
     std::string key(u32 pos) {
-        auto key = _keys[pos];
-        return std::string(key.data(), key.size());
+        return std::string(_dir.full(pos));
     }
     pgid_t val(u32 pos) {
-        return key2val(_keys[pos]);
-    }
-    pgid_t key2val(std::string_view key) {
-        auto elem = (Elem *)(key.data() - sizeof(Elem));
-        return elem->val;
+        return _dir.elem(pos)->val;
     }
 
     void verify() {
-        // for(u32 i = 1; i < _keys.size(); i++) {
-        //     assert(_keys[i] > _keys[i - 1]);
+        // for(u32 i = 1; i < *_size; i++) {
+        //     assert(_dir.key(i) > _dir.key(i - 1));
         // }
     }
 
     // =======================================
-    InnerNodeImpl(pgid_t id, comparator_t cmp) {
-        _pg = std::make_shared<PageHelper>(id);
+    InnerNodeImpl(pgid_t id, comparator_t cmp, 
+            PageMode mode = PageMode::Copy) {
+        _pg = std::make_shared<PageHelper>(id, mode);
         _cmp = cmp;
+        _order = keyOrder(cmp);
+        _bytewise = _order == KeyOrder::bytes;
         _pg->read();
         reset();
     }
@@ -100,147 +106,429 @@ public:
         _hdr = (PageHeader *)_pg->data();
         _size  = &_hdr->size;
         _bytes = &_hdr->bytes;
-        _head  = (pgid_t *)(_hdr + 1);
-        _data  = (char *)(_head + 1);
-        updateVec();
+        _nodehdr = (Header *)(_hdr + 1);
+        _dir.reset((char *)_hdr, _pg->capacity(), (u32 *)(_nodehdr + 1),
+                &_nodehdr->low, _size, _bytes, &_hdr->high,
+                &_nodehdr->prefix, true);
+    }
+
+    // format as an empty node.
+    void clear() {
+        *_bytes = sizeof(PageHeader) + sizeof(Header);
+        _nodehdr->head = 0;
+        _dir.clear();
+    }
+
+    static void newOnDisk(pgid_t id, pgid_t next = 0) {
+        PageHelper pg(id, 1);
+        auto hdr = (PageHeader *)pg.data();
+        PageHeader::init(hdr, 1, next);
+        hdr->bytes += sizeof(Header);
+        auto nodehdr = (Header *)(hdr + 1);
+        nodehdr->head = 0;
+        nodehdr->low = g_option.page_size;
+        nodehdr->prefix = 0;
+        pg.write();
+    }
+
+    // rewrite a node of an old format into the layout now, return all
+    // the children. format 0 packed records after the head, 1 had slots
+    // but no prefix, 2 no heads.
+    static std::vector<pgid_t> upgrade(pgid_t id, u32 version) {
+        std::vector<pgid_t> children;
+        std::vector<std::string> keys;
+        std::string high, pre;
+        {
+            PageHelper pg(id);
+            auto hdr = (PageHeader *)pg.read();
+            auto head = (pgid_t *)(hdr + 1);
+            children.push_back(*head);
+            char *data = (char *)(head + 1);
+            auto slots = (u32 *)(data + sizeof(u32));
+            if(version >= 2) {
+                if(auto off = *slots) {
+                    auto elem = (Elem *)((char *)hdr + off);
+                    pre.assign((char *)(elem + 1), elem->keylen);
+                }
+                slots++;
+            }
+            for(u32 i = 0; i < hdr->size; i++) {
+                auto elem = version ? (Elem *)((char *)hdr + slots[i])
+                                    : (Elem *)data;
+                keys.emplace_back(pre);
+                keys.back().append((char *)(elem + 1), elem->keylen);
+                children.push_back(elem->val);
+                data += elem->size();
+            }
+            if(version && hdr->high) {
+                auto elem = (Elem *)((char *)hdr + hdr->high);
+                high.assign((char *)(elem + 1), elem->keylen);
+            }
+        }
+        InnerNodeImpl impl(id, comparator_t(), PageMode::Write);
+        impl.clear();
+        if(version >= 2) {
+            // keys of the bucket may not sort as bytes, keep the prefix.
+            impl.setPrefix(pre);
+        }
+        impl._nodehdr->head = children[0];
+        for(u32 i = 0; i < keys.size(); i++) {
+            impl.push_back(keys[i], children[i + 1]);
+        }
+        if(!high.empty()) {
+            impl.setHigh(high);
+        }
+        impl.write();
+        return children;
+    }
+
+    // the children of a node of the layout now.
+    static std::vector<pgid_t> children(pgid_t id) {
+        InnerNodeImpl impl(id, comparator_t());
+        std::vector<pgid_t> ret{impl.head()};
+        for(auto it = impl.begin(); !it.done(); it.next()) {
+            ret.push_back(it.val());
+        }
+        return ret;
+    }
+
+    // lay out a node of head and the first n of ents on a run of pages of
+    // its own, for bulk load. next is left 0, high is none if null. keys
+    // share their prefix if bytes_order is set.
+    static std::string image(pgid_t head,
+            std::vector<std::pair<std::string, pgid_t>> &ents, u32 n,
+            const std::string *high, bool bytes_order) {
+        u32 pre = 0;
+        if(bytes_order && n > 1) {
+            pre = SlotDir<Elem>::common(ents[0].first, ents[n - 1].first);
+        }
+        u32 bytes = sizeof(PageHeader) + sizeof(Header);
+        if(pre) {
+            bytes += sizeof(Elem) + pre;
+        }
+        for(u32 i = 0; i < n; i++) {
+            bytes += elemSize(ents[i].first, ents[i].second) - pre;
+        }
+        if(high) {
+            bytes += sizeof(Elem) + high->size();
+        }
+        u32 pages = byte2page(bytes);
+        std::string buf(pages * g_option.page_size, 0);
+        auto hdr = (PageHeader *)buf.data();
+        PageHeader::init(hdr, pages, 0);
+        hdr->bytes += sizeof(Header);
+        auto nodehdr = (Header *)(hdr + 1);
+        nodehdr->head = head;
+        SlotDir<Elem> dir;
+        dir.reset(buf.data(), buf.size(), (u32 *)(nodehdr + 1),
+                &nodehdr->low, &hdr->size, &hdr->bytes, &hdr->high,
+                &nodehdr->prefix, true);
+        dir.clear();
+        if(pre) {
+            auto elem = dir.setPrefix(sizeof(Elem) + pre);
+            elem->keylen = pre;
+            elem->val = 0;
+            std::memcpy((char *)(elem + 1), ents[0].first.data(), pre);
+        }
+        for(u32 i = 0; i < n; i++) {
+            auto &[key, child] = ents[i];
+            auto elem = dir.insert(hdr->size, 
+                    sizeof(Elem) + key.size() - pre);
+            elem->keylen = key.size() - pre;
+            elem->val = child;
+            std::memcpy((char *)(elem + 1), key.data() + pre, elem->keylen);
+            dir.setHead(hdr->size - 1);
+        }
+        if(high) {
+            auto elem = dir.setHigh(sizeof(Elem) + high->size());
+            elem->keylen = high->size();
+            elem->val = 0;
+            std::memcpy((char *)(elem + 1), high->data(), elem->keylen);
+        }
+        return buf;
+    }
+
+    // upper bound on a single page frame with no latch, a writer may be
+    // changing it. nothing read is trusted, false if an offset goes out
+    // of page. the caller validates the version anyway. right is set if
+    // key has gone right by split, child is the right node then.
+    template <typename Cmp>
+    static bool optGet(char *page, std::string &key, 
+            const Cmp &cmp, pgid_t &child, bool &right) {
+        u64 cap = g_option.page_size;
+        auto hdr = (PageHeader *)page;
+        auto nodehdr = (Header *)(hdr + 1);
+        auto slots = (u32 *)(nodehdr + 1);
+        u64 size = hdr->size;
+        // slots and their heads.
+        if((char *)slots - page + size * 2 * sizeof(u32) > cap) {
+            return false;
+        }
+        // each field is loaded once, it may change between two loads.
+        auto elem = [&](u64 off, std::string_view &k, pgid_t &v) {
+            if(off + sizeof(Elem) > cap) {
+                return false;
+            }
+            auto e = (Elem *)(page + off);
+            u64 keylen = e->keylen;
+            if(off + sizeof(Elem) + keylen > cap) {
+                return false;
+            }
+            k = std::string_view((char *)(e + 1), keylen);
+            v = e->val;
+            return true;
+        };
+        std::string_view k;
+        u64 high = hdr->high;
+        right = false;
+        if(high) {
+            if(!elem(high, k, child)) {
+                return false;
+            }
+            if(!cmp(key, k)) {
+                right = true;
+                child = hdr->next;
+                return true;
+            }
+        }
+        // the rest of key is looked up, or key is out of the prefix.
+        std::string_view rest = key;
+        u64 lo = 0, hi = size;
+        u64 pre = nodehdr->prefix;
+        if(pre) {
+            if(!elem(pre, k, child)) {
+                return false;
+            }
+            int where = SlotDir<Elem>::locate(k, key, rest);
+            if(where) {
+                lo = hi = where < 0 ? 0 : size;
+            }
+        }
+        if constexpr(std::is_same_v<Cmp, std::less<std::string_view>>) {
+            if(lo < hi) {
+                u32 lt, le;
+                countHeads(slots + size, size, keyHead(rest), lt, le);
+                lo = lt;
+                hi = le;
+            }
+        }
+        if constexpr(std::is_same_v<Cmp, KeySearch>) {
+            if(!cmp.upperBound(page, cap, slots, lo, hi, rest, lo)) {
+                return false;
+            }
+            hi = lo;
+        }
+        while(lo < hi) {
+            u64 mid = lo + (hi - lo) / 2;
+            if(!elem(slots[mid], k, child)) {
+                return false;
+            }
+            if(cmp(rest, k)) {
+                hi = mid;
+            }else {
+                lo = mid + 1;
+            }
+        }
+        if(lo == 0) {
+            child = nodehdr->head;
+            return true;
+        }
+        return elem(slots[lo - 1], k, child);
     }
+
     // =================================================
 
     void handleOverFlow(u32 extbytes) {
         if (_pg->overFlow(extbytes)) {
+            u32 oldcap = _pg->capacity();
             _pg->extend(extbytes);
             reset();
+            _dir.grow(oldcap);
         } 
     }
 
     // init an InnerNodeImpl we must have a key and two child.
     void init(std::string &key, pgid_t child1, pgid_t child2) {
-        handleOverFlow(elemSize(key, child1) + sizeof(child2));
-        (*_bytes) += sizeof(pgid_t);
-        (*_head) = child1;
-        _put(_data, key, child2);
+        _nodehdr->head = child1;
+        push_back(key, child2);
     }
 
     // put key and val at pos
     void putat(u32 pos, std::string &key, pgid_t val) {
         verify();
-        handleOverFlow(elemSize(key, val));
+        auto rest = fit(key);
+        handleOverFlow(elemSize(rest, val));
         assert(pos <= *_size);
-        if(pos == *_size) {
-            push_back(key, val);
-            return;
-        }
-        _put(const_cast<char *>(_keys[pos].data() - sizeof(Elem)), key, val);
+        _put(pos, rest, val);
     }
 
     // delete elem at pos.
     void delat(u32 pos) {
         verify();
         assert(pos < *_size);
-        _del(const_cast<char *>(_keys[pos].data() - sizeof(Elem)));
+        _dir.erase(pos);
+    }
+
+    // the child at from is moved to to.
+    void moveChild(pgid_t from, pgid_t to) {
+        if(_nodehdr->head == from) {
+            _nodehdr->head = to;
+            return;
+        }
+        for(u32 i = 0; i < *_size; i++) {
+            if(_dir.elem(i)->val == from) {
+                _dir.elem(i)->val = to;
+                return;
+            }
+        }
+        assert(0);
+    }
+
+    // all children in order.
+    std::vector<pgid_t> children() {
+        std::vector<pgid_t> ret{_nodehdr->head};
+        for(u32 i = 0; i < *_size; i++) {
+            ret.push_back(_dir.elem(i)->val);
+        }
+        return ret;
     }
 
     // update key at pos
     void updateKeyat(u32 pos, std::string &newkey) {
         verify();
-        handleOverFlow(newkey.size());
         assert(pos < *_size);
-        _updateKey(const_cast<char *>(_keys[pos].data() - sizeof(Elem)), newkey);
+        auto rest = fit(newkey);
+        u32 len = sizeof(Elem) + rest.size();
+        if(len > _dir.elem(pos)->size()) {
+            handleOverFlow(len);
+        }
+        auto val = _dir.elem(pos)->val;
+        auto elem = _dir.replace(pos, len);
+        elem->keylen = rest.size();
+        elem->val = val;
+        std::memcpy((char *)(elem + 1), rest.data(), elem->keylen);
+        _dir.setHead(pos);
     }
 
     std::tuple<pgid_t, u32> get(std::string &key) {
         verify();
-        /* 
-        for(u32 i = 1; i < _keys.size(); i++) {
-            assert(_keys[i] > _keys[i - 1]);
-        }
-        */
         // 这里upper_bound
-        auto ret = std::upper_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-        u32 pos = ret - _keys.begin();
-        if(ret == _keys.begin()) 
-            return std::make_tuple(*_head, pos);
-        ret--;
-        Elem *elem = (Elem *)(ret->data() - sizeof(Elem));
-        return std::make_tuple(elem->val, pos);
+        u32 pos = upperBound(key);
+        if(pos == 0) 
+            return std::make_tuple(_nodehdr->head, pos);
+        return std::make_tuple(val(pos - 1), pos);
+    }
+
+    // the child of keys before key, the last child if key is null. low is
+    // set to the least key of the child, if it is not the first.
+    pgid_t before(std::string *key, std::string &low, bool &haslow) {
+        u32 pos = key ? lowerBound(*key) : *_size;
+        if(pos == 0) {
+            return _nodehdr->head;
+        }
+        low = this->key(pos - 1);
+        haslow = true;
+        return val(pos - 1);
+    }
+
+    // the child of each run of sorted keys from pos on, a run is the child
+    // and the end of its keys. keys[pos] is taken as in this node, the
+    // rest only if surely, see LeafNodeImpl::holds().
+    void route(std::vector<std::string *> &keys, u32 pos, 
+            std::vector<std::tuple<pgid_t, u32>> &runs) {
+        bool bounded = _dir.hasHigh() || !_hdr->next;
+        for(u32 i = pos; i < keys.size(); i++) {
+            auto &key = *keys[i];
+            u32 at = upperBound(key);
+            if(i > pos && (bounded ? !covers(key) : at == *_size)) {
+                break;
+            }
+            pgid_t child = at == 0 ? _nodehdr->head : val(at - 1);
+            if(!runs.empty() && std::get<0>(runs.back()) == child) {
+                std::get<1>(runs.back()) = i + 1;
+            }else {
+                runs.emplace_back(child, i + 1);
+            }
+        }
     }
 
     std::tuple<pgid_t, u32> get(
             std::string &key, DelEntry &entry) {
 
-        auto ret = std::upper_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-        u32 pos = ret - _keys.begin();
+        u32 pos = upperBound(key);
 
-        if(ret == _keys.end()) {
+        if(pos == *_size) {
             entry.last = true;
         }else {
-            entry.delim = std::string(ret->data(), ret->size());
+            entry.delim = this->key(pos);
         }
 
-        if(ret == _keys.begin()) 
-            return std::make_tuple(*_head, pos);
-
-        ret--;
-        Elem *elem = (Elem *)(ret->data() - sizeof(Elem));
-        return std::make_tuple(elem->val, pos);
+        if(pos == 0) 
+            return std::make_tuple(_nodehdr->head, pos);
+        return std::make_tuple(val(pos - 1), pos);
     }
 
     std::string splitTo(InnerNodeImpl &other) {
-        u32 pos = roundup(*_size);
-        auto str = _keys[pos];
-        char *it = const_cast<char *>(str.data() - sizeof(Elem));
-
-        auto strprev = _keys[pos - 1];
-        auto ret = std::string(strprev.data(), strprev.size());
-        Elem *elem = (Elem *)(strprev.data() - sizeof(Elem));
-
-        u32 rentbytes = (_end - it);
-        u32 rentsize = (*_size - pos);
-
-        other.handleOverFlow(rentbytes + sizeof(pgid_t));
-
-        *other._head = elem->val;
-        *other._size += rentsize;
-        // add head size !!!
-        *other._bytes += (rentbytes + sizeof(pgid_t));
-        other._end = other._data + rentbytes;
-        std::memcpy(other._data, it, rentbytes);
-        other.updateVec();
-
-        *_size -= (rentsize + 1);
-        *_bytes -= (rentbytes + elemSize(elem));
-        _end -= (rentbytes + elemSize(elem));
-        updateVec();
+        u32 pos = splitPos();
+        // key at pos - 1 goes up, its child become the head of other.
+        auto ret = key(pos - 1);
+        other._nodehdr->head = val(pos - 1);
+        other.setPrefix(other.shared(*this, pos, *_size));
+        for(u32 i = pos; i < *_size; i++) {
+            other.append(*this, i);
+        }
+        _dir.truncate(pos - 1);
+        setPrefix(shared(*this, 0, pos - 1));
+        other.takeHigh(*this);
+        setHigh(ret);
         return ret;
     }
 
     void mergeFrom(InnerNodeImpl &other, std::string &str) {
-        push_back(str, *other._head);
-        u32 bytes = other._end - other._data;
-        handleOverFlow(bytes);
-        *_size += *other._size;
-        *_bytes += bytes;
-        std::memcpy(_end, other._data, bytes);
-        _end += bytes;
-        updateVec();
+        push_back(str, other.head());
+        for(u32 i = 0; i < *other._size; i++) {
+            append(other, i);
+        }
+        takeHigh(other);
     }
 
     std::string borrowFrom(InnerNodeImpl &other, std::string delim) {
-        auto ret = std::string(other._keys[0]);
+        auto ret = other.key(0);
         //assert(ret >= delim);
-        push_back(delim, *other._head);
-        *other._head = other.val(0);
+        push_back(delim, other.head());
+        other._nodehdr->head = other.val(0);
         other.pop_front();
+        setHigh(ret);
         return ret;
     }
 
-    u32 elemSize(std::string &key, pgid_t val) { 
+    // if key is in range of node, or has gone right by split.
+    bool covers(std::string &key) {
+        return !_dir.hasHigh() || _cmp(key, _dir.high());
+    }
+    void setHigh(const std::string &key) {
+        u32 len = sizeof(Elem) + key.size();
+        handleOverFlow(len);
+        auto elem = _dir.setHigh(len);
+        elem->keylen = key.size();
+        elem->val = 0;
+        std::memcpy((char *)(elem + 1), key.data(), elem->keylen);
+    }
+    // the high key of other, it is the end of range of both.
+    void takeHigh(InnerNodeImpl &other) {
+        if(other._dir.hasHigh()) {
+            setHigh(std::string(other._dir.high()));
+        }else {
+            _dir.dropHigh();
+        }
+    }
+
+    // the record, its slot and head.
+    static u32 elemSize(std::string_view key, pgid_t val) { 
         (void)val;
-        return sizeof(Elem) + key.size(); 
+        return sizeof(Elem) + key.size() + 2 * sizeof(u32); 
     }
-    bool raw() { return !_data; }
+    bool raw() { return !_hdr; }
     u32 size() { return *_size; }
     void write(){ _pg->write(); }
     u32 next(){ return _hdr->next;}
@@ -250,86 +538,161 @@ public:
 private:
 
     // ===================================================
-    // put at pos it.
-    void _put(char *it, std::string &key, pgid_t val) {
-        u32 size = sizeof(Elem) + key.size();
-        std::memmove(it + size, it, _end - it);
-        auto elem = (Elem *)it;
-        elem->keylen = key.size();
+    // put the rest of key at pos.
+    void _put(u32 pos, std::string_view rest, pgid_t val) {
+        auto elem = _dir.insert(pos, sizeof(Elem) + rest.size());
+        elem->keylen = rest.size();
         elem->val = val;
-        char *data = (char *)(elem + 1);
-        std::memcpy(data, key.data(), elem->keylen);
-
-        (*_size)++;
-        (*_bytes) += size;
-        _end += size;
-        updateVec();
+        std::memcpy((char *)(elem + 1), rest.data(), elem->keylen);
+        _dir.setHead(pos);
     }
 
     void push_back(std::string &key, pgid_t val) {
-        handleOverFlow(elemSize(key, val));
-        _put(_end, key, val);
+        auto rest = fit(key);
+        handleOverFlow(elemSize(rest, val));
+        _put(*_size, rest, val);
     }
 
-    //===================================================
-    //
-    void _del(char *it) {
-        auto elem = (Elem *)it;
-        auto size = elemSize(elem);
-        auto next = it + size;
-        std::memmove(it, next, _end - next);
-
-        (*_size)--;
-        (*_bytes) -= size;
-        _end -= size;
-        updateVec();
+    // copy the record at pos of other node to the end.
+    void append(InnerNodeImpl &other, u32 pos) {
+        auto rest = fit(other._dir.full(pos));
+        auto val = other.val(pos);
+        handleOverFlow(elemSize(rest, val));
+        _put(*_size, rest, val);
     }
 
-    void pop_front() {
-        _del(_data);
+    // key at pos - 1 goes up, it has to be whole as the bound of both
+    // subtrees. take the shortest near the middle.
+    u32 splitPos() {
+        u32 mid = roundup(*_size);
+        u32 best = mid, len = UINT32_MAX;
+        for(u32 d = 0; d <= *_size / SPLIT_WINDOW; d++) {
+            for(u32 pos: {mid - d, mid + d}) {
+                if(pos < 2 || pos >= *_size) {
+                    continue;
+                }
+                if(_dir.elem(pos - 1)->keylen < len) {
+                    best = pos;
+                    len = _dir.elem(pos - 1)->keylen;
+                }
+            }
+        }
+        return best;
     }
 
-    //==================================================
-
-    void _updateKey(char *it, std::string &newkey) {
-        auto elem = (Elem *)it;
-        auto next = it + elemSize(elem);
-        int delta = (int)newkey.size() - (int)elem->keylen;
-        std::memmove(next + delta, next, _end - next);
-        elem->keylen = newkey.size();
-        char *data = (char *)(elem + 1);
-        std::memcpy(data, newkey.data(), elem->keylen);
-        
-        (*_bytes) += delta;
-        _end += delta;
-        updateVec();
+    // the prefix keys in [from, to) of node share, see LeafNodeImpl.
+    std::string shared(InnerNodeImpl &node, u32 from, u32 to) {
+        if(!_bytewise || to - from < 2) {
+            return std::string(node._dir.prefix());
+        }
+        std::string first(node._dir.full(from));
+        return first.substr(0, SlotDir<Elem>::common(first, 
+                    node._dir.full(to - 1)));
+    }
+    // the rest of key after the prefix, which is cut short first if key
+    // has not all of it.
+    std::string_view fit(std::string_view key) {
+        std::string_view rest;
+        if(_dir.locate(key, rest)) {
+            auto pre = _dir.prefix();
+            setPrefix(std::string(pre.substr(0, 
+                        SlotDir<Elem>::common(pre, key))));
+            _dir.locate(key, rest);
+        }
+        return rest;
+    }
+    // rewrite all records under prefix pre, which all keys have.
+    void setPrefix(std::string pre) {
+        if(pre == _dir.prefix()) {
+            return;
+        }
+        std::vector<std::pair<std::string, pgid_t>> ents;
+        for(u32 i = 0; i < *_size; i++) {
+            ents.emplace_back(key(i), val(i));
+        }
+        _dir.truncate(0);
+        _dir.dropPrefix();
+        if(!pre.empty()) {
+            handleOverFlow(sizeof(Elem) + pre.size());
+            auto elem = _dir.setPrefix(sizeof(Elem) + pre.size());
+            elem->keylen = pre.size();
+            elem->val = 0;
+            std::memcpy((char *)(elem + 1), pre.data(), pre.size());
+        }
+        for(auto &[key, val]: ents) {
+            auto rest = std::string_view(key).substr(pre.size());
+            handleOverFlow(elemSize(rest, val));
+            _put(*_size, rest, val);
+        }
     }
 
-    //==================================================
+    //===================================================
+    //
 
-    void updateVec() {
+    void pop_front() {
+        _dir.erase(0);
+    }
 
-        _keys.resize(*_size);
-        Elem *elem = (Elem *)_data;
-        char *data = _data;
-        for(u32 i = 0; i < *_size; i++) {
-            _keys[i] = std::string_view(data + sizeof(Elem), elem->keylen);
-            data += elemSize(elem);
-            elem = (Elem *)data;
+    // keys are looked up by the rest after prefix, a key out of it is
+    // before or after all. in the order of bytes, only the keys of the
+    // same head are compared.
+    void narrow(std::string_view rest, u32 &lo, u32 &hi) {
+        lo = 0;
+        hi = *_size;
+        if(_bytewise) {
+            _dir.headRange(rest, lo, hi);
         }
-        _end = data;
     }
-    u32 elemSize(Elem *elem) {
-        return elem->keylen + sizeof(Elem);
+    u32 lowerBound(std::string &key) {
+        std::string_view rest;
+        if(int where = _dir.locate(key, rest)) {
+            return where < 0 ? 0 : *_size;
+        }
+        u32 lo, hi;
+        narrow(rest, lo, hi);
+        return withOrder(_order, _cmp, [&](const auto &cmp) {
+            using Cmp = std::decay_t<decltype(cmp)>;
+            if constexpr(std::is_same_v<Cmp, KeySearch>) {
+                return cmp.lowerBound(_dir.base(), _dir.begin(), lo, hi,
+                        rest);
+            }
+            auto it = std::lower_bound(_dir.begin() + lo, 
+                    _dir.begin() + hi, rest,
+                [this, &cmp](u32 off, std::string_view rest) {
+                    return cmp(_dir.offkey(off), rest);
+                });
+            return u32(it - _dir.begin());
+        });
+    }
+    u32 upperBound(std::string &key) {
+        std::string_view rest;
+        if(int where = _dir.locate(key, rest)) {
+            return where < 0 ? 0 : *_size;
+        }
+        u32 lo, hi;
+        narrow(rest, lo, hi);
+        return withOrder(_order, _cmp, [&](const auto &cmp) {
+            using Cmp = std::decay_t<decltype(cmp)>;
+            if constexpr(std::is_same_v<Cmp, KeySearch>) {
+                return cmp.upperBound(_dir.base(), _dir.begin(), lo, hi,
+                        rest);
+            }
+            auto it = std::upper_bound(_dir.begin() + lo, 
+                    _dir.begin() + hi, rest,
+                [this, &cmp](std::string_view rest, u32 off) {
+                    return cmp(rest, _dir.offkey(off));
+                });
+            return u32(it - _dir.begin());
+        });
     }
 
     comparator_t   _cmp;
-    std::vector<std::string_view> _keys;
-    char   *_data{nullptr};
-    char   *_end{nullptr};
-    pgid_t *_head{nullptr};
+    KeyOrder       _order{KeyOrder::other};
+    bool           _bytewise{false};
+    SlotDir<Elem>  _dir;
     u32    *_size{nullptr};
     u32    *_bytes{nullptr};
+    Header *_nodehdr{nullptr};
     PageHeader *_hdr{nullptr};
     PageHelperPtr _pg;
 };
@@ -0,0 +1,375 @@
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "FileManager.h"
+#include "IoEngine.h"
+
+namespace bptdb {
+
+std::unique_ptr<IoEngine> g_io;
+
+IoEngine::~IoEngine() {
+    if(_dfd >= 0) {
+        ::close(_dfd);
+    }
+}
+
+int IoEngine::fdOf(Req *req) {
+    if(_dfd < 0 || req->pos % DIRECT_ALIGN) {
+        return _fd;
+    }
+    for(auto &v: req->iov) {
+        if((u64)v.iov_base % DIRECT_ALIGN || v.iov_len % DIRECT_ALIGN) {
+            return _fd;
+        }
+    }
+    return _dfd;
+}
+
+void IoEngine::complete(Req *req, std::int64_t res) {
+    req->res = res;
+    auto batch = req->batch;
+    std::lock_guard lg(batch->_mtx);
+    if(--batch->_pending == 0) {
+        batch->_cv.notify_all();
+    }
+}
+
+// a pool of threads, one blocking call each at a time.
+class ThreadEngine: public IoEngine {
+public:
+    ThreadEngine(int fd, int dfd, u32 nthreads): IoEngine(fd, dfd) {
+        for(u32 i = 0; i < nthreads; i++) {
+            _threads.emplace_back([this] { run(); });
+        }
+    }
+    ~ThreadEngine() {
+        {
+            std::lock_guard lg(_mtx);
+            _stop = true;
+        }
+        _cv.notify_all();
+        for(auto &t: _threads) {
+            t.join();
+        }
+    }
+    void submit(std::vector<Req *> &reqs) override {
+        {
+            std::lock_guard lg(_mtx);
+            _queue.insert(_queue.end(), reqs.begin(), reqs.end());
+        }
+        _cv.notify_all();
+    }
+private:
+    void run() {
+        while(true) {
+            Req *req;
+            {
+                std::unique_lock lg(_mtx);
+                _cv.wait(lg, [this] { return _stop || !_queue.empty(); });
+                if(_queue.empty()) {
+                    return;
+                }
+                req = _queue.front();
+                _queue.pop_front();
+            }
+            auto n = req->write ?
+                ::pwritev(fdOf(req), req->iov.data(), req->iov.size(), req->pos):
+                ::preadv(fdOf(req), req->iov.data(), req->iov.size(), req->pos);
+            complete(req, n < 0 ? -errno : n);
+        }
+    }
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::deque<Req *> _queue;
+    bool _stop{false};
+    std::vector<std::thread> _threads;
+};
+
+// io_uring on its system calls. submitters fill the sq under a lock, one
+// thread reaps the cq. at most depth io are in flight, so the cq never
+// overflows.
+class UringEngine: public IoEngine {
+public:
+    static std::unique_ptr<IoEngine> make(int fd, int dfd, u32 depth) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int ring = ::syscall(__NR_io_uring_setup, depth, &p);
+        if(ring < 0) {
+            return nullptr;
+        }
+        std::unique_ptr<UringEngine> e(new UringEngine(fd, dfd, ring, p));
+        if(!e->_sqes) {
+            e->_dfd = -1;
+            return nullptr;
+        }
+        e->_reaper = std::thread([e = e.get()] { e->reap(); });
+        return e;
+    }
+
+    ~UringEngine() {
+        if(_reaper.joinable()) {
+            // a nop of no request tells the reaper to stop.
+            std::unique_lock lg(_sq_mtx);
+            auto sqe = next(lg);
+            sqe->opcode = IORING_OP_NOP;
+            enter(1, 0, 0);
+            lg.unlock();
+            _reaper.join();
+        }
+        if(_sqes) {
+            ::munmap(_sqes, _sqes_len);
+        }
+        if(_cq_ptr && _cq_ptr != _sq_ptr) {
+            ::munmap(_cq_ptr, _cq_len);
+        }
+        if(_sq_ptr) {
+            ::munmap(_sq_ptr, _sq_len);
+        }
+        ::close(_ring);
+    }
+
+    void submit(std::vector<Req *> &reqs) override {
+        std::unique_lock lg(_sq_mtx);
+        for(auto req: reqs) {
+            auto sqe = next(lg);
+            sqe->opcode = req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe->fd = fdOf(req);
+            sqe->addr = (u64)req->iov.data();
+            sqe->len = req->iov.size();
+            sqe->off = req->pos;
+            sqe->user_data = (u64)req;
+        }
+        enter(_queued, 0, 0);
+    }
+
+private:
+    UringEngine(int fd, int dfd, int ring, io_uring_params &p):
+    IoEngine(fd, dfd), _ring(ring) {
+        _depth = p.sq_entries;
+        _sq_len = p.sq_off.array + p.sq_entries * sizeof(u32);
+        _cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if(single) {
+            _sq_len = _cq_len = std::max(_sq_len, _cq_len);
+        }
+        _sq_ptr = map(_sq_len, IORING_OFF_SQ_RING);
+        _cq_ptr = single ? _sq_ptr : map(_cq_len, IORING_OFF_CQ_RING);
+        if(!_sq_ptr || !_cq_ptr) {
+            return;
+        }
+        _sq_tail  = (u32 *)(_sq_ptr + p.sq_off.tail);
+        _sq_mask  = *(u32 *)(_sq_ptr + p.sq_off.ring_mask);
+        _sq_array = (u32 *)(_sq_ptr + p.sq_off.array);
+        _cq_head  = (u32 *)(_cq_ptr + p.cq_off.head);
+        _cq_tail  = (u32 *)(_cq_ptr + p.cq_off.tail);
+        _cq_mask  = *(u32 *)(_cq_ptr + p.cq_off.ring_mask);
+        _cqes     = (io_uring_cqe *)(_cq_ptr + p.cq_off.cqes);
+        _sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+        _sqes = (io_uring_sqe *)map(_sqes_len, IORING_OFF_SQES);
+    }
+
+    char *map(std::size_t len, u64 off) {
+        auto p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, _ring, off);
+        return p == MAP_FAILED ? nullptr : (char *)p;
+    }
+
+    // a free sqe, once one of depth in flight is done. what is queued is
+    // submitted before waiting.
+    io_uring_sqe *next(std::unique_lock<std::mutex> &lg) {
+        if(_inflight == _depth) {
+            enter(_queued, 0, 0);
+            _sq_cv.wait(lg, [this] { return _inflight < _depth; });
+        }
+        u32 tail = *_sq_tail;
+        u32 idx = tail & _sq_mask;
+        auto sqe = &_sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        _sq_array[idx] = idx;
+        __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        _inflight++;
+        _queued++;
+        return sqe;
+    }
+
+    // caller holds _sq_mtx if it submits.
+    void enter(u32 submit, u32 min, u32 flags) {
+        if(submit) {
+            _queued = 0;
+        }
+        while(true) {
+            int n = ::syscall(__NR_io_uring_enter, _ring, submit, min,
+                    flags, nullptr, 0);
+            if(n < 0) {
+                assert(errno == EINTR);
+                if(errno != EINTR) {
+                    return;
+                }
+                continue;
+            }
+            if((u32)n >= submit) {
+                return;
+            }
+            submit -= n;
+        }
+    }
+
+    void reap() {
+        bool stop = false;
+        while(!stop) {
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+            u32 head = *_cq_head;
+            u32 tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+            u32 n = tail - head;
+            for(; head != tail; head++) {
+                auto cqe = &_cqes[head & _cq_mask];
+                if(!cqe->user_data) {
+                    stop = true;
+                }else {
+                    complete((Req *)cqe->user_data, cqe->res);
+                }
+            }
+            __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+            if(n) {
+                std::lock_guard lg(_sq_mtx);
+                _inflight -= n;
+                _sq_cv.notify_all();
+            }
+        }
+    }
+
+    int _ring{-1};
+    u32 _depth{0};
+    char *_sq_ptr{nullptr};
+    char *_cq_ptr{nullptr};
+    std::size_t _sq_len{0};
+    std::size_t _cq_len{0};
+    std::size_t _sqes_len{0};
+    u32 *_sq_tail{nullptr};
+    u32 *_sq_array{nullptr};
+    u32  _sq_mask{0};
+    u32 *_cq_head{nullptr};
+    u32 *_cq_tail{nullptr};
+    u32  _cq_mask{0};
+    io_uring_sqe *_sqes{nullptr};
+    io_uring_cqe *_cqes{nullptr};
+
+    std::mutex _sq_mtx;
+    std::condition_variable _sq_cv;
+    u32 _inflight{0};
+    u32 _queued{0}; // in sq, not submitted yet
+    std::thread _reaper;
+};
+
+std::unique_ptr<IoEngine> IoEngine::make(std::string path, int fd,
+                                         Option &option) {
+    int dfd = -1;
+    // some file systems refuse O_DIRECT, then all io is buffered.
+    if(option.direct_io) {
+        dfd = ::open(path.c_str(),
+                O_RDWR | O_DIRECT | (option.sync ? O_DSYNC : 0));
+    }
+    u32 depth = std::max(option.io_depth, 1u);
+    if(option.io_backend == IoBackend::uring) {
+        if(auto e = UringEngine::make(fd, dfd, depth)) {
+            return e;
+        }
+    }
+    return std::make_unique<ThreadEngine>(fd, dfd, std::min(depth, 16u));
+}
+
+void IoBatch::read(std::vector<iovec> iov, u64 pos,
+                   std::function<void()> done) {
+    add(false, iov, pos, done);
+}
+
+void IoBatch::write(std::vector<iovec> iov, u64 pos,
+                    std::function<void()> done) {
+    add(true, iov, pos, done);
+}
+
+// split by IOV_MAX, done goes with the last piece.
+void IoBatch::add(bool write, std::vector<iovec> &iov, u64 pos,
+                  std::function<void()> &done) {
+    for(std::size_t i = 0; i < iov.size(); i += IOV_MAX) {
+        auto req = std::make_unique<IoEngine::Req>();
+        req->write = write;
+        req->iov.assign(iov.begin() + i,
+                iov.begin() + std::min<std::size_t>(iov.size(), i + IOV_MAX));
+        req->pos = pos;
+        for(auto &v: req->iov) {
+            req->len += v.iov_len;
+        }
+        pos += req->len;
+        req->batch = this;
+        if(i + IOV_MAX >= iov.size()) {
+            req->done = std::move(done);
+        }
+        _reqs.push_back(std::move(req));
+    }
+}
+
+void IoBatch::wait() {
+    if(_reqs.empty()) {
+        return;
+    }
+    if(_engine) {
+        std::vector<IoEngine::Req *> reqs;
+        for(auto &req: _reqs) {
+            reqs.push_back(req.get());
+        }
+        _pending = reqs.size();
+        _engine->submit(reqs);
+        std::unique_lock lg(_mtx);
+        _cv.wait(lg, [this] { return _pending == 0; });
+    }
+    for(auto &req: _reqs) {
+        // a short one, or no engine: the rest by blocking io.
+        u64 n = req->res > 0 ? req->res : 0;
+        if(n < req->len) {
+            auto &iov = req->iov;
+            u32 i = 0;
+            for(u64 skip = n; skip > 0; ) {
+                if(skip >= iov[i].iov_len) {
+                    skip -= iov[i++].iov_len;
+                    continue;
+                }
+                iov[i].iov_base = (char *)iov[i].iov_base + skip;
+                iov[i].iov_len -= skip;
+                skip = 0;
+            }
+            std::vector<iovec> rest(iov.begin() + i, iov.end());
+            if(req->write) {
+                g_fm->writev(rest, req->pos + n);
+            }else {
+                g_fm->readv(rest, req->pos + n);
+            }
+        }
+        if(req->done) {
+            req->done();
+        }
+    }
+    _reqs.clear();
+}
+
+void IoBatch::drop() {
+    for(auto &req: _reqs) {
+        if(req->done) {
+            req->done();
+        }
+    }
+    _reqs.clear();
+}
+
+}// namespace bptdb
@@ -0,0 +1,82 @@
+#ifndef __IO_ENGINE_H
+#define __IO_ENGINE_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "common.h"
+#include "Option.h"
+
+namespace bptdb {
+
+class IoBatch;
+
+// runs reads and writes of the data file, many of them in flight at once.
+// io is queued to a batch and given to the engine all together.
+class IoEngine {
+public:
+    // one preadv or pwritev. res is the bytes done or -errno, what is left
+    // of a short one is done by blocking io.
+    struct Req {
+        bool write{false};
+        std::vector<iovec> iov;
+        u64 pos{0};
+        u64 len{0};
+        std::int64_t res{0};
+        std::function<void()> done;
+        IoBatch *batch{nullptr};
+    };
+
+    virtual ~IoEngine();
+    // io_uring if asked and the kernel has it, else threads.
+    static std::unique_ptr<IoEngine> make(std::string path, int fd,
+                                          Option &option);
+    virtual void submit(std::vector<Req *> &reqs) = 0;
+
+protected:
+    IoEngine(int fd, int dfd): _fd(fd), _dfd(dfd) {}
+    // O_DIRECT is taken when buffers, length and offset are all aligned.
+    int fdOf(Req *req);
+    static void complete(Req *req, std::int64_t res);
+
+    int _fd{-1};
+    int _dfd{-1}; // opened with O_DIRECT, -1 if not asked or not allowed
+};
+
+// io queued by one thread. wait() gives it all to the engine, then calls
+// the callbacks in the calling thread, so latches taken here are released
+// here.
+class IoBatch {
+public:
+    IoBatch(IoEngine *engine): _engine(engine) {}
+    ~IoBatch() { wait(); }
+    // read consecutive bytes at pos into buffers of iov, zero past the end.
+    void read(std::vector<iovec> iov, u64 pos, std::function<void()> done);
+    // write buffers of iov to consecutive bytes at pos.
+    void write(std::vector<iovec> iov, u64 pos, std::function<void()> done);
+    u32 size() { return _reqs.size(); }
+    void wait();
+    // give up the io queued, the callbacks are still called.
+    void drop();
+
+private:
+    friend class IoEngine;
+    void add(bool write, std::vector<iovec> &iov, u64 pos,
+             std::function<void()> &done);
+
+    IoEngine *_engine{nullptr};
+    std::vector<std::unique_ptr<IoEngine::Req>> _reqs;
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    u32 _pending{0};
+};
+
+extern std::unique_ptr<IoEngine> g_io;
+
+}// namespace bptdb
+
+#endif
@@ -11,6 +11,7 @@ public:
     virtual std::string_view val() = 0;
     virtual bool done() = 0;
     virtual void next() = 0;
+    virtual void prev() = 0;
 };
 
 }// namespace bptdb
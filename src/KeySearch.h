@@ -0,0 +1,151 @@
+#ifndef __KEY_SEARCH_H
+#define __KEY_SEARCH_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+#include "Option.h"
+
+namespace bptdb {
+
+// binary search over the slots of a node in the order of a comparator,
+// made for the type of it, so each compare is inline and only a whole
+// search is a virtual call. a record a slot points to is the u32 length
+// of key, 4 bytes more, then the key.
+class KeySearch {
+public:
+    virtual ~KeySearch() = default;
+    virtual bool less(std::string_view a, std::string_view b) const = 0;
+    bool operator()(std::string_view a, std::string_view b) const {
+        return less(a, b);
+    }
+    // the first of slots[lo, hi) whose key is not less than key.
+    virtual std::uint32_t lowerBound(const char *node,
+            const std::uint32_t *slots, std::uint32_t lo, std::uint32_t hi,
+            std::string_view key) const = 0;
+    // the first of slots[lo, hi) whose key is greater than key.
+    virtual std::uint32_t upperBound(const char *node,
+            const std::uint32_t *slots, std::uint32_t lo, std::uint32_t hi,
+            std::string_view key) const = 0;
+    // upperBound in a node of cap bytes a writer may be changing, each
+    // slot and length is loaded once, false if a key is out of node.
+    virtual bool upperBound(const char *node, std::uint64_t cap,
+            const std::uint32_t *slots, std::uint64_t lo, std::uint64_t hi,
+            std::string_view key, std::uint64_t &pos) const = 0;
+};
+
+template <typename Cmp>
+class KeySearchOf final: public KeySearch {
+    static_assert(std::is_invocable_r_v<bool, const Cmp &,
+                  std::string_view, std::string_view>,
+                  "a const call of cmp(a, b) tells if a is before b");
+public:
+    KeySearchOf(Cmp cmp): _cmp(std::move(cmp)) {}
+
+    bool less(std::string_view a, std::string_view b) const override {
+        return _cmp(a, b);
+    }
+    std::uint32_t lowerBound(const char *node, const std::uint32_t *slots,
+            std::uint32_t lo, std::uint32_t hi,
+            std::string_view key) const override {
+        while(lo < hi) {
+            std::uint32_t mid = lo + (hi - lo) / 2;
+            if(_cmp(keyAt(node, slots[mid]), key)) {
+                lo = mid + 1;
+            }else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+    std::uint32_t upperBound(const char *node, const std::uint32_t *slots,
+            std::uint32_t lo, std::uint32_t hi,
+            std::string_view key) const override {
+        while(lo < hi) {
+            std::uint32_t mid = lo + (hi - lo) / 2;
+            if(_cmp(key, keyAt(node, slots[mid]))) {
+                hi = mid;
+            }else {
+                lo = mid + 1;
+            }
+        }
+        return lo;
+    }
+    bool upperBound(const char *node, std::uint64_t cap,
+            const std::uint32_t *slots, std::uint64_t lo, std::uint64_t hi,
+            std::string_view key, std::uint64_t &pos) const override {
+        while(lo < hi) {
+            std::uint64_t mid = lo + (hi - lo) / 2;
+            std::uint64_t off = slots[mid];
+            if(off + HEAD > cap) {
+                return false;
+            }
+            std::uint32_t len;
+            std::memcpy(&len, node + off, sizeof(len));
+            if(off + HEAD + len > cap) {
+                return false;
+            }
+            if(_cmp(key, std::string_view(node + off + HEAD, len))) {
+                hi = mid;
+            }else {
+                lo = mid + 1;
+            }
+        }
+        pos = lo;
+        return true;
+    }
+
+private:
+    static constexpr std::uint32_t HEAD = 2 * sizeof(std::uint32_t);
+    static std::string_view keyAt(const char *node, std::uint32_t off) {
+        std::uint32_t len;
+        std::memcpy(&len, node + off, sizeof(len));
+        return std::string_view(node + off + HEAD, len);
+    }
+
+    Cmp _cmp;
+};
+
+// a comparator_t holding this is searched in nodes by its KeySearch.
+class SearchCmp {
+public:
+    SearchCmp(std::shared_ptr<const KeySearch> search)
+        : _search(std::move(search)) {}
+    bool operator()(std::string_view a, std::string_view b) const {
+        return _search->less(a, b);
+    }
+    const KeySearch &search() const {
+        return *_search;
+    }
+private:
+    std::shared_ptr<const KeySearch> _search;
+};
+
+// if Cmp is an order of keys to be searched as its own type.
+template <typename Cmp>
+constexpr bool isKeyOrder =
+    std::is_invocable_r_v<bool, const Cmp &,
+                          std::string_view, std::string_view> &&
+    !std::is_same_v<std::decay_t<Cmp>, comparator_t>;
+
+// cmp as a comparator_t searched by KeySearchOf<Cmp>. std::less and
+// std::greater of string_view are searched inline by nodes themselves,
+// and std::less has prefixes and heads of keys too, they are kept as
+// they are.
+template <typename Cmp>
+comparator_t searchable(Cmp cmp) {
+    if constexpr(std::is_same_v<Cmp, std::less<std::string_view>> ||
+                 std::is_same_v<Cmp, std::greater<std::string_view>>) {
+        return cmp;
+    }else {
+        return SearchCmp(std::make_shared<KeySearchOf<Cmp>>(std::move(cmp)));
+    }
+}
+
+}// namespace bptdb
+
+#endif
@@ -2,10 +2,12 @@
 #define __LEAF_NODE_H
 
 #include <memory>
+#include "FileManager.h"
 #include "Node.h"
 #include "Option.h"
 #include "LeafNodeImpl.h"
 #include "PageHelper.h"
+#include "WriteBatch.h"
 
 // maintain next_impl._impl
 
@@ -15,21 +17,21 @@ class LeafNode: public Node {
 public:
     using Iter_t = LeafNodeImpl::Iterator;
     //using IterPtr_t = std::shared_ptr<Iter_t>;
-    using Mutex_t = std::shared_mutex;
+    using Mutex_t = VersionLatch;
 
     LeafNode(pgid_t id, u32 maxsize, 
-             NodeMap<LeafNode> *map, comparator_t cmp): 
-        Node(id, maxsize), _cmp(cmp), _map(map) {}
+             NodeMap<LeafNode> *map, const comparator_t &cmp): 
+        Node(id, maxsize), _cmp(cmp), _type(map->type()), _map(map) {}
 
     // ==================================================================
 
     void split(PutEntry &entry, LeafNodeImpl &impl) {
 
         auto new_id = g_pa->allocPage(1);
-        PageHeader::newOnDisk(new_id, 1, impl.next());
+        LeafNodeImpl::newOnDisk(new_id, impl.next());
         impl.setNext(new_id);
 
-        auto next_node = LeafNodeImpl(new_id, _cmp);
+        auto next_node = LeafNodeImpl(new_id, _cmp, PageMode::Write, _type);
 
         entry.val = new_id;
         entry.key = impl.splitTo(next_node);
@@ -40,7 +42,9 @@ public:
 
     bool borrow(DelEntry &entry, LeafNodeImpl &impl) {
 
-        auto next_node = LeafNodeImpl(impl.next(), _cmp);
+        std::lock_guard lg(_map->get(impl.next())->getMutex());
+        auto next_node = LeafNodeImpl(impl.next(), _cmp, 
+                PageMode::Write, _type);
 
         if(!hasmore(next_node.size())) {
             return false;
@@ -55,16 +59,22 @@ public:
 
     void merge(DelEntry &entry, LeafNodeImpl &impl) {
 
-        auto next_node = LeafNodeImpl(impl.next(), _cmp);
-        impl.mergeFrom(next_node);
-        entry.del = true;
-        
         assert(impl.next());
         auto ret = impl.next();
-        // set next
-        impl.setNext(next_node.next());
-        // 1. free page buffer on memory and page id on disk
-        next_node.free();
+        auto sib = _map->get(ret);
+        {
+            // a lookup may be on it, latch it before it goes.
+            std::lock_guard lg(sib->getMutex());
+            auto next_node = LeafNodeImpl(ret, _cmp, PageMode::Write, _type);
+            impl.mergeFrom(next_node);
+            entry.del = true;
+
+            // set next
+            impl.setNext(next_node.next());
+            // 1. free page buffer on memory and page id on disk
+            next_node.free();
+            sib->getMutex().markObsolete();
+        }
         // 2. del page at cache
         // _db->getPageCache()->del(ret);
         // 3. del node on map
@@ -74,17 +84,18 @@ public:
     // ==================================================================
 
     std::tuple<bool, Status> 
-    tryPut(std::string &key, std::string &val, Mutex_t &par_mtx) {
+    tryPut(std::string &key, std::string &val, Coupling &par) {
         std::lock_guard lg(_shmtx);
-        par_mtx.unlock_shared();
-        
-        auto impl = LeafNodeImpl(_id, _cmp);
+        if(!par.release(_shmtx)) {
+            return std::make_tuple(false, Status());
+        }
+
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
         if (!safetoput(impl.size())) {
             return std::make_tuple(false, Status());
         }
+        // a failed op leaves the page as it was, no write.
         if(!impl.put(key, val)) {
-            // write here, because the page maybe over flow and change.
-            impl.write();
             return std::make_tuple(true, Status(error::keyRepeat));
         }
         impl.write();
@@ -95,10 +106,8 @@ public:
 
         std::lock_guard lg(_shmtx);
 
-        auto impl = LeafNodeImpl(_id, _cmp);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
         if(!impl.put(key, val)) {
-            // same as tryPut
-            impl.write();
             return Status(error::keyRepeat);
         }
         // we need to judge again, because other thread may do this.
@@ -112,16 +121,17 @@ public:
     }
 
     std::tuple<bool, Status> 
-    tryDel(std::string &key, Mutex_t &par_mtx) {
+    tryDel(std::string &key, Coupling &par) {
         std::lock_guard lg(_shmtx);
-        par_mtx.unlock_shared();
+        if(!par.release(_shmtx)) {
+            return std::make_tuple(false, Status());
+        }
 
-        auto impl = LeafNodeImpl(_id, _cmp);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
         if(safetodel(impl.size())) {
             return std::make_tuple(false, Status());
         }
         if(!impl.del(key)) {
-            impl.write();
             return std::make_tuple(true, Status(error::keyNotFind));
         }
         impl.write();
@@ -131,7 +141,7 @@ public:
     Status del(std::string &key, DelEntry &entry) {
 
         std::lock_guard lg(_shmtx);
-        auto impl = LeafNodeImpl(_id, _cmp);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
 
         if(!impl.del(key)) {
             return Status(error::keyNotFind);
@@ -152,68 +162,209 @@ done:
         return Status(); 
     }
 
-    Status get(std::string &key, std::string &val, 
-            Mutex_t &par_mtx) {
+    // false if the leaf is not the one for key any more, look it up again.
+    std::tuple<bool, Status> 
+    get(std::string &key, std::string &val, Coupling &par) {
 
         // shared lock guard for self and unlock parent.
         std::shared_lock lg(_shmtx);
-        par_mtx.unlock_shared();
+        if(!par.release(_shmtx)) {
+            return std::make_tuple(false, Status());
+        }
 
-        auto impl = LeafNodeImpl(_id, _cmp);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Read, _type);
         // keep page alive.
         if(!impl.get(key, val)) {
-            return Status(error::keyNotFind);
+            return std::make_tuple(true, Status(error::keyNotFind));
         }
-        return Status();
+        return std::make_tuple(true, Status());
     }
 
-    Status update(std::string &key, std::string &val, 
-            Mutex_t &par_mtx) {
+    // get vals of sorted keys in [pos, end), the caller keeps the leaf
+    // from split or merge, else keys may have gone right. return the first
+    // key not looked up, right is the leaf right of it then.
+    u32 get(std::vector<std::string *> &keys, u32 pos, u32 end, 
+            std::vector<std::tuple<Status, std::string> *> &rets, 
+            pgid_t &right) {
+        std::shared_lock lg(_shmtx);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Read, _type);
+        for(; pos < end; pos++) {
+            if(!impl.covers(*keys[pos])) {
+                right = impl.next();
+                break;
+            }
+            auto &[stat, val] = *rets[pos];
+            if(!impl.get(*keys[pos], val)) {
+                stat = Status(error::keyNotFind);
+            }
+        }
+        return pos;
+    }
+
+    // same as get.
+    std::tuple<bool, Status> 
+    update(std::string &key, std::string &val, Coupling &par) {
 
         // lock guard for self and unlock parent.
         std::lock_guard lg(_shmtx);
-        par_mtx.unlock_shared();
+        if(!par.release(_shmtx)) {
+            return std::make_tuple(false, Status());
+        }
 
-        auto impl = LeafNodeImpl(_id, _cmp);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
 
         if(!impl.update(key, val)) {
-            impl.write();
-            return Status(error::keyNotFind);
+            return std::make_tuple(true, Status(error::keyNotFind));
         }
         impl.write();
-        return Status();
+        return std::make_tuple(true, Status());
     }
 
-    static void newOnDisk(pgid_t id) {
-        PageHeader::newOnDisk(id);
+    // apply ops from pos on while their keys fall in this leaf and no split
+    // or merge is needed, the leaf is latched and written once for all.
+    // return false if the leaf is not the one for ops[pos], right is its
+    // right leaf then. else the first op not applied, pos itself if that
+    // op changes the tree shape.
+    std::tuple<bool, u32> 
+    apply(std::vector<WriteBatch::Op *> &ops, u32 pos, Coupling &par, 
+          bool merge, pgid_t &right) {
+        std::lock_guard lg(_shmtx);
+        if(!par.release(_shmtx)) {
+            return std::make_tuple(false, pos);
+        }
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
+        if(!impl.covers(ops[pos]->key)) {
+            right = impl.next();
+            return std::make_tuple(false, pos);
+        }
+        // dels of keys not there only, the page is as it was.
+        bool changed = false;
+        for(; pos < ops.size(); pos++) {
+            auto op = ops[pos];
+            if(!impl.holds(op->key)) {
+                break;
+            }
+            bool there = impl.find(op->key);
+            if(op->del) {
+                if(!there) {
+                    continue;
+                }
+                if(merge && !safetodel(impl.size())) {
+                    break;
+                }
+                impl.del(op->key);
+                changed = true;
+                continue;
+            }
+            if(there) {
+                impl.update(op->key, op->val);
+                changed = true;
+                continue;
+            }
+            if(!safetoput(impl.size())) {
+                break;
+            }
+            impl.put(op->key, op->val);
+            changed = true;
+        }
+        if(changed) {
+            impl.write();
+        }
+        return std::make_tuple(true, pos);
     }
 
-    // !!!iteration without lock
+    // ops in blink mode, the leaf is latched alone. false and the right
+    // leaf if key has gone right by split, try it then.
     // =====================================================
 
-    std::tuple<Iter_t, LeafNodeImplPtr> begin() {
-        // keep page alive.
-        auto impl = std::make_shared<LeafNodeImpl>(_id, _cmp);
-        return std::make_tuple(impl->begin(), impl);
+    std::tuple<bool, Status> 
+    linkGet(std::string &key, std::string &val, pgid_t &right) {
+        std::shared_lock lg(_shmtx);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Read, _type);
+        if(!impl.covers(key)) {
+            right = impl.next();
+            return std::make_tuple(false, Status());
+        }
+        if(!impl.get(key, val)) {
+            return std::make_tuple(true, Status(error::keyNotFind));
+        }
+        return std::make_tuple(true, Status());
     }
-    std::tuple<Iter_t, LeafNodeImplPtr> at(std::string &key) {
-        // keep page alive.
-        auto impl = std::make_shared<LeafNodeImpl>(_id, _cmp);
-        return std::make_tuple(impl->at(key), impl);
+
+    std::tuple<bool, Status> 
+    linkUpdate(std::string &key, std::string &val, pgid_t &right) {
+        std::lock_guard lg(_shmtx);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
+        if(!impl.covers(key)) {
+            right = impl.next();
+            return std::make_tuple(false, Status());
+        }
+        if(!impl.update(key, val)) {
+            return std::make_tuple(true, Status(error::keyNotFind));
+        }
+        impl.write();
+        return std::make_tuple(true, Status());
+    }
+
+    std::tuple<bool, Status> 
+    linkPut(std::string &key, std::string &val, PutEntry &entry, 
+            pgid_t &right) {
+        std::lock_guard lg(_shmtx);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
+        if(!impl.covers(key)) {
+            right = impl.next();
+            return std::make_tuple(false, Status());
+        }
+        if(!impl.put(key, val)) {
+            return std::make_tuple(true, Status(error::keyRepeat));
+        }
+        if(ifsplit(impl.size())) {
+            DEBUGOUT("===> leafnode split");
+            split(entry, impl);
+        }
+        impl.write();
+        return std::make_tuple(true, Status());
     }
 
-    // !!!without lock, only used by iterator.
-    LeafNode *next() {
+    // never merge, a leaf may go empty.
+    std::tuple<bool, Status> 
+    linkDel(std::string &key, pgid_t &right) {
+        std::lock_guard lg(_shmtx);
+        auto impl = LeafNodeImpl(_id, _cmp, PageMode::Write, _type);
+        if(!impl.covers(key)) {
+            right = impl.next();
+            return std::make_tuple(false, Status());
+        }
+        if(!impl.del(key)) {
+            return std::make_tuple(true, Status(error::keyNotFind));
+        }
+        impl.write();
+        return std::make_tuple(true, Status());
+    }
+
+    static void newOnDisk(pgid_t id) {
+        LeafNodeImpl::newOnDisk(id);
+    }
+
+    // iteration on a copy of the leaf, the long vals are read with it
+    // under the latch. pages of a mapped file never change, they are read
+    // in place when asked.
+    // =====================================================
+
+    std::tuple<Iter_t, LeafNodeImplPtr> begin() {
+        std::shared_lock lg(_shmtx);
         // keep page alive.
-        auto impl = LeafNodeImpl(_id, _cmp);
-        if(impl.next() == 0) {
-            return nullptr;
+        auto impl = std::make_shared<LeafNodeImpl>(_id, _cmp, 
+                PageMode::Copy, _type);
+        if(!g_fm->mapped()) {
+            impl->keepBlobs();
         }
-        return _map->get(impl.next());
+        return std::make_tuple(impl->begin(), impl);
     }
 
 private:
-    comparator_t         _cmp;
+    const comparator_t  &_cmp; // the one of map
+    const BucketType    &_type;
     NodeMap<LeafNode>    *_map;
 };
 
@@ -11,17 +11,27 @@
 #include <algorithm>
 #include <tuple>
 #include "common.h"
+#include "Blob.h"
+#include "FixedDir.h"
 #include "Option.h"
 #include "PageHelper.h"
 #include "PageHeader.h"
+#include "SlotDir.h"
 
 namespace bptdb {
 
 class LeafNodeImpl {
 public:
     struct Elem {
+        static constexpr u32 BLOB = 1u << 31; ///< in vallen, val is a ref
         u32 keylen;
         u32 vallen;
+        u32 size() { return sizeof(Elem) + keylen + (vallen & ~BLOB); }
+    };
+    // follow the PageHeader.
+    struct Header {
+        u32 low;     ///< start of record area
+        u32 prefix;  ///< offset of the prefix of keys, 0 if none
     };
     class Iterator {
         friend class LeafNodeImpl;
@@ -34,64 +44,107 @@ public:
         void next() {
             _pos++;
         }
-        std::string_view key() { return _impl->_keys[_pos]; }
-        std::string_view val() { return key2val(key());    }
+        void prev() {
+            _pos--;
+        }
+        u32 pos() { return _pos; }
+        std::string_view key() { return _impl->full(_pos); }
+        std::string_view val() { return _impl->valView(_pos); }
+        bool blob() { return _impl->blob(_pos); }
         bool done() {
-            return _pos == *(_impl->_size);    
+            return _pos == *(_impl->_size);
         }
     private:
-        std::string_view key2val(std::string_view key) {
-            auto elem = (Elem *)(key.data() - sizeof(Elem));
-            return std::string_view(
-                key.data() + elem->keylen, elem->vallen);
-        }
         u32 _pos{0};
         LeafNodeImpl *_impl{nullptr};
     };
 
     std::string_view minkey() {
-        return _keys[0];
+        return full(0);
     }
     std::string_view maxkey() {
-        return _keys[_keys.size() - 1];
+        return full(*_size - 1);
     }
 
     // ===============================================
 
     // get key and val at pos
     std::string key(u32 pos) {
-        auto key = _keys[pos];
-        return std::string(key.data(), key.size());
+        return std::string(full(pos));
     }
     std::string val(u32 pos) {
-        return key2val(_keys[pos]);
+        return std::string(valView(pos));
     }
-    std::string key2val(std::string_view key) {
-        auto elem = (Elem *)(key.data() - sizeof(Elem));
-        return std::string(
-            key.data() + elem->keylen, elem->vallen);
+    // a long val is read into a buffer of node, kept till the next one,
+    // or is the one kept by keepBlobs.
+    std::string_view valView(u32 pos) {
+        if(blob(pos)) {
+            if(!_kept.empty()) {
+                return _kept[pos];
+            }
+            return Blob::read(ref(pos), _blob);
+        }
+        return raw(pos);
+    }
+    // read all long vals now, the caller holds the latch of leaf. once it
+    // is let go their pages may be rewritten or freed and taken by others.
+    void keepBlobs() {
+        if(_fixed) {
+            return;
+        }
+        for(u32 pos = 0; pos < *_size; pos++) {
+            if(!blob(pos)) {
+                continue;
+            }
+            if(_kept.empty()) {
+                _kept.resize(*_size);
+            }
+            _kept[pos] = std::string(Blob::read(ref(pos), _blob));
+        }
+    }
+    // if val at pos is on pages of its own.
+    bool blob(u32 pos) {
+        return !_fixed && (_dir.elem(pos)->vallen & Elem::BLOB);
+    }
+    // val at pos as it is in record, the ref of a long one.
+    std::string_view raw(u32 pos) {
+        if(_fixed) {
+            return _fd.val(pos);
+        }
+        auto elem = _dir.elem(pos);
+        return std::string_view((char *)(elem + 1) + elem->keylen, 
+                elem->vallen & ~Elem::BLOB);
+    }
+    Blob::Ref ref(u32 pos) {
+        return Blob::load(raw(pos).data());
     }
 
     // ===============================================
-    
+
     // get iteration
     Iterator begin() {
         return Iterator(0, this);
     }
-    Iterator at(std::string &key) {
-        auto it = std::lower_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-        if((it == _keys.end()) || _cmp(key, *it)) {
-            return Iterator();
-        }
-        return Iterator(it - _keys.begin(), this);
+    // at the first key not less than key.
+    Iterator seek(std::string &key) {
+        return Iterator(lowerBound(key), this);
+    }
+    Iterator end() {
+        return Iterator(*_size, this);
     }
 
     //================================================
 
-    LeafNodeImpl(pgid_t id, comparator_t cmp) {
-        _pg = std::make_shared<PageHelper>(id);
+    // records of a typed bucket are laid out by FixedDir, they have no
+    // prefix and no long val.
+    LeafNodeImpl(pgid_t id, comparator_t cmp,
+            PageMode mode = PageMode::Copy, BucketType type = BucketType()) {
+        _pg = std::make_shared<PageHelper>(id, mode);
         _cmp = cmp;
+        _order = keyOrder(cmp);
+        _fixed = type.typed();
+        _bytewise = _order == KeyOrder::bytes && !_fixed;
+        _type = type;
         _pg->read();
         reset();
     }
@@ -100,218 +153,533 @@ public:
         _hdr = (PageHeader *)_pg->data();
         _bytes = &_hdr->bytes;
         _size = &_hdr->size;
-        _data = (char *)(_hdr + 1);
-        // notice! we don't set the _end here.
-        updateVec();
+        _nodehdr = (Header *)(_hdr + 1);
+        _dir.reset((char *)_hdr, _pg->capacity(), (u32 *)(_nodehdr + 1),
+                &_nodehdr->low, _size, _bytes, &_hdr->high, 
+                &_nodehdr->prefix);
+        _fd.reset((char *)_hdr, _pg->capacity(), 
+                sizeof(PageHeader) + sizeof(Header), _size, _bytes, 
+                &_hdr->high, _type);
+    }
+
+    // format as an empty node.
+    void clear() {
+        *_bytes = sizeof(PageHeader) + sizeof(Header);
+        _dir.clear();
+    }
+
+    static void newOnDisk(pgid_t id, pgid_t next = 0) {
+        PageHelper pg(id, 1);
+        auto hdr = (PageHeader *)pg.data();
+        PageHeader::init(hdr, 1, next);
+        hdr->bytes += sizeof(Header);
+        ((Header *)(hdr + 1))->low = g_option.page_size;
+        ((Header *)(hdr + 1))->prefix = 0;
+        pg.write();
+    }
+
+    // rewrite a node of an old format into the layout now. format 0
+    // packed records right after the header, 1 had slots but no prefix.
+    static void upgrade(pgid_t id, u32 version) {
+        std::vector<std::pair<std::string, std::string>> kvs;
+        std::string high;
+        {
+            PageHelper pg(id);
+            auto hdr = (PageHeader *)pg.read();
+            char *data = (char *)(hdr + 1);
+            auto slots = (u32 *)(data + sizeof(u32));
+            for(u32 i = 0; i < hdr->size; i++) {
+                auto elem = version ? (Elem *)((char *)hdr + slots[i]) 
+                                    : (Elem *)data;
+                char *key = (char *)(elem + 1);
+                kvs.emplace_back(std::string(key, elem->keylen),
+                        std::string(key + elem->keylen, elem->vallen));
+                data += elem->size();
+            }
+            if(version && hdr->high) {
+                auto elem = (Elem *)((char *)hdr + hdr->high);
+                high.assign((char *)(elem + 1), elem->keylen);
+            }
+        }
+        LeafNodeImpl impl(id, comparator_t(), PageMode::Write);
+        impl.clear();
+        for(auto &kv: kvs) {
+            impl.push_back(std::move(kv.first), std::move(kv.second));
+        }
+        if(!high.empty()) {
+            impl.setHigh(high);
+        }
+        impl.write();
+    }
+
+    // lay out a node of the first n of kvs on a run of pages of its own,
+    // for bulk load. next is left 0, high is none if null. keys share
+    // their prefix if bytes_order is set. vals marked in blobs are refs.
+    static std::string image(
+            std::vector<std::pair<std::string, std::string>> &kvs, 
+            std::vector<bool> &blobs, u32 n, const std::string *high, 
+            bool bytes_order) {
+        u32 pre = 0;
+        if(bytes_order && n > 1) {
+            pre = SlotDir<Elem>::common(kvs[0].first, kvs[n - 1].first);
+        }
+        u32 bytes = sizeof(PageHeader) + sizeof(Header);
+        if(pre) {
+            bytes += sizeof(Elem) + pre;
+        }
+        for(u32 i = 0; i < n; i++) {
+            bytes += elemSize(kvs[i].first, kvs[i].second) - pre;
+        }
+        if(high) {
+            bytes += sizeof(Elem) + high->size();
+        }
+        u32 pages = byte2page(bytes);
+        std::string buf(pages * g_option.page_size, 0);
+        auto hdr = (PageHeader *)buf.data();
+        PageHeader::init(hdr, pages, 0);
+        hdr->bytes += sizeof(Header);
+        auto nodehdr = (Header *)(hdr + 1);
+        SlotDir<Elem> dir;
+        dir.reset(buf.data(), buf.size(), (u32 *)(nodehdr + 1),
+                &nodehdr->low, &hdr->size, &hdr->bytes, &hdr->high,
+                &nodehdr->prefix);
+        dir.clear();
+        if(pre) {
+            auto elem = dir.setPrefix(sizeof(Elem) + pre);
+            elem->keylen = pre;
+            elem->vallen = 0;
+            std::memcpy((char *)(elem + 1), kvs[0].first.data(), pre);
+        }
+        for(u32 i = 0; i < n; i++) {
+            auto &[key, val] = kvs[i];
+            u32 keylen = key.size() - pre;
+            auto elem = dir.insert(hdr->size, 
+                    sizeof(Elem) + keylen + val.size());
+            elem->keylen = keylen;
+            elem->vallen = val.size() | (blobs[i] ? Elem::BLOB : 0);
+            char *data = (char *)(elem + 1);
+            std::memcpy(data, key.data() + pre, keylen);
+            std::memcpy(data + keylen, val.data(), val.size());
+        }
+        if(high) {
+            auto elem = dir.setHigh(sizeof(Elem) + high->size());
+            elem->keylen = high->size();
+            elem->vallen = 0;
+            std::memcpy((char *)(elem + 1), high->data(), elem->keylen);
+        }
+        return buf;
     }
 
     // ============================================
 
     void handleOverFlow(u32 extbytes) {
         if (_pg->overFlow(extbytes)) {
+            u32 oldcap = _pg->capacity();
             _pg->extend(extbytes);
             reset();
-        } 
+            if(_fixed) {
+                _fd.grow(oldcap);
+            }else {
+                _dir.grow(oldcap);
+            }
+        }
     }
 
     // ============================================
 
     void verify() {
-        // for(u32 i = 1; i < _keys.size(); i++) {
-        //     assert(_keys[i] > _keys[i - 1]);
+        // for(u32 i = 1; i < *_size; i++) {
+        //     assert(_dir.key(i) > _dir.key(i - 1));
         // }
     }
 
     void push_back(std::string &&key, std::string &&val) {
-        handleOverFlow(elemSize(key, val));
-        _put(_end, key, val);
+        auto rest = fit(key);
+        handleOverFlow(elemSize(rest, Blob::stored(val.size())));
+        _store(*_size, rest, val);
     }
 
     bool put(std::string &key, std::string &val) {
         verify();
-        handleOverFlow(elemSize(key, val));
-        auto ret = std::lower_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-
-        if(ret != _keys.end() && !_cmp(key, *ret)) {
+        if(find(key)) {
             return false;
         }
-        char *it = nullptr;
-        if(ret == _keys.end()) {
-            it = _end;
-        }else {
-            it = const_cast<char *>(ret->data()) - sizeof(Elem);
+        if(_fixed) {
+            handleOverFlow(_fd.stride());
+            _fd.insert(lowerBound(key), key, val);
+            return true;
         }
-        _put(it, key, val);
+        auto rest = fit(key);
+        handleOverFlow(elemSize(rest, Blob::stored(val.size())));
+        _store(lowerBound(key), rest, val);
         return true;
     }
 
     bool find(std::string &key) {
         verify();
-        return std::binary_search(
-            _keys.begin(), _keys.end(), key, _cmp);
+        auto [pos, found] = search(key);
+        return found;
     }
 
     bool get(std::string &key, std::string &val) {
         verify();
-        auto ret = std::lower_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-        if(ret == _keys.end() || _cmp(key, *ret)) {
+        auto [pos, found] = search(key);
+        if(!found) {
             return false;
         }
-        val = key2val(*ret);
+        if(!blob(pos)) {
+            val = std::string(raw(pos));
+            return true;
+        }
+        auto view = Blob::read(ref(pos), val);
+        if(view.data() != val.data()) {
+            val = std::string(view);
+        }
         return true;
     }
 
-    // del at pos it
-    void _del(char *it) {
-        auto elem = (Elem *)it;
-        auto size = elemSize(elem);
-        auto next = it + size;
-        std::memmove(it, next, _end - next);
-
-        (*_size)--;
-        (*_bytes) -= size;
-        _end -= size;
-        updateVec();
-    }
-
     bool del(std::string &key) {
         verify();
-        assert(*_size == _keys.size());
-        auto ret = std::lower_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-        if(ret == _keys.end() || _cmp(key, *ret)) {
+        auto [pos, found] = search(key);
+        if(!found) {
             return false;
         }
-        auto it = const_cast<char *>(ret->data()) - sizeof(Elem);
-        _del(it);
+        if(blob(pos)) {
+            Blob::free(ref(pos));
+        }
+        erase(pos);
         return true;
     }
 
     bool update(std::string &key, std::string &val) {
         verify();
-        handleOverFlow(elemSize(key, val));
-        auto ret = std::lower_bound(
-            _keys.begin(), _keys.end(), key, _cmp);
-
-        if(ret == _keys.end() || _cmp(key, *ret)) {
+        auto [pos, found] = search(key);
+        if(!found) {
             return false;
         }
-
-        auto it = const_cast<char *>(ret->data()) - sizeof(Elem);
-        auto elem = (Elem *)it;
-        auto next = it + elemSize(elem);
-        int delta = (int)val.size() - (int)elem->vallen;
-        std::memmove(next + delta, next, _end - next);
-        elem->vallen = val.size();
-        char *data = (char *)(elem + 1) + elem->keylen;
-        std::memcpy(data, val.data(), elem->vallen);
-        
-        (*_bytes) += delta;
-        _end += delta;
-        updateVec();
+        if(_fixed) {
+            _fd.setVal(pos, val);
+            return true;
+        }
+        // a long val goes on the pages of the old one if it fits there.
+        bool was = blob(pos), large = Blob::large(val.size());
+        Blob::Ref ref{0, 0};
+        if(was) {
+            ref = this->ref(pos);
+        }
+        if(was && !(large && Blob::rewrite(ref, val))) {
+            Blob::free(ref);
+            was = false;
+        }
+        if(large && !was) {
+            ref = Blob::write(val);
+        }
+        std::string_view bytes = large ? Blob::bytes(ref) : val;
+        u32 keylen = _dir.elem(pos)->keylen;
+        u32 len = sizeof(Elem) + keylen + bytes.size();
+        if(len > _dir.elem(pos)->size()) {
+            handleOverFlow(len);
+        }
+        // the rest of key stays, the record moves only if it grows.
+        std::string rest(_dir.key(pos));
+        auto elem = _dir.replace(pos, len);
+        elem->keylen = keylen;
+        elem->vallen = bytes.size() | (large ? Elem::BLOB : 0);
+        char *data = (char *)(elem + 1);
+        std::memcpy(data, rest.data(), keylen);
+        std::memcpy(data + keylen, bytes.data(), bytes.size());
         return true;
     }
 
     void pop_front() {
-        _del(_data);
+        erase(0);
     }
 
     std::string splitTo(LeafNodeImpl &other) {
-        auto pos = *_size / 2;
-        auto str = _keys[pos];
-        auto it = str.data() - sizeof(Elem);
-        // return string instead of string_view
-        auto ret = std::string(str.data(), str.size());
-        u32 rentbytes = (_end - it);
-        u32 rentsize = (*_size - pos);
-
-        other.handleOverFlow(rentbytes);
-        *other._size += rentsize;
-        *other._bytes += rentbytes;
-        other._end = other._data + rentbytes;
-        std::memcpy(other._data, it, rentbytes);
-        other.updateVec();
-        
-        *_size -= rentsize;
-        *_bytes -= rentbytes;
-        _end -= rentbytes;
-        updateVec();
+        auto pos = splitPos();
+        auto ret = separator(pos);
+        other.setPrefix(other.shared(*this, pos, *_size));
+        for(u32 i = pos; i < *_size; i++) {
+            other.append(*this, i);
+        }
+        if(_fixed) {
+            _fd.truncate(pos);
+        }else {
+            _dir.truncate(pos);
+        }
+        setPrefix(shared(*this, 0, pos));
+        other.takeHigh(*this);
+        setHigh(ret);
         return ret;
     }
 
     std::string borrowFrom(LeafNodeImpl &other) {
-        // convert string_view to string at once. other._keys[1] will 
+        // convert string_view to string at once. other key at 1 will
         // be unavailable after other.pop_front().
-        auto str = other._keys[1];
-        auto ret = std::string(str.data(), str.size());
-        push_back(other.key(0), other.val(0));
+        auto ret = other.separator(1);
+        append(other, 0);
         other.pop_front();
+        setHigh(ret);
         return ret;
     }
 
     void mergeFrom(LeafNodeImpl &other) {
-        // we should not use other._bytes which include the 
-        // node header bytes
-        u32 bytes = other._end - other._data;
-        handleOverFlow(bytes);
-        *_size += *other._size;
-        *_bytes += bytes;
-        std::memcpy(_end, other._data, bytes);
-        _end += bytes;
-        updateVec();
-    }
-    static u32 elemSize(std::string &key, std::string &val) { 
-        return sizeof(Elem) + key.size() + val.size(); 
+        for(u32 i = 0; i < *other._size; i++) {
+            append(other, i);
+        }
+        takeHigh(other);
+    }
+
+    // if key is in range of node, or has gone right by split.
+    bool covers(std::string &key) {
+        return !hasHigh() || _cmp(key, high());
+    }
+    // if key is surely in range of node. a node with no high key and a
+    // right node is written before high keys, it holds keys up to its max.
+    bool holds(std::string &key) {
+        if(hasHigh() || !_hdr->next) {
+            return covers(key);
+        }
+        return *_size && !_cmp(maxkey(), key);
+    }
+    void setHigh(const std::string &key) {
+        if(_fixed) {
+            handleOverFlow(_fd.hasHigh() ? 0 : key.size());
+            _fd.setHigh(key);
+            return;
+        }
+        u32 len = sizeof(Elem) + key.size();
+        handleOverFlow(len);
+        auto elem = _dir.setHigh(len);
+        elem->keylen = key.size();
+        elem->vallen = 0;
+        std::memcpy((char *)(elem + 1), key.data(), elem->keylen);
+    }
+    // the high key of other, it is the end of range of both.
+    void takeHigh(LeafNodeImpl &other) {
+        if(other.hasHigh()) {
+            setHigh(std::string(other.high()));
+        }else if(_fixed) {
+            _fd.dropHigh();
+        }else {
+            _dir.dropHigh();
+        }
+    }
+    static u32 elemSize(std::string_view key, std::string_view val) {
+        return elemSize(key, val.size());
+    }
+    static u32 elemSize(std::string_view key, u32 vallen) {
+        return sizeof(Elem) + key.size() + vallen + sizeof(u32);
+    }
+    // move the long vals on pages from end on to pages before it, for
+    // compaction. return how many are moved.
+    u32 moveBlobs(pgid_t end) {
+        u32 moved = 0;
+        for(u32 i = 0; i < *_size; i++) {
+            if(!blob(i)) {
+                continue;
+            }
+            auto ref = this->ref(i);
+            if(Blob::move(ref, end)) {
+                std::memcpy((char *)raw(i).data(), &ref, sizeof(ref));
+                moved++;
+            }
+        }
+        return moved;
     }
     u32 size() { return *_size; }
-    bool raw() { return !_data; }
+    bool raw() { return !_hdr; }
     void write(){ _pg->write(); }
     u32 next(){ return _hdr->next;}
     void setNext(u32 next) { _hdr->next = next; }
     void free() { _pg->free(); }
 private:
-    //put key and val at pos it
-    void _put(char *it, std::string &key, std::string &val) {
-        auto size = elemSize(key, val);
-        std::memmove(it + size, it, _end - it);
-        auto elem = (Elem *)it;
-        elem->keylen = key.size();
-        elem->vallen = val.size();
+    // the whole key at pos.
+    std::string_view full(u32 pos) {
+        return _fixed ? _fd.key(pos) : _dir.full(pos);
+    }
+    bool hasHigh() {
+        return _fixed ? _fd.hasHigh() : _dir.hasHigh();
+    }
+    std::string_view high() {
+        return _fixed ? _fd.high() : _dir.high();
+    }
+    void erase(u32 pos) {
+        if(_fixed) {
+            _fd.erase(pos);
+        }else {
+            _dir.erase(pos);
+        }
+    }
+
+    //put the rest of key and val at pos, val is a ref if blob.
+    void _put(u32 pos, std::string_view rest, std::string_view val, 
+              bool blob = false) {
+        auto elem = _dir.insert(pos, sizeof(Elem) + rest.size() + val.size());
+        elem->keylen = rest.size();
+        elem->vallen = val.size() | (blob ? Elem::BLOB : 0);
         char *data = (char *)(elem + 1);
-        std::memcpy(data, key.data(), elem->keylen);
-        std::memcpy(data + elem->keylen, val.data(), elem->vallen);
+        std::memcpy(data, rest.data(), elem->keylen);
+        std::memcpy(data + elem->keylen, val.data(), val.size());
+    }
+    // same as _put, but a long val goes to pages of its own first.
+    void _store(u32 pos, std::string_view rest, std::string_view val) {
+        if(!Blob::large(val.size())) {
+            _put(pos, rest, val);
+            return;
+        }
+        auto ref = Blob::write(val);
+        _put(pos, rest, Blob::bytes(ref), true);
+    }
+    // copy the record at pos of other node to the end, a ref goes as is.
+    void append(LeafNodeImpl &other, u32 pos) {
+        if(_fixed) {
+            handleOverFlow(_fd.stride());
+            _fd.insert(*_size, other._fd.key(pos), other._fd.val(pos));
+            return;
+        }
+        auto rest = fit(other._dir.full(pos));
+        auto val = other.raw(pos);
+        handleOverFlow(elemSize(rest, val));
+        _put(*_size, rest, val, other.blob(pos));
+    }
 
-        // update header
-        (*_size)++;
-        (*_bytes) += size;
-        _end += size;
-        updateVec();
+    // the key that goes up when keys from pos on go right. under the order
+    // of bytes it is the shortest one above the key at pos - 1.
+    std::string separator(u32 pos) {
+        if(!_bytewise) {
+            return key(pos);
+        }
+        return SlotDir<Elem>::between(key(pos - 1), key(pos));
     }
-    u32 elemSize(Elem *elem) {
-        return sizeof(Elem) + elem->keylen + elem->vallen;
+    // split near the middle, where the separator is the shortest. keys
+    // share the prefix, so the rest of them tells.
+    u32 splitPos() {
+        u32 mid = *_size / 2;
+        if(!_bytewise) {
+            return mid;
+        }
+        u32 best = mid, len = UINT32_MAX;
+        for(u32 d = 0; d <= *_size / SPLIT_WINDOW; d++) {
+            for(u32 pos: {mid - d, mid + d}) {
+                if(pos == 0 || pos >= *_size) {
+                    continue;
+                }
+                u32 l = SlotDir<Elem>::common(_dir.key(pos - 1), _dir.key(pos));
+                if(l < len) {
+                    best = pos;
+                    len = l;
+                }
+            }
+        }
+        return best;
     }
-    void updateVec() {
 
-        _keys.resize(*_size);
-        Elem *elem = (Elem *)_data;
-        char *data = _data;
+    // the prefix keys in [from, to) of node share, none if keys are
+    // not sorted by bytes.
+    std::string shared(LeafNodeImpl &node, u32 from, u32 to) {
+        if(!_bytewise || to - from < 2) {
+            return std::string(node._dir.prefix());
+        }
+        std::string first(node._dir.full(from));
+        return first.substr(0, SlotDir<Elem>::common(first, 
+                    node._dir.full(to - 1)));
+    }
+    // the rest of key after the prefix, which is cut short first if key
+    // has not all of it.
+    std::string_view fit(std::string_view key) {
+        std::string_view rest;
+        if(_dir.locate(key, rest)) {
+            auto pre = _dir.prefix();
+            setPrefix(std::string(pre.substr(0, 
+                        SlotDir<Elem>::common(pre, key))));
+            _dir.locate(key, rest);
+        }
+        return rest;
+    }
+    // rewrite all records under prefix pre, which all keys have.
+    void setPrefix(std::string pre) {
+        if(pre == _dir.prefix()) {
+            return;
+        }
+        std::vector<std::tuple<std::string, std::string, bool>> kvs;
         for(u32 i = 0; i < *_size; i++) {
-            _keys[i] = std::string_view(data + sizeof(Elem), elem->keylen);
-            data += elemSize(elem);
-            elem = (Elem *)data;
+            kvs.emplace_back(key(i), raw(i), blob(i));
+        }
+        _dir.truncate(0);
+        _dir.dropPrefix();
+        if(!pre.empty()) {
+            handleOverFlow(sizeof(Elem) + pre.size());
+            auto elem = _dir.setPrefix(sizeof(Elem) + pre.size());
+            elem->keylen = pre.size();
+            elem->vallen = 0;
+            std::memcpy((char *)(elem + 1), pre.data(), pre.size());
+        }
+        for(auto &[key, val, blob]: kvs) {
+            auto rest = std::string_view(key).substr(pre.size());
+            handleOverFlow(elemSize(rest, val));
+            _put(*_size, rest, val, blob);
         }
-        _end = data;
     }
 
+    // the pos of first key not less than key, and if it is key.
+    std::tuple<u32, bool> search(std::string &key) {
+        if(_fixed) {
+            u32 pos = _fd.lowerBound(key);
+            return std::make_tuple(pos, pos != *_size && _fd.key(pos) == key);
+        }
+        std::string_view rest;
+        int where = _dir.locate(key, rest);
+        if(where) {
+            return std::make_tuple(where < 0 ? 0 : *_size, false);
+        }
+        return withOrder(_order, _cmp, [&](const auto &cmp) {
+            u32 pos = lowerBound(rest, cmp);
+            return std::make_tuple(pos, 
+                    pos != *_size && !cmp(rest, _dir.key(pos)));
+        });
+    }
+    u32 lowerBound(std::string &key) {
+        if(_fixed) {
+            return _fd.lowerBound(key);
+        }
+        std::string_view rest;
+        int where = _dir.locate(key, rest);
+        if(where) {
+            return where < 0 ? 0 : *_size;
+        }
+        return lowerBound(rest);
+    }
+    u32 lowerBound(std::string_view rest) {
+        return withOrder(_order, _cmp, [&](const auto &cmp) {
+            return lowerBound(rest, cmp);
+        });
+    }
+    template <typename Cmp>
+    u32 lowerBound(std::string_view rest, const Cmp &cmp) {
+        if constexpr(std::is_same_v<Cmp, KeySearch>) {
+            return cmp.lowerBound(_dir.base(), _dir.begin(), 0,
+                    u32(_dir.end() - _dir.begin()), rest);
+        }
+        auto it = std::lower_bound(_dir.begin(), _dir.end(), rest,
+            [this, &cmp](u32 off, std::string_view rest) {
+                return cmp(_dir.offkey(off), rest);
+            });
+        return it - _dir.begin();
+    }
 
     comparator_t _cmp;
-    std::vector<std::string_view> _keys;
-    char *_end{nullptr};
+    KeyOrder _order{KeyOrder::other};
+    bool _bytewise{false};
+    bool _fixed{false};
+    BucketType _type;
+    SlotDir<Elem> _dir;
+    FixedDir _fd;
+    std::string _blob;  // the long val read last
+    std::vector<std::string> _kept; // long vals by pos, see keepBlobs
     u32 *_bytes{nullptr};
-    char *_data{nullptr};
     u32 *_size{nullptr};
+    Header *_nodehdr{nullptr};
     PageHeader *_hdr{nullptr};
     PageHelperPtr _pg;
 };
@@ -320,4 +688,3 @@ using LeafNodeImplPtr = std::shared_ptr<LeafNodeImpl>;
 
 }// namespace bptdb
 #endif
-
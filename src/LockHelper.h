@@ -1,14 +1,173 @@
 #ifndef __LOCK_HELPER_H
 #define __LOCK_HELPER_H
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <mutex>
 #include <new>
 #include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <cassert>
 #include "common.h"
 
 namespace bptdb {
 
+// a shared_mutex with a version for readers taking no latch. a writer bumps
+// the version on lock and on unlock, so it is odd while locked. a reader
+// gets the version, reads without latch, and validates the version after,
+// anything read is garbage if it changed.
+class VersionLatch {
+public:
+    void lock() {
+        _mtx.lock();
+        _version.store(_version.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+        // the writes under latch never go before the version.
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void unlock() {
+        _version.fetch_add(1, std::memory_order_release);
+        _mtx.unlock();
+    }
+    void lock_shared() {
+        _mtx.lock_shared();
+    }
+    void unlock_shared() {
+        _mtx.unlock_shared();
+    }
+    // wait for the writer, false if the node is gone.
+    bool readVersion(u64 &version) {
+        u32 spins = 0;
+        while((version = _version.load(std::memory_order_acquire)) & 1) {
+            if(++spins % 64 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        return !_obsolete.load(std::memory_order_relaxed);
+    }
+    // if no writer came since readVersion.
+    bool validate(u64 version) {
+        // the reads before never go after the check.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _version.load(std::memory_order_relaxed) == version;
+    }
+    // the node is merged away or out of the tree, caller holds the latch
+    // exclusive or no one reaches the node through the tree any more.
+    void markObsolete() {
+        _obsolete.store(true, std::memory_order_relaxed);
+    }
+    bool obsolete() {
+        return _obsolete.load(std::memory_order_relaxed);
+    }
+private:
+    std::shared_mutex _mtx;
+    std::atomic<u64>  _version{0};
+    std::atomic_bool  _obsolete{false};
+};
+
+// held shared by ops on a tree, exclusive by compaction while it moves
+// nodes. a shared holder counts only in the stripe of its thread, ops of
+// threads on other stripes never write the same cache line. a thread
+// holding it may take it shared again.
+class TreeGate {
+public:
+    void lock_shared() {
+        auto &s = stripe();
+        s.count.fetch_add(1);
+        // nested, the outer one keeps it open.
+        if(depth()++) {
+            return;
+        }
+        while(_closed.load()) {
+            s.count.fetch_sub(1);
+            while(_closed.load()) {
+                std::this_thread::yield();
+            }
+            s.count.fetch_add(1);
+        }
+    }
+    void unlock_shared() {
+        depth()--;
+        stripe().count.fetch_sub(1, std::memory_order_release);
+    }
+    // new holders wait, the ones in go on to the end.
+    void lock() {
+        _mtx.lock();
+        _closed.store(true);
+        for(auto &s: _stripes) {
+            while(s.count.load()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    void unlock() {
+        _closed.store(false);
+        _mtx.unlock();
+    }
+private:
+    struct alignas(64) Stripe {
+        std::atomic<u32> count{0};
+    };
+    static constexpr u32 STRIPES = 16;
+
+    Stripe &stripe() {
+        thread_local u32 t_stripe = 
+            std::hash<std::thread::id>()(std::this_thread::get_id()) % STRIPES;
+        return _stripes[t_stripe];
+    }
+    // times the calling thread holds this gate.
+    u32 &depth() {
+        thread_local std::vector<std::pair<TreeGate *, u32>> t_held;
+        for(auto &[gate, n]: t_held) {
+            if(gate == this) {
+                return n;
+            }
+        }
+        for(auto &e: t_held) {
+            if(!e.second) {
+                e.first = this;
+                return e.second;
+            }
+        }
+        return t_held.emplace_back(this, 0).second;
+    }
+
+    Stripe _stripes[STRIPES];
+    std::atomic_bool _closed{false};
+    std::mutex _mtx;
+};
+
+// the parent of a leaf during a lookup, released once the leaf is latched.
+// pessimistic: the parent is latched shared. optimistic: the parent is not
+// latched, the version read on the way down must be unchanged.
+class Coupling {
+public:
+    Coupling() = default;
+    Coupling(VersionLatch &latch): _latch(&latch) {}
+    Coupling(VersionLatch &latch, u64 version): 
+        _latch(&latch), _version(version), _optimistic(true) {}
+    // call with the leaf latched. false if the leaf may no longer hold the
+    // key, the caller unlatches it and starts over.
+    // a default one has no parent, as in blink mode.
+    bool release(VersionLatch &leaf) {
+        if(!_latch) {
+            return true;
+        }
+        if(!_optimistic) {
+            _latch->unlock_shared();
+            return true;
+        }
+        return _latch->validate(_version) && !leaf.obsolete();
+    }
+private:
+    VersionLatch *_latch{nullptr};
+    u64  _version{0};
+    bool _optimistic{false};
+};
+
 template <typename T>
 class UnLockGuardArray {
 public:
@@ -20,7 +179,7 @@ public:
         clear();
         if(_arr) std::free(_arr);
     }
-    void emplace_back(std::shared_mutex &mtx) {
+    void emplace_back(VersionLatch &mtx) {
         assert(_size < _cap);
         new(_arr + _size++)T(mtx);
     }
@@ -45,18 +204,18 @@ private:
 
 class UnReadLockGuard {
 public:
-    UnReadLockGuard(std::shared_mutex &mtx): _mtx(mtx){}
+    UnReadLockGuard(VersionLatch &mtx): _mtx(mtx){}
     ~UnReadLockGuard() { _mtx.unlock_shared(); }
 private:
-    std::shared_mutex &_mtx;
+    VersionLatch &_mtx;
 };
 
 class UnWriteLockGuard {
 public:
-    UnWriteLockGuard(std::shared_mutex &mtx): _mtx(mtx) {}
+    UnWriteLockGuard(VersionLatch &mtx): _mtx(mtx) {}
     ~UnWriteLockGuard() { _mtx.unlock(); }
 private:
-    std::shared_mutex &_mtx;
+    VersionLatch &_mtx;
 };
 
 }// namespace bptdb
@@ -1,6 +1,9 @@
 #ifndef __NODE_H
 #define __NODE_H
 
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
 #include <vector>
 #include <type_traits>
 #include <cstring>
@@ -12,6 +15,9 @@
 #include <iostream>
 
 #include "common.h"
+#include "Epoch.h"
+#include "LockHelper.h"
+#include "Option.h"
 #include "Status.h"
 #include "FileManager.h"
 #include "PageAllocator.h"
@@ -19,34 +25,259 @@
 
 namespace bptdb {
 
+// node objects of a tree by page id. a lookup takes no lock, each shard
+// is a table of open addressing read through atomics, changed under the
+// lock of shard and copied to a new one as it fills up. about max_nodes
+// objects are kept, the ones not used since the clock hand came by last
+// are taken out. objects and tables taken out are freed once no thread in
+// an EpochGuard may hold them. an object taken out but not freed comes
+// back when its page is asked for, a page never has two latches at once.
 template <typename NodeType>
 class NodeMap {
 public:
-    NodeMap(u32 order, comparator_t cmp) {
+    NodeMap(u32 order, const comparator_t &cmp, 
+            BucketType type = BucketType()) {
         _order = order;
         _cmp = cmp;
+        _type = type;
+        _cap = std::max(g_option.max_nodes / SHARDS, 16u);
     }
+    ~NodeMap() {
+        for(auto &sh: _shards) {
+            if(auto t = sh.table.load()) {
+                for(u32 i = 0; i <= t->mask; i++) {
+                    delete t->slots[i].node.load();
+                }
+                delete t;
+            }
+            collect(sh, UINT64_MAX);
+        }
+    }
+    // the caller is in an EpochGuard, the node is valid till it leaves.
     NodeType *get(pgid_t id) {
-        std::lock_guard<std::mutex> lg(_mtx);
-        auto ret = _map.find(id);
-        if(ret != _map.end()) {
-            return ret->second.get();
+        auto &sh = shard(id);
+        if(auto node = find(sh.table.load(std::memory_order_acquire), id)) {
+            node->touch();
+            return node;
         }
-        auto node = std::make_unique<NodeType>(id, _order, this, _cmp);
-        auto raw = node.get();
-        _map.insert({id, std::move(node)});
-        return raw;
+        return load(sh, id);
+    }
+    const BucketType &type() {
+        return _type;
     }
     void del(pgid_t id) {
-        std::lock_guard<std::mutex> lg(_mtx);
-        _map.erase(id);
+        auto &sh = shard(id);
+        std::lock_guard lg(sh.mtx);
+        auto node = take(sh, id);
+        if(!node) {
+            auto it = sh.limbo.find(id);
+            if(it == sh.limbo.end()) {
+                return;
+            }
+            node = it->second.first;
+            sh.limbo.erase(it);
+        }
+        // a lookup without latch may still be on it.
+        node->retire();
+        sh.dead.emplace_back(node, g_epoch.retire());
+        if(sh.dead.size() >= SWEEP) {
+            collect(sh, g_epoch.safe());
+        }
     }
 private:
+    struct Slot {
+        std::atomic<pgid_t> id{0};  // 0 if empty, never changes once set
+        std::atomic<NodeType *> node{nullptr}; // null if taken out
+    };
+    struct Table {
+        Table(u32 size): mask(size - 1), slots(new Slot[size]) {}
+        u32 mask;
+        u32 used{0}; // slots with id set
+        std::unique_ptr<Slot[]> slots;
+    };
+    struct Shard {
+        std::atomic<Table *> table{nullptr};
+        std::mutex mtx;
+        u32 live{0};
+        u32 hand{0}; // slot the clock goes on from
+        // taken out, with the tag of epoch then.
+        std::unordered_map<pgid_t, std::pair<NodeType *, u64>> limbo;
+        std::vector<std::pair<NodeType *, u64>> dead; // pages freed
+        std::vector<std::pair<Table *, u64>> tables;
+    };
+    Shard &shard(pgid_t id) {
+        return _shards[id % SHARDS];
+    }
+    static u32 hash(pgid_t id) {
+        return (id / SHARDS) * 2654435761u;
+    }
+    static NodeType *find(Table *t, pgid_t id) {
+        if(!t) {
+            return nullptr;
+        }
+        for(u32 i = hash(id) & t->mask;; i = (i + 1) & t->mask) {
+            auto at = t->slots[i].id.load(std::memory_order_acquire);
+            if(at == id) {
+                return t->slots[i].node.load(std::memory_order_acquire);
+            }
+            if(!at) {
+                return nullptr;
+            }
+        }
+    }
+
+    NodeType *load(Shard &sh, pgid_t id) {
+        std::lock_guard lg(sh.mtx);
+        if(auto node = find(sh.table.load(), id)) {
+            return node;
+        }
+        NodeType *node;
+        auto it = sh.limbo.find(id);
+        if(it != sh.limbo.end()) {
+            node = it->second.first;
+            sh.limbo.erase(it);
+        }else {
+            node = new NodeType(id, _order, this, _cmp);
+        }
+        put(sh, id, node);
+        if(sh.live > _cap) {
+            evict(sh);
+        }
+        return node;
+    }
+    // caller holds the lock of shard.
+    void put(Shard &sh, pgid_t id, NodeType *node) {
+        auto t = sh.table.load();
+        // keep a quarter empty, so a probe ends soon.
+        if(!t || (t->used + 1) * 4 > (t->mask + 1) * 3) {
+            t = grow(sh);
+        }
+        for(u32 i = hash(id) & t->mask;; i = (i + 1) & t->mask) {
+            auto &slot = t->slots[i];
+            auto at = slot.id.load();
+            if(at && at != id) {
+                continue;
+            }
+            slot.node.store(node, std::memory_order_release);
+            if(!at) {
+                slot.id.store(id, std::memory_order_release);
+                t->used++;
+            }
+            break;
+        }
+        sh.live++;
+    }
+    NodeType *take(Shard &sh, pgid_t id) {
+        auto t = sh.table.load();
+        if(!t) {
+            return nullptr;
+        }
+        for(u32 i = hash(id) & t->mask;; i = (i + 1) & t->mask) {
+            auto &slot = t->slots[i];
+            auto at = slot.id.load();
+            if(!at) {
+                return nullptr;
+            }
+            if(at != id) {
+                continue;
+            }
+            auto node = slot.node.load();
+            if(node) {
+                slot.node.store(nullptr, std::memory_order_release);
+                sh.live--;
+            }
+            return node;
+        }
+    }
+    // a table twice the live nodes, slots taken out are left behind.
+    Table *grow(Shard &sh) {
+        u32 size = 16;
+        while(size < (sh.live + 1) * 2) {
+            size *= 2;
+        }
+        auto old = sh.table.load();
+        auto t = new Table(size);
+        if(old) {
+            for(u32 i = 0; i <= old->mask; i++) {
+                auto node = old->slots[i].node.load();
+                if(!node) {
+                    continue;
+                }
+                pgid_t id = old->slots[i].id.load();
+                for(u32 j = hash(id) & t->mask;; j = (j + 1) & t->mask) {
+                    if(!t->slots[j].id.load()) {
+                        t->slots[j].node.store(node);
+                        t->slots[j].id.store(id);
+                        t->used++;
+                        break;
+                    }
+                }
+            }
+            sh.tables.emplace_back(old, 0);
+        }
+        sh.table.store(t, std::memory_order_release);
+        if(old) {
+            sh.tables.back().second = g_epoch.retire();
+        }
+        sh.hand = 0;
+        return t;
+    }
+    // take out nodes not used lately until an eighth below cap, and free
+    // what no one holds.
+    void evict(Shard &sh) {
+        auto t = sh.table.load();
+        u32 target = _cap - _cap / 8;
+        for(u32 n = 0; sh.live > target && n < 2 * (t->mask + 1); n++) {
+            auto &slot = t->slots[sh.hand];
+            sh.hand = (sh.hand + 1) & t->mask;
+            auto node = slot.node.load();
+            if(!node || !node->aged()) {
+                continue;
+            }
+            slot.node.store(nullptr, std::memory_order_release);
+            sh.live--;
+            sh.limbo.emplace(slot.id.load(), std::make_pair(node, 0));
+        }
+        u64 tag = g_epoch.retire();
+        for(auto &[id, e]: sh.limbo) {
+            if(!e.second) {
+                e.second = tag;
+            }
+        }
+        collect(sh, g_epoch.safe());
+    }
+    // free what was taken out with a tag below safe.
+    static void collect(Shard &sh, u64 safe) {
+        for(auto it = sh.limbo.begin(); it != sh.limbo.end();) {
+            if(it->second.second >= safe) {
+                ++it;
+                continue;
+            }
+            delete it->second.first;
+            it = sh.limbo.erase(it);
+        }
+        auto free = [safe](auto &vec) {
+            auto it = std::remove_if(vec.begin(), vec.end(), [safe](auto &e) {
+                if(e.second >= safe) {
+                    return false;
+                }
+                delete e.first;
+                return true;
+            });
+            vec.erase(it, vec.end());
+        };
+        free(sh.dead);
+        free(sh.tables);
+    }
+
+    static constexpr u32 SHARDS = 64;
+    static constexpr u32 SWEEP = 64;  // dead ones kept before a sweep
+
     u32 _order{0};
-    comparator_t _cmp;
-    std::mutex _mtx;
-    std::unordered_map<pgid_t, 
-        std::unique_ptr<NodeType>>  _map;
+    u32 _cap{0}; // nodes a shard keeps
+    comparator_t _cmp; // shared by all nodes
+    BucketType _type;  // of leaves
+    Shard _shards[SHARDS];
 };
 
 struct PutEntry {
@@ -69,9 +300,24 @@ public:
         _id      = id;
         _maxsize = maxsize;
     }
-    std::shared_mutex &getMutex() {
+    VersionLatch &getMutex() {
         return _shmtx;
     }
+    // removed from map, but may still be read. it is out of the tree
+    // already, a lookup without latch that comes to it goes down again.
+    void retire() {
+        _shmtx.markObsolete();
+    }
+    // used since the clock hand came by last.
+    void touch() {
+        if(!_used.load(std::memory_order_relaxed)) {
+            _used.store(true, std::memory_order_relaxed);
+        }
+    }
+    // if not used since, the hand goes by now.
+    bool aged() {
+        return !_used.exchange(false, std::memory_order_relaxed);
+    }
 protected:
     bool safetoput(u32 size) {
         return size < _maxsize;
@@ -91,7 +337,8 @@ protected:
 
     pgid_t _id{0};
     u32    _maxsize{0};
-    std::shared_mutex _shmtx;
+    VersionLatch _shmtx;
+    std::atomic_bool _used{true};
 };
 
 }// namespace bptdb
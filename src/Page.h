@@ -12,18 +12,23 @@
 #include "common.h"
 #include "List.h"
 #include "Option.h"
+#include "SnapshotManager.h"
+#include "Wal.h"
 
 namespace bptdb {
  
 class Page {
 public:
+    // the content is loaded by PageCache.
     Page(pgid_t id): _id(id){
-        _data = std::malloc(g_option.page_size);
-        g_fm->read((char*)_data, g_option.page_size, _id * g_option.page_size);
+        // aligned for O_DIRECT if the size allows.
+        _data = g_option.page_size % DIRECT_ALIGN ? 
+            std::malloc(g_option.page_size) :
+            std::aligned_alloc(DIRECT_ALIGN, g_option.page_size);
     }
     ~Page() { 
         if (_dirty) {
-            g_fm->write((char*)_data, g_option.page_size, _id * g_option.page_size);
+            g_fm->write((char*)_data, g_option.page_size, page2off(_id));
         }
         std::free(_data); 
     }
@@ -33,30 +38,102 @@ public:
     }
     void write(void *src) {
         std::unique_lock lg(_shmtx);
+        keep();
         std::memcpy(_data, src, g_option.page_size);
-        _dirty = true;
+        markDirty();
     }
-    void flush() {
-        std::shared_lock lg(_shmtx);
-        if (!_dirty) {
-            return;
-        }
-        g_fm->write((char*)_data, g_option.page_size, _id * g_option.page_size);
+    // lsn the log must reach before the page goes to disk, false if the
+    // txn wrote it is not in log yet. caller must hold the latch.
+    bool walLsn(u64 &lsn) {
+        lsn = _writer ? _writer->lsn.load() : 0;
+        return !_writer || lsn != 0;
+    }
+    void setClean() {
         _dirty.store(false);
     }
+    // if the page can be written back without waiting for any txn.
+    bool flushable() {
+        std::shared_lock lg(_shmtx, std::try_to_lock);
+        if (!lg.owns_lock()) {
+            return false;
+        }
+        return !_writer || _writer->lsn.load() != 0;
+    }
     pgid_t getId() {
         return _id;
     }
     bool dirty() {
         return _dirty.load();
     }
-    tag_declare(lru_tag, Page, _lru_tag);
+    // direct access to the frame, caller must hold the latch.
+    void *data() {
+        return _data;
+    }
+    std::shared_mutex &latch() {
+        return _shmtx;
+    }
+    // keep the content for snapshots before it is changed, caller must
+    // hold the latch exclusive.
+    void keep() {
+        if (g_snap) {
+            g_snap->keep(_id, _data, _kept);
+        }
+    }
+    // caller must hold the latch exclusive.
+    void markDirty() {
+        _dirty.store(true);
+        if (g_wal) {
+            g_wal->logPage(this);
+        }
+    }
+    WalMarkPtr writer() {
+        return _writer;
+    }
+    void setWriter(WalMarkPtr mark) {
+        _writer = std::move(mark);
+    }
+    void pin() {
+        _pins++;
+    }
+    void unpin() {
+        _pins--;
+    }
+    bool pinned() {
+        return _pins.load() > 0;
+    }
+    // taken by the cleaner, out of replacer.
+    bool evicting() {
+        return _evicting;
+    }
+    void setEvicting(bool evicting) {
+        _evicting = evicting;
+    }
+    // state of replacer.
+    bool ref() {
+        return _ref.load(std::memory_order_relaxed);
+    }
+    void setRef(bool ref) {
+        _ref.store(ref, std::memory_order_relaxed);
+    }
+    u8 queue() {
+        return _queue;
+    }
+    void setQueue(u8 queue) {
+        _queue = queue;
+    }
+    tag_declare(repl_tag, Page, _repl_tag);
 private:
     pgid_t _id{0};
     void   *_data{nullptr};
-    ListTag _lru_tag;
+    ListTag _repl_tag;
+    std::atomic_bool  _ref{false};
+    u8                _queue{0};
+    bool              _evicting{false}; // under the lock of shard
     std::shared_mutex _shmtx;
     std::atomic_bool  _dirty{false};
+    std::atomic<u32>  _pins{0};
+    WalMarkPtr        _writer; // the last txn wrote the page
+    u64               _kept{0}; // tag of the image kept last
 };
 
 using PagePtr = std::shared_ptr<Page>;
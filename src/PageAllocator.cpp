@@ -1,10 +1,14 @@
+#include <cassert>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <thread>
 #include "PageAllocator.h"
 #include "DB.h"
+#include "FileManager.h"
 #include "PageCache.h"
 #include "PageHeader.h"
+#include "Wal.h"
 #include "common.h"
 
 namespace bptdb {
@@ -22,105 +26,407 @@ PageAllocator::PageAllocator(pgid_t root) {
     _root = root;
     _pg = std::make_unique<PageHelper>(_root);
     _pg->read();
+    auto s = slots();
+    for(u32 i = 0; i < count(); i++) {
+        _by_pos.emplace(s[i].pos, i);
+        _by_len.emplace(s[i].len, s[i].pos);
+        _free += s[i].len;
+    }
+}
+
+PageAllocator::Elem *PageAllocator::slots() {
+    return (Elem *)((PageHeader *)_pg->data() + 1);
+}
+
+u32 &PageAllocator::count() {
+    return ((PageHeader *)_pg->data())->size;
+}
+
+PageAllocator::Cache &PageAllocator::cache() {
+    auto h = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return _caches[h % CACHES];
 }
 
+// changes of the freelist are logged as top actions. a crash before the
+// txn which allocates reaches the log leaks the pages, never loses them.
+// so do pages in caches. a top action out of txn may wait for checkpoint,
+// so it is begun before any lock here, and committed after.
 pgid_t PageAllocator::allocPage(u32 len) {
+    if(len == 1) {
+        auto &c = cache();
+        {
+            std::lock_guard lg(c.mtx);
+            if(!c.pages.empty()) {
+                auto ret = c.pages.back();
+                c.pages.pop_back();
+                return ret;
+            }
+        }
+        std::vector<pgid_t> pages;
+        {
+            WalTopAction top;
+            std::lock_guard lg(_mtx);
+            for(u32 i = 0; i < CACHE_PAGES / 2; i++) {
+                pages.push_back(take(1));
+            }
+            flush();
+        }
+        // the lowest first.
+        std::lock_guard lg(c.mtx);
+        c.pages.insert(c.pages.end(), pages.rbegin(), pages.rend() - 1);
+        return pages.front();
+    }
+    WalTopAction top;
+    std::lock_guard lg(_mtx);
+    auto ret = take(len);
+    flush();
+    return ret;
+}
+
+pgid_t PageAllocator::allocTail(u32 len) {
 
+    WalTopAction top;
     std::lock_guard lg(_mtx);
 
     auto hdr = (PageHeader *)_pg->data();
-    auto begin = (Elem *)(hdr + 1);
-    auto end = begin + hdr->size;
-    auto it = std::find_if(begin, end, 
-            [len](Elem &x){ return x.len >= len; });
-    if(it == end) {
-        auto ret = hdr->next;
-        hdr->next += len;
-        _pg->write();
-        return ret;
-    }
-    auto ret = it->pos;
-    if(it->len == len) {
-        std::memmove(it, it + 1, (end - it - 1) * sizeof(Elem));
-        hdr->size -= 1;
-        hdr->bytes -= sizeof(Elem);
-    }else {
-        it->len -= len;
-        it->pos += len;
+    // pages cut off may still have frames in cache, never give them to a
+    // writer which goes by it.
+    if(hdr->next < _floor) {
+        auto from = hdr->next;
+        hdr->next = _floor;
+        give(from, _floor - from);
     }
-    _pg->write();
+    auto ret = grow(len);
+    flush();
     return ret;
 }
 
 void PageAllocator::freePage(pgid_t pos, u32 len) {
 
+    // the pages are still referred by disk until the txn is in log.
+    if(g_wal && g_wal->inTxn()) {
+        g_wal->afterCommit([pos, len] { g_pa->freePage(pos, len); });
+        return;
+    }
+    assert(len);
+    std::vector<pgid_t> back;
+    if(len == 1) {
+        auto &c = cache();
+        std::lock_guard lg(c.mtx);
+        if(c.pages.size() < CACHE_PAGES) {
+            c.pages.push_back(pos);
+            return;
+        }
+        // full, half of it goes back with pos.
+        while(c.pages.size() > CACHE_PAGES / 2) {
+            back.push_back(c.pages.back());
+            c.pages.pop_back();
+        }
+    }
+    WalTopAction top;
     std::lock_guard lg(_mtx);
+    give(pos, len);
+    for(auto id: back) {
+        give(id, 1);
+    }
+    flush();
+}
 
+pgid_t PageAllocator::reallocPage(pgid_t pos, u32 len, u32 newlen) {
     assert(len);
-    Elem cur{pos, len};
+    assert(newlen > len);
+    freePage(pos, len);
+    return allocPage(newlen);
+}
+
+void PageAllocator::drain() {
+    for(auto &c: _caches) {
+        std::vector<pgid_t> pages;
+        {
+            std::lock_guard lg(c.mtx);
+            pages.swap(c.pages);
+        }
+        if(pages.empty()) {
+            continue;
+        }
+        WalTopAction top;
+        std::lock_guard lg(_mtx);
+        for(auto id: pages) {
+            give(id, 1);
+        }
+        flush();
+    }
+}
+
+pgid_t PageAllocator::used() {
+    std::lock_guard lg(_mtx);
+    return ((PageHeader *)_pg->data())->next - _free;
+}
+
+pgid_t PageAllocator::tail() {
+    std::lock_guard lg(_mtx);
+    auto next = ((PageHeader *)_pg->data())->next;
+    if(_by_pos.empty()) {
+        return next;
+    }
+    auto [pos, slot] = *_by_pos.rbegin();
+    return pos + slots()[slot].len == next ? pos : next;
+}
+
+pgid_t PageAllocator::allocBelow(u32 len, pgid_t limit) {
+    WalTopAction top;
+    std::lock_guard lg(_mtx);
+    auto ret = takeBelow(len, limit);
+    if(ret) {
+        flush();
+    }
+    return ret;
+}
+
+bool PageAllocator::allocAt(pgid_t pos, u32 len) {
+    WalTopAction top;
+    std::lock_guard lg(_mtx);
+    auto it = _by_pos.upper_bound(pos);
+    if(it == _by_pos.begin()) {
+        return false;
+    }
+    auto [from, slot] = *std::prev(it);
+    u32 l = slots()[slot].len;
+    if(pos + len > from + l) {
+        return false;
+    }
+    if(from == pos) {
+        if(l == len) {
+            dropSlot(slot);
+        }else {
+            setSlot(slot, pos + len, l - len);
+        }
+    }else {
+        setSlot(slot, from, pos - from);
+        if(from + l > pos + len) {
+            addSlot(pos + len, from + l - pos - len);
+        }
+    }
+    flush();
+    return true;
+}
+
+// the extra pages of self go before the pages in use first, if they can.
+// then the free extent at the end is cut. records which freed pages in it
+// must be durable before, or a crash may bring back a tree using them.
+//
+// the sync and the cut are done out of _mtx. the extent is taken out of
+// the freelist first, so no one gets it meanwhile. the end of file may
+// move on, by one who needs pages there, the cut is called off then and
+// the extent is given back.
+pgid_t PageAllocator::shrink() {
+    pgid_t pos = 0, end = 0;
+    {
+        WalTopAction top;
+        std::lock_guard lg(_mtx);
+        auto hdr = (PageHeader *)_pg->data();
+        u32 reslen = hdr->realpages - hdr->hdrpages;
+        if(hdr->res && hdr->res + reslen > hdr->next - _free) {
+            if(auto to = takeBelow(reslen, hdr->res)) {
+                auto from = hdr->res;
+                hdr->res = to;
+                for(u32 i = 0; i < _pg->_data_pgs; i++) {
+                    _dirty.insert(i);
+                }
+                give(from, reslen);
+            }
+        }
+        end = hdr->next;
+        if(!_by_pos.empty() && !_cut_pending) {
+            auto [at, slot] = *_by_pos.rbegin();
+            if(at + slots()[slot].len == end) {
+                dropSlot(slot);
+                pos = at;
+                _cut_pending = true;
+                std::lock_guard cut(_cut);
+                _cutting = true;
+            }
+        }
+        flush();
+    }
+    if(!pos) {
+        return end;
+    }
+    // no cut if the log failed, the extent is given back.
+    bool durable = !g_wal || g_wal->syncAll();
+    g_pc->discard(pos, end);
+    bool cut = false;
+    {
+        std::lock_guard lg(_cut);
+        if(_cutting && durable) {
+            g_fm->truncate(page2off(pos));
+            cut = true;
+        }
+        _cutting = false;
+    }
+    WalTopAction top;
+    std::lock_guard lg(_mtx);
     auto hdr = (PageHeader *)_pg->data();
-    auto begin = (Elem *)(hdr + 1);
-    auto end = begin + hdr->size;
-    
-    auto it = std::lower_bound(
-        begin, end, cur, 
-        [](const Elem &e1, const Elem &e2){
-            return e1.pos < e2.pos; 
-        });
-    if(it != end) {
-        assert(it->pos != pos);
-    }
-    auto next = it;
-    auto prev = it - 1;
-    if(next == end)   next = nullptr;
-    if(prev <  begin) prev = nullptr;
-
-    if(prev && adjacent(prev, &cur) &&
-            next && adjacent(&cur, next)){
-            
-        // merge
-        prev->len += cur.len + next->len;
-        std::memmove(next, next + 1, (end - next - 1) * sizeof(Elem));
-        hdr->size--;
-        hdr->bytes -= sizeof(Elem);
-    }
-    else if(prev && adjacent(prev, &cur)) {
-        prev->len += cur.len;
-    }
-    else if(next && adjacent(&cur, next)) {
-        next->len += cur.len;
-        next->pos -= cur.len;
-    }
-    else {
-        std::memmove(it + 1, it, (end - it) * sizeof(Elem));
-        *it = cur;
-        hdr->size++;
-        hdr->bytes += sizeof(Elem);
-    }
-
-    // last
+    _cut_pending = false;
+    if(cut && hdr->next == end) {
+        hdr->next = pos;
+        _floor = std::max(_floor, end);
+    }else {
+        give(pos, end - pos);
+    }
+    flush();
+    return hdr->next;
+}
+
+// the best fit, the lowest of them. the end of file if none.
+pgid_t PageAllocator::take(u32 len) {
+    auto it = _by_len.lower_bound({len, 0});
+    if(it == _by_len.end()) {
+        return grow(len);
+    }
+    auto [l, pos] = *it;
+    u32 slot = _by_pos[pos];
+    if(l == len) {
+        dropSlot(slot);
+    }else {
+        setSlot(slot, pos + len, l - len);
+    }
+    return pos;
+}
+
+// the end of file moves on, a cut going on is called off.
+pgid_t PageAllocator::grow(u32 len) {
+    if(_cut_pending) {
+        std::lock_guard lg(_cut);
+        _cutting = false;
+        _cut_pending = false;
+    }
+    auto hdr = (PageHeader *)_pg->data();
+    auto ret = hdr->next;
+    hdr->next += len;
+    return ret;
+}
+
+// the lowest extent before limit which has len pages.
+pgid_t PageAllocator::takeBelow(u32 len, pgid_t limit) {
+    auto s = slots();
+    for(auto [pos, slot]: _by_pos) {
+        if(pos >= limit) {
+            break;
+        }
+        u32 l = s[slot].len;
+        if(l < len) {
+            continue;
+        }
+        if(l == len) {
+            dropSlot(slot);
+        }else {
+            setSlot(slot, pos + len, l - len);
+        }
+        return pos;
+    }
+    return 0;
+}
+
+// merge with the extents right before and after.
+void PageAllocator::give(pgid_t pos, u32 len) {
+    auto s = slots();
+    auto next = _by_pos.find(pos + len);
+    auto it = _by_pos.lower_bound(pos);
+    assert(it == _by_pos.end() || it->first != pos);
+    auto prev = _by_pos.end();
+    if(it != _by_pos.begin()) {
+        auto p = std::prev(it);
+        if(p->first + s[p->second].len == pos) {
+            prev = p;
+        }
+    }
+    if(prev != _by_pos.end() && next != _by_pos.end()) {
+        pgid_t from = prev->first;
+        u32 total = s[prev->second].len + len + s[next->second].len;
+        // the slot of prev may move to where next was.
+        dropSlot(next->second);
+        setSlot(_by_pos[from], from, total);
+    }else if(prev != _by_pos.end()) {
+        setSlot(prev->second, prev->first, s[prev->second].len + len);
+    }else if(next != _by_pos.end()) {
+        setSlot(next->second, pos, len + s[next->second].len);
+    }else {
+        addSlot(pos, len);
+    }
+}
+
+void PageAllocator::addSlot(pgid_t pos, u32 len) {
+    bool moved = false;
     if(_pg->overFlow(sizeof(Elem))) {
-        DEBUGOUT("overflow");
-        hdr = (PageHeader *)extendPage(sizeof(Elem));
-        hdr->bytes += sizeof(Elem);
-        // 第一次extend不会realloc
-        if(_tmp.len) {
-            // TODO free page safe, page leak here.
-            // freePage(_tmp.pos, _tmp.len);
+        // the res pages move to the end of file, all is written there.
+        _tmp.len = 0;
+        extendPage(sizeof(Elem));
+        for(u32 i = 0; i < _pg->_data_pgs; i++) {
+            _dirty.insert(i);
         }
+        moved = _tmp.len > 0;
+    }
+    auto hdr = (PageHeader *)_pg->data();
+    u32 slot = hdr->size++;
+    hdr->bytes += sizeof(Elem);
+    slots()[slot] = {pos, len};
+    _by_pos.emplace(pos, slot);
+    _by_len.emplace(len, pos);
+    _free += len;
+    touch(slot);
+    if(moved) {
+        give(_tmp.pos, _tmp.len);
     }
-    _pg->write();
 }
 
-pgid_t PageAllocator::reallocPage(pgid_t pos, u32 len, u32 newlen) {
+// the last slot takes its place.
+void PageAllocator::dropSlot(u32 slot) {
+    auto hdr = (PageHeader *)_pg->data();
+    auto s = slots();
+    _by_pos.erase(s[slot].pos);
+    _by_len.erase({s[slot].len, s[slot].pos});
+    _free -= s[slot].len;
+    u32 last = --hdr->size;
+    hdr->bytes -= sizeof(Elem);
+    if(slot != last) {
+        s[slot] = s[last];
+        _by_pos[s[slot].pos] = slot;
+        touch(slot);
+    }
+}
 
-    std::lock_guard lg(_mtx);
+void PageAllocator::setSlot(u32 slot, pgid_t pos, u32 len) {
+    auto &e = slots()[slot];
+    _by_pos.erase(e.pos);
+    _by_len.erase({e.len, e.pos});
+    _free += len;
+    _free -= e.len;
+    e = {pos, len};
+    _by_pos.emplace(pos, slot);
+    _by_len.emplace(len, pos);
+    touch(slot);
+}
 
-    assert(len);
-    assert(newlen > len);
+// a slot may lie over two pages.
+void PageAllocator::touch(u32 slot) {
+    u32 off = sizeof(PageHeader) + slot * sizeof(Elem);
+    _dirty.insert(off / g_option.page_size);
+    _dirty.insert((off + sizeof(Elem) - 1) / g_option.page_size);
+}
 
-    freePage(pos, len);
-    return allocPage(newlen);
+void PageAllocator::flush() {
+    auto hdr = (PageHeader *)_pg->data();
+    _dirty.insert(0);
+    for(auto i: _dirty) {
+        if(i >= _pg->_data_pgs) {
+            continue;
+        }
+        pgid_t at = i < hdr->hdrpages ? _root + i : 
+            hdr->res + i - hdr->hdrpages;
+        _pg->_writePage(_pg->_data + page2off(i), 1, at);
+    }
+    _dirty.clear();
 }
 
 // do this by self other call pg->extend;
@@ -137,14 +443,12 @@ void *PageAllocator::extendPage(u32 extbytes) {
         hdr->realpages += extpages;
 
         if(hdr->res == 0) {
-            hdr->res = hdr->next;
-            hdr->next += extpages;
+            hdr->res = grow(extpages);
         }else {
             assert(reslen > 0);
             _tmp.pos = hdr->res;
             _tmp.len = reslen;
-            hdr->res = hdr->next;
-            hdr->next += (reslen + extpages);
+            hdr->res = grow(reslen + extpages);
         }
     }
     // we have not enought space on memory, realloc on memory.
@@ -154,16 +458,15 @@ void *PageAllocator::extendPage(u32 extbytes) {
 }
 
 void PageAllocator::show() {
-    auto hdr = (PageHeader *)_pg->data();
-    auto begin = (Elem *)(hdr + 1);
-    auto end = begin + hdr->size;
+    std::lock_guard lg(_mtx);
+    auto s = slots();
     std::cout << "pos  ";
-    for(auto it = begin; it != end; it++) {
-        std::cout << it->pos << " ";
+    for(auto &[pos, slot]: _by_pos) {
+        std::cout << pos << " ";
     }
     std::cout << "\nsize ";
-    for(auto it = begin; it != end; it++) {
-        std::cout << it->len << " ";
+    for(auto &[pos, slot]: _by_pos) {
+        std::cout << s[slot].len << " ";
     }
     std::cout << "\n";
 }
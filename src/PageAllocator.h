@@ -2,37 +2,89 @@
 #define __PAGE_ALLOCATOR_H
 
 #include <algorithm>
+#include <map>
 #include <mutex>
 #include <memory>
+#include <set>
+#include <utility>
+#include <vector>
 #include "common.h"
 #include "PageHelper.h"
 
 namespace bptdb {
 
+// free extents are kept on disk as an array in no order, a change rewrites
+// only the pages of the slots it touches. in memory they are indexed by
+// position, to merge neighbours, and by length, to take the best fit. single
+// pages go through small caches, each used by some of the threads.
 class PageAllocator {
 public:
     struct Elem {
         pgid_t pos;
         u32    len;
-    }; 
+    };
     static void newOnDisk(pgid_t root, u32 start_pos);
     PageAllocator(pgid_t root);
     pgid_t allocPage(u32 len);
+    // pages from the end of file, never used before, so no copy of them
+    // is in cache or log.
+    pgid_t allocTail(u32 len);
     // free page at pos of len.
     void freePage(pgid_t pos, u32 len);
     pgid_t reallocPage(pgid_t pos, u32 len, u32 newlen);
+    // give the pages of caches back to the freelist, before close.
+    void drain();
+    // pages in use, the end of file less the free ones. pages in caches
+    // count as used.
+    pgid_t used();
+    // where the free pages at the end of file begin, the end if none.
+    pgid_t tail();
+    // len free pages before limit, the lowest ones. 0 if none.
+    pgid_t allocBelow(u32 len, pgid_t limit);
+    // the len pages at pos, false if not all of them are free.
+    bool allocAt(pgid_t pos, u32 len);
+    // cut the free pages at the end off the file, return the new end.
+    pgid_t shrink();
     void show();
 private:
+    struct Cache {
+        std::mutex mtx;
+        std::vector<pgid_t> pages;
+    };
+    Cache &cache();
+    // caller holds _mtx.
+    pgid_t take(u32 len);
+    pgid_t grow(u32 len);
+    pgid_t takeBelow(u32 len, pgid_t limit);
+    void give(pgid_t pos, u32 len);
+    Elem *slots();
+    u32 &count();
+    void addSlot(pgid_t pos, u32 len);
+    void dropSlot(u32 slot);
+    // change slot to pos and len, indexes go with it.
+    void setSlot(u32 slot, pgid_t pos, u32 len);
+    void touch(u32 slot);
+    // write the pages touched, and the header.
+    void flush();
     // extend page of self.
     void *extendPage(u32 extbytes);
-    // if p1 and p2 could merge
-    bool adjacent(Elem *p1, Elem *p2) {
-        return p1->pos + p1->len == p2->pos;
-    }
+
+    static constexpr u32 CACHES = 16;
+    static constexpr u32 CACHE_PAGES = 32;
+
     pgid_t                _root{0};
     Elem                  _tmp;
-    std::recursive_mutex  _mtx;
+    std::mutex            _mtx;
     std::unique_ptr<PageHelper> _pg{nullptr};
+    std::map<pgid_t, u32> _by_pos;                 // pos to slot
+    std::set<std::pair<u32, pgid_t>> _by_len;      // len and pos
+    std::set<u32>         _dirty;                  // pages of _pg
+    u64                   _free{0};                // pages in extents
+    pgid_t                _floor{0};               // end before the last cut
+    bool                  _cut_pending{false};     // a shrink is cutting
+    std::mutex            _cut;                    // after _mtx, if both
+    bool                  _cutting{false};         // under _cut, not off
+    Cache                 _caches[CACHES];
 };
 
 extern std::unique_ptr<PageAllocator> g_pa;
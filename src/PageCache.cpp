@@ -9,6 +9,9 @@
 #include <vector>
 #include <thread>
 #include <chrono>
+#include <cstring>
+#include <sys/uio.h>
+#include "IoEngine.h"
 #include "Page.h"
 #include "PageCache.h"
 
@@ -16,8 +19,20 @@ namespace bptdb {
 
 std::shared_ptr<PageCache> g_pc;
 
-PageCache::PageCache(u32 max_page): _lru(Page::lru_tag()) {
-    _max_page = max_page;
+PageCache::PageCache(u32 max_page, CachePolicy policy) {
+    // one shard for every 64 pages at least, up to 64 shards.
+    u32 nshards = 1;
+    while (nshards < 64 && nshards * 2 * 64 <= max_page) {
+        nshards *= 2;
+    }
+    _mask = nshards - 1;
+    for (u32 i = 0; i < nshards; i++) {
+        auto sh = std::make_unique<Shard>();
+        sh->max_page = max_page / nshards + (i == 0 ? max_page % nshards : 0);
+        sh->reserve = std::max(1u, sh->max_page / 8);
+        sh->repl = newReplacer(policy, sh->max_page);
+        _shards.push_back(std::move(sh));
+    }
 }
 
 void PageCache::start() {
@@ -25,82 +40,400 @@ void PageCache::start() {
 }
 
 void PageCache::stop() {
-    _stop.store(true);
+    {
+        std::lock_guard lg(_mtx);
+        _stop.store(true);
+    }
+    _cv.notify_one();
     _f.get();
 }
 
 PagePtr PageCache::tryGet(pgid_t id) {
-    std::shared_lock lg(_shmtx);
-    auto it = _cache.find(id);
-    if (it == _cache.end()) {
+    auto &sh = shard(id);
+    std::shared_lock lg(sh.shmtx);
+    auto it = sh.cache.find(id);
+    if (it == sh.cache.end()) {
         return std::shared_ptr<Page>();
     }
     auto pg = it->second;
-    _lru.move_to_front(pg.get());
+    // pin under the lock, so the cleaner never sees it unpinned.
+    pg->pin();
+    if (!pg->evicting()) {
+        sh.repl->touch(pg.get());
+    }
     return pg;
 }
 
-PagePtr PageCache::insertNew(pgid_t id) {
-    std::unique_lock lg(_shmtx);
+// a fresh page is returned latched exclusive and not loaded, so the disk
+// read is done out of the cache lock.
+std::tuple<PagePtr, bool> PageCache::insertNew(pgid_t id) {
+    auto &sh = shard(id);
+    std::unique_lock lg(sh.shmtx);
+    // other thread may load it before we get the lock.
+    auto it = sh.cache.find(id);
+    if (it != sh.cache.end()) {
+        it->second->pin();
+        return {it->second, false};
+    }
     auto pg = std::make_shared<Page>(id);
-    _page_count++;
-    if (_page_count > _max_page) {
-        auto raw = _lru.pop_back();
-        auto it = _cache.find(raw->getId());
-        it->second->flush();
-        _cache.erase(it);
-        _page_count--;
-    }
-    _cache.insert({pg->getId(), pg});
-    _lru.push_front(pg.get());
-    return pg;
+    pg->pin();
+    pg->latch().lock();
+    sh.page_count++;
+    if (sh.page_count > sh.max_page) {
+        evict(sh);
+    }
+    sh.cache.insert({pg->getId(), pg});
+    sh.repl->insert(pg.get());
+    if (sh.page_count + sh.reserve > sh.max_page) {
+        _cv.notify_one();
+    }
+    return {pg, true};
 }
 
-void PageCache::read(pgid_t id, void *dest) {
+// must hold the exclusive lock of shard. only a clean page is taken, so
+// no io here. if there is none, the shard goes over the limit until the
+// cleaner catches up.
+void PageCache::evict(Shard &sh) {
+    auto raw = sh.repl->victim([](Page *pg) {
+        return !pg->pinned() && !pg->dirty();
+    });
+    if (!raw) {
+        return;
+    }
+    sh.cache.erase(raw->getId());
+    sh.page_count--;
+}
+
+PagePtr PageCache::pin(pgid_t id) {
     auto pg = tryGet(id);
-    if (!pg) {
-        pg = insertNew(id);
+    if (pg) {
+        return pg;
+    }
+    bool fresh;
+    std::tie(pg, fresh) = insertNew(id);
+    if (fresh) {
+        g_fm->read((char *)pg->data(), g_option.page_size, page2off(id));
+        pg->latch().unlock();
     }
+    return pg;
+}
+
+void PageCache::unpin(PagePtr &pg) {
+    pg->unpin();
+    pg.reset();
+}
+
+void PageCache::read(pgid_t id, void *dest) {
+    auto pg = pin(id);
     pg->read(dest);
+    unpin(pg);
+}
+
+void PageCache::read(pgid_t id, u32 cnt, void *dest) {
+    char *buf = (char *)dest;
+    // fresh pages of a run, read by one preadv.
+    std::vector<PagePtr> miss;
+    auto load = [&]() {
+        if (miss.empty()) {
+            return;
+        }
+        std::vector<iovec> iov;
+        for (auto &pg: miss) {
+            iov.push_back({pg->data(), g_option.page_size});
+        }
+        g_fm->readv(iov, page2off(miss[0]->getId()));
+        for (auto &pg: miss) {
+            std::memcpy(buf + page2off(pg->getId() - id), pg->data(),
+                    g_option.page_size);
+            pg->latch().unlock();
+            unpin(pg);
+        }
+        miss.clear();
+    };
+    for (u32 i = 0; i < cnt; i++) {
+        auto pg = tryGet(id + i);
+        bool fresh = false;
+        if (!pg) {
+            std::tie(pg, fresh) = insertNew(id + i);
+        }
+        if (fresh) {
+            miss.push_back(pg);
+            continue;
+        }
+        load();
+        pg->read(buf + page2off(i));
+        unpin(pg);
+    }
+    load();
+}
+
+// runs of adjacent pages are read by one preadv, all runs are in flight
+// at once. the fresh pages are unlatched here, by the thread which latched
+// them.
+void PageCache::prefetch(std::vector<pgid_t> ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (g_fm->mapped()) {
+        // nodes are read in the mapping, the kernel loads them.
+        for (u32 i = 0, j = 0; i < ids.size(); i = j) {
+            for (j = i + 1; j < ids.size() && ids[j] == ids[j - 1] + 1; j++);
+            g_fm->willNeed(ids[i], j - i);
+        }
+        return;
+    }
+    std::vector<std::vector<PagePtr>> runs;
+    for (auto id: ids) {
+        if (contains(id)) {
+            continue;
+        }
+        auto [pg, fresh] = insertNew(id);
+        if (!fresh) {
+            unpin(pg);
+            continue;
+        }
+        if (runs.empty() || runs.back().back()->getId() + 1 != id) {
+            runs.emplace_back();
+        }
+        runs.back().push_back(pg);
+    }
+    IoBatch batch(g_io.get());
+    for (auto &run: runs) {
+        std::vector<iovec> iov;
+        for (auto &pg: run) {
+            iov.push_back({pg->data(), g_option.page_size});
+        }
+        batch.read(std::move(iov), page2off(run[0]->getId()), [&run, this] {
+            for (auto &pg: run) {
+                pg->latch().unlock();
+                unpin(pg);
+            }
+        });
+    }
+    batch.wait();
+}
+
+// a page changed while a snapshot is on is loaded, its content before
+// is kept by Page::write.
+static bool keeping() {
+    return g_snap && g_snap->active();
 }
 
 void PageCache::write(pgid_t id, void *src) {
-    auto pg = tryGet(id);
+    // a write out of any txn is one of its own, begun before the latch.
+    if (g_wal && !g_wal->inRecord()) {
+        WalTxn txn;
+        write(id, src);
+        return;
+    }
+    auto pg = keeping() ? pin(id) : tryGet(id);
+    if (!pg && g_wal) {
+        // with log the page must be in cache to be logged and held back.
+        bool fresh;
+        std::tie(pg, fresh) = insertNew(id);
+        if (fresh) {
+            // no need to load, it is overwritten all.
+            std::memcpy(pg->data(), src, g_option.page_size);
+            pg->markDirty();
+            pg->latch().unlock();
+            unpin(pg);
+            return;
+        }
+    }
     if (pg) {
         pg->write(src);
+        unpin(pg);
         return;
     }
-    g_fm->write((char *)src, g_option.page_size, id * g_option.page_size);
+    g_fm->write((char *)src, g_option.page_size, page2off(id));
+}
+
+void PageCache::write(pgid_t id, u32 cnt, void *src) {
+    char *buf = (char *)src;
+    // pages not in cache, written by one pwrite.
+    u32 run = 0;
+    auto flush = [&](u32 end) {
+        if (run < end) {
+            g_fm->write(buf + page2off(run),
+                    (end - run) * g_option.page_size, page2off(id + run));
+        }
+    };
+    for (u32 i = 0; i < cnt; i++) {
+        if (!g_wal && !keeping() && !contains(id + i)) {
+            continue;
+        }
+        flush(i);
+        write(id + i, buf + page2off(i));
+        run = i + 1;
+    }
+    flush(cnt);
+}
+
+bool PageCache::contains(pgid_t id) {
+    auto &sh = shard(id);
+    std::shared_lock lg(sh.shmtx);
+    return sh.cache.count(id) > 0;
+}
+
+// the pages are free, a dirty one is not written. a frame in use is left,
+// it is written before read once the page is taken again.
+void PageCache::discard(pgid_t from, pgid_t to) {
+    for (auto &sh: _shards) {
+        std::unique_lock lg(sh->shmtx);
+        for (auto it = sh->cache.begin(); it != sh->cache.end();) {
+            auto pg = it->second.get();
+            if (it->first < from || it->first >= to || pg->pinned() ||
+                    pg->evicting()) {
+                ++it;
+                continue;
+            }
+            pg->setClean();
+            sh->repl->erase(pg);
+            it = sh->cache.erase(it);
+            sh->page_count--;
+        }
+    }
 }
 
 bool PageCache::alive() {
     return !_stop.load();
 }
 
+// keep reserve clean frames free in every shard, and write back all dirty
+// pages every 10 seconds.
 void PageCache::run() {
     DEBUGOUT("PageCache start...");
     auto pc = g_pc;
+    auto last = std::chrono::steady_clock::now();
     while (pc->alive()) {
-        auto dirty_pgs = pc->collectDirty();
-        std::for_each(dirty_pgs.begin(), 
-                dirty_pgs.end(), [](PagePtr pg) { pg->flush(); });
-        if (!pc->alive()) {
-            break;
+        for (auto &sh: pc->_shards) {
+            pc->clean(*sh);
         }
-        std::this_thread::sleep_for(std::chrono::seconds(10));
+        auto now = std::chrono::steady_clock::now();
+        if (now - last >= std::chrono::seconds(10)) {
+            auto dirty_pgs = pc->collectDirty();
+            pc->writeBack(dirty_pgs);
+            last = now;
+        }
+        std::unique_lock lg(pc->_mtx);
+        pc->_cv.wait_for(lg, std::chrono::milliseconds(10),
+                [pc] { return !pc->alive(); });
     }
-    auto dirty_pgs = pc->collectDirty();
-    std::for_each(dirty_pgs.begin(), 
-            dirty_pgs.end(), [](PagePtr pg) { pg->flush(); });
+    pc->flushAll();
     DEBUGOUT("PageCache stop...");
 }
 
+void PageCache::clean(Shard &sh) {
+    std::vector<PagePtr> pgs;
+    {
+        std::unique_lock lg(sh.shmtx);
+        while (sh.page_count - pgs.size() + sh.reserve > sh.max_page) {
+            auto raw = sh.repl->victim([](Page *pg) {
+                return !pg->pinned() && pg->flushable();
+            });
+            if (!raw) {
+                break;
+            }
+            // stay in cache while written, readers must not miss it.
+            raw->setEvicting(true);
+            pgs.push_back(sh.cache[raw->getId()]);
+        }
+    }
+    if (pgs.empty()) {
+        return;
+    }
+    writeBack(pgs);
+    std::unique_lock lg(sh.shmtx);
+    for (auto &pg: pgs) {
+        pg->setEvicting(false);
+        // used again meanwhile, keep it.
+        if (pg->pinned() || pg->dirty()) {
+            sh.repl->insert(pg.get());
+            continue;
+        }
+        sh.cache.erase(pg->getId());
+        sh.page_count--;
+    }
+}
+
+// write dirty pages in order of id, adjacent pages go by one pwritev. up
+// to io_depth runs are written at once.
+void PageCache::writeBack(std::vector<PagePtr> &pgs) {
+    std::sort(pgs.begin(), pgs.end(), [](PagePtr &a, PagePtr &b) {
+        return a->getId() < b->getId();
+    });
+    bool lost = false; // the log failed, pages stay dirty in cache
+    IoBatch batch(g_io.get());
+    std::vector<Page *> run; // latched shared
+    u64 maxlsn = 0;
+    auto flush = [&]() {
+        // log goes to disk before the pages, they never go if it fails.
+        if (maxlsn && !g_wal->sync(maxlsn)) {
+            lost = true;
+            batch.drop();
+        }
+        maxlsn = 0;
+        batch.wait();
+    };
+    auto endRun = [&]() {
+        if (run.empty()) {
+            return;
+        }
+        std::vector<iovec> iov;
+        for (auto pg: run) {
+            iov.push_back({pg->data(), g_option.page_size});
+        }
+        u64 pos = page2off(run[0]->getId());
+        batch.write(std::move(iov), pos, [run = std::move(run), &lost] {
+            for (auto pg: run) {
+                if (!lost) {
+                    pg->setClean();
+                }
+                pg->latch().unlock_shared();
+            }
+        });
+        run.clear();
+        if (batch.size() >= g_option.io_depth) {
+            flush();
+        }
+    };
+    for (auto &pg: pgs) {
+        if (!pg->dirty()) {
+            continue;
+        }
+        if (!run.empty() && run.back()->getId() + 1 != pg->getId()) {
+            endRun();
+        }
+        // never wait for a latch while holding others.
+        if (!pg->latch().try_lock_shared()) {
+            endRun();
+            flush();
+            pg->latch().lock_shared();
+        }
+        u64 lsn;
+        if (!pg->dirty() || !pg->walLsn(lsn)) {
+            pg->latch().unlock_shared();
+            continue;
+        }
+        run.push_back(pg.get());
+        maxlsn = std::max(maxlsn, lsn);
+    }
+    endRun();
+    flush();
+}
+
+void PageCache::flushAll() {
+    auto dirty_pgs = collectDirty();
+    writeBack(dirty_pgs);
+}
+
 std::vector<PagePtr> PageCache::collectDirty() {
     std::vector<PagePtr> dirty_pgs;
-    std::shared_lock lg(_shmtx);
-    for (auto it = _cache.begin(); it != _cache.end(); ++it) {
-        if (it->second->dirty()) {
-            dirty_pgs.push_back(it->second);
+    for (auto &sh: _shards) {
+        std::shared_lock lg(sh->shmtx);
+        for (auto it = sh->cache.begin(); it != sh->cache.end(); ++it) {
+            if (it->second->dirty()) {
+                dirty_pgs.push_back(it->second);
+            }
         }
     }
     return dirty_pgs;
@@ -4,43 +4,73 @@
 #include <cstdlib>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <functional>
 #include <mutex>
 #include <future>
-#include <map>
 #include <memory>
 #include <list>
 #include <shared_mutex>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "common.h"
-#include "List.h"
 #include "Page.h"
+#include "Replacer.h"
 
 namespace bptdb {
 
 class PageCache {
 public:
-    PageCache(u32 max_page);
+    PageCache(u32 max_page, CachePolicy policy);
     void read(pgid_t id, void *dest);
     void write(pgid_t id, void *src);
+    // read and write cnt pages from id.
+    void read(pgid_t id, u32 cnt, void *dest);
+    void write(pgid_t id, u32 cnt, void *src);
+    // load pages not in cache yet, in parallel.
+    void prefetch(std::vector<pgid_t> ids);
+    bool contains(pgid_t id);
+    // drop the frames of pages in [from, to), they are cut off the file.
+    void discard(pgid_t from, pgid_t to);
+    // pin the page in cache, the frame will not be evicted until unpin.
+    PagePtr pin(pgid_t id);
+    void unpin(PagePtr &pg);
     std::vector<PagePtr> collectDirty();
+    // write back all dirty pages, no txn is running.
+    void flushAll();
     void start();
     void stop();
     bool alive();
 private:
-    // PagePtr readWrite(pgid_t id);
+    // pages are partitioned by id, each shard has its own lock and
+    // replacer, so threads hitting different shards never meet.
+    struct Shard {
+        std::unordered_map<pgid_t, PagePtr> cache;
+        std::shared_mutex shmtx;
+        std::unique_ptr<Replacer> repl; // 并不拥有Page所有权
+        u32 page_count{0};
+        u32 max_page{0};
+        u32 reserve{0}; // free frames the cleaner keeps
+    };
+    Shard &shard(pgid_t id) {
+        return *_shards[id & _mask];
+    }
     PagePtr tryGet(pgid_t id);
-    PagePtr insertNew(pgid_t id);
+    std::tuple<PagePtr, bool> insertNew(pgid_t id);
+    void evict(Shard &sh);
+    // write back and drop cold pages until reserve frames are free.
+    void clean(Shard &sh);
+    void writeBack(std::vector<PagePtr> &pgs);
     static void run();
-    u32 _max_page{0};
-    std::atomic<u32> _page_count{0};
-    std::map<pgid_t, PagePtr> _cache;
-    std::shared_mutex _shmtx;
+    u32 _mask{0};
+    std::vector<std::unique_ptr<Shard>> _shards;
     std::atomic_bool _stop{false};
+    std::mutex _mtx;
+    std::condition_variable _cv; // wake up the cleaner
     std::future<void> _f;
-    List<Page> _lru; // 侵入式链表，并不拥有Page所有权
 };
 
 extern std::shared_ptr<PageCache> g_pc;
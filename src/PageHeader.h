@@ -12,7 +12,7 @@ struct PageHeader {
     u32    hdrpages;
     u32    realpages;
     u32    bytes;   ///< 总字节数
-    u32    checksum;
+    u32    high;    ///< offset of the high key of node, 0 if none
     pgid_t res;
     u32    size;
     pgid_t next;
@@ -21,7 +21,7 @@ struct PageHeader {
         hdr->hdrpages  = len;
         hdr->realpages = len;
         hdr->bytes     = sizeof(PageHeader);
-        hdr->checksum  = 0;
+        hdr->high      = 0;
         hdr->res       = 0;
         hdr->size      = 0;
         hdr->next      = next;
@@ -7,12 +7,14 @@
 #include "Option.h"
 #include "PageCache.h"
 #include "PageHeader.h"
+#include "SnapshotManager.h"
 
 namespace bptdb {
 
-PageHelper::PageHelper(pgid_t id) {
+PageHelper::PageHelper(pgid_t id, PageMode mode) {
     assert(id > 0);
     _id = id;
+    _mode = mode;
 }
 
 PageHelper::PageHelper(pgid_t id, u32 data_pgs) {
@@ -24,22 +26,70 @@ PageHelper::PageHelper(pgid_t id, u32 data_pgs) {
 }
 
 PageHelper::~PageHelper() {
-    if(_data) std::free(_data);
+    _release();
+}
+
+void PageHelper::_release() {
+    if(_data && !_inFrame() && !_mapped) {
+        std::free(_data);
+    }
+    _data = nullptr;
+    if(!_frame) {
+        return;
+    }
+    if(_mode == PageMode::Read) {
+        _frame->latch().unlock_shared();
+    }else {
+        _frame->latch().unlock();
+    }
+    g_pc->unpin(_frame);
 }
 
 void *PageHelper::read() {
     assert(_data == nullptr); 
-    _data = (char *)std::malloc(g_option.page_size);
-    _readPage(_data, 1, _id);
+    PageHeader *hdr = nullptr;
+    // read only, the node is read in place and never changes.
+    if(g_fm->mapped()) {
+        _mapped = true;
+        _data = g_fm->at(page2off(_id));
+        hdr = (PageHeader *)_data;
+        _data_pgs = hdr->realpages;
+        if(_data_pgs > hdr->hdrpages) {
+            _data = g_fm->view(_id, hdr->hdrpages, hdr->res, 
+                    _data_pgs - hdr->hdrpages);
+        }
+        return _data;
+    }
+    // a snapshot reads a copy, the frame may be newer.
+    if(_mode != PageMode::Copy && !SnapshotManager::current()) {
+        _frame = g_pc->pin(_id);
+        if(_mode == PageMode::Read) {
+            _frame->latch().lock_shared();
+        }else {
+            _frame->latch().lock();
+            _frame->keep();
+        }
+        hdr = (PageHeader *)_frame->data();
+        _data_pgs = hdr->realpages;
+        assert(_data_pgs > 0);
+        // zero copy, work on the frame directly.
+        if(_data_pgs == 1) {
+            _data = (char *)_frame->data();
+            return _data;
+        }
+        // more than one page, we have to gather them.
+        _data = (char *)std::malloc(_data_pgs * g_option.page_size);
+        std::memcpy(_data, _frame->data(), g_option.page_size);
+    }else {
+        _data = (char *)std::malloc(g_option.page_size);
+        _readPage(_data, 1, _id);
+        hdr = (PageHeader *)_data;
+        _data_pgs = hdr->realpages;
+        assert(_data_pgs > 0);
+        _data = (char *)std::realloc(_data, _data_pgs * g_option.page_size);
+    }
 
-    auto hdr = (PageHeader *)_data;
-    _data_pgs = byte2page(hdr->bytes);
     u32 datapages = _data_pgs;
-
-    //std::cout << "datapages " << datapages << "\n";
-    assert(datapages > 0);
-
-    _data = (char *)std::realloc(_data, datapages * g_option.page_size);
     // 更新header
     hdr = (PageHeader *)_data;
 
@@ -59,7 +109,12 @@ void *PageHelper::read() {
 }
 
 void *PageHelper::extend(u32 extbytes) {
-    assert(_data);
+    assert(_data && !_mapped);
+    // leave the frame, it will be copied back on write.
+    if(_inFrame()) {
+        _data = (char *)std::malloc(g_option.page_size);
+        std::memcpy(_data, _frame->data(), g_option.page_size);
+    }
     auto hdr = (PageHeader *)_data;
     u32 extpages = byte2page(hdr->bytes + extbytes) - _data_pgs;
     _data_pgs += extpages;
@@ -82,12 +137,22 @@ void *PageHelper::extend(u32 extbytes) {
 }
 
 void PageHelper::write() {
-    assert(_data);
+    assert(_data && !_mapped);
+    assert(_mode != PageMode::Read);
     auto hdr = (PageHeader *)_data;
     u32 total = _data_pgs;
     u32 towrite = std::min(hdr->hdrpages, total);
     //std::cout << g_option.page_size << " to write " << towrite << " id " << _id << "\n";
-    _writePage(_data, towrite, _id);
+    if(_frame) {
+        // we hold the frame exclusive, so update it in place.
+        if(!_inFrame()) {
+            std::memcpy(_frame->data(), _data, g_option.page_size);
+        }
+        _frame->markDirty();
+        _writePage(_data + g_option.page_size, towrite - 1, _id + 1);
+    }else {
+        _writePage(_data, towrite, _id);
+    }
     total -= towrite;
     if(total > 0) {
         _writePage(_data + g_option.page_size * towrite, total, hdr->res);
@@ -95,21 +160,17 @@ void PageHelper::write() {
 }
 
 void PageHelper::_readPage(char *buf, u32 cnt, u32 pos) {
-    // g_fm->read(buf, cnt * g_option.page_size, pos * g_option.page_size);
-    for (u32 i = 0; i < cnt; i++) {
-        g_pc->read(pos, buf);
-        pos++;
-        buf += g_option.page_size;
+    if(auto seq = SnapshotManager::current()) {
+        for(u32 i = 0; i < cnt; i++) {
+            g_snap->read(pos + i, seq, buf + page2off(i));
+        }
+        return;
     }
+    g_pc->read(pos, cnt, buf);
 }
 
 void PageHelper::_writePage(char *buf, u32 cnt, u32 pos) {
-    // g_fm->write(buf, cnt * g_option.page_size, pos * g_option.page_size);
-    for (u32 i = 0; i < cnt; i++) {
-        g_pc->write(pos, buf);
-        pos++;
-        buf += g_option.page_size;
-    }
+    g_pc->write(pos, cnt, buf);
 }
 
 bool PageHelper::overFlow(u32 extbytes) {
@@ -125,8 +186,7 @@ void PageHelper::free() {
     if(hdr->res) {
         g_pa->freePage(hdr->res, hdr->realpages - hdr->hdrpages);
     }
-    std::free(_data);
-    _data = nullptr;
+    _release();
 }
 
 }
@@ -7,16 +7,24 @@
 #include <memory>
 #include <cstdlib>
 #include "common.h"
+#include "Page.h"
 
 namespace bptdb {
 
 class PageAllocator;
 
+// how PageHelper reach the content of page.
+enum class PageMode {
+    Copy,   // read into private buffer, write back through cache.
+    Read,   // pin the cached frame and hold its latch shared.
+    Write,  // pin the cached frame and hold its latch exclusive.
+};
+
 class PageHelper { 
     friend class PageAllocator;
 public:
     PageHelper(pgid_t id, u32 data_pgs);
-    PageHelper(pgid_t id);
+    PageHelper(pgid_t id, PageMode mode = PageMode::Copy);
     ~PageHelper();
     void *read();
     void *extend(u32 extbytes);
@@ -24,6 +32,7 @@ public:
     void free();
     bool   overFlow(u32 extbytes);
     void   *data() { return _data; }
+    u32    capacity() { return _data_pgs * g_option.page_size; }
     pgid_t getId() { return _id; }
 
 private:
@@ -31,10 +40,16 @@ private:
     void _readPage(char *buf, u32 cnt, u32 pos);
     // write by page_size
     void _writePage(char *buf, u32 cnt, u32 pos);
+    // unlatch and unpin the frame, free the buffer.
+    void _release();
+    bool _inFrame() { return _frame && _data == _frame->data(); }
 
     pgid_t  _id{0};
     u32     _data_pgs{0}; // page len of _data
     char    *_data{nullptr};
+    PageMode _mode{PageMode::Copy};
+    PagePtr  _frame; // pinned frame of the first page, if any.
+    bool     _mapped{false}; // _data is in the mapped file
 };
 
 using PageHelperPtr = std::shared_ptr<PageHelper>;
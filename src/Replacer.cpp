@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "List.h"
+#include "Page.h"
+#include "Replacer.h"
+
+namespace bptdb {
+
+namespace {
+
+// id of pages evicted lately, the most recent at front.
+class Ghost {
+public:
+    bool erase(pgid_t id) {
+        auto it = _map.find(id);
+        if (it == _map.end()) {
+            return false;
+        }
+        _list.erase(it->second);
+        _map.erase(it);
+        return true;
+    }
+    void push(pgid_t id) {
+        _list.push_front(id);
+        _map[id] = _list.begin();
+    }
+    void pop() {
+        _map.erase(_list.back());
+        _list.pop_back();
+    }
+    u32 size() { return _list.size(); }
+private:
+    std::list<pgid_t> _list;
+    std::unordered_map<pgid_t, std::list<pgid_t>::iterator> _map;
+};
+
+// second chance, a referenced page loses its bit and goes to back.
+Page *clockVictim(List<Page> &ring, std::function<bool(Page *)> &ok) {
+    auto cnt = ring.size() * 2;
+    while (cnt--) {
+        auto raw = ring.pop_front();
+        if (raw->ref()) {
+            raw->setRef(false);
+        } else if (ok(raw)) {
+            return raw;
+        }
+        ring.push_back(raw);
+    }
+    return nullptr;
+}
+
+// strict lru, every hit moves the page to front. hits come under the
+// shared lock of shard, so the list has a lock of its own.
+class LruReplacer: public Replacer {
+public:
+    void insert(Page *pg) override {
+        std::lock_guard lg(_mtx);
+        _lru.push_front(pg);
+    }
+    void touch(Page *pg) override {
+        std::lock_guard lg(_mtx);
+        _lru.move_to_front(pg);
+    }
+    void erase(Page *pg) override {
+        std::lock_guard lg(_mtx);
+        _lru.erase(pg);
+    }
+    Page *victim(std::function<bool(Page *)> ok) override {
+        std::lock_guard lg(_mtx);
+        auto cnt = _lru.size();
+        while (cnt--) {
+            auto raw = _lru.pop_back();
+            if (ok(raw)) {
+                return raw;
+            }
+            _lru.push_front(raw);
+        }
+        return nullptr;
+    }
+private:
+    std::mutex _mtx;
+    List<Page> _lru{Page::repl_tag()};
+};
+
+class ClockReplacer: public Replacer {
+public:
+    void insert(Page *pg) override {
+        pg->setRef(false);
+        _ring.push_back(pg);
+    }
+    void touch(Page *pg) override {
+        if (!pg->ref()) {
+            pg->setRef(true);
+        }
+    }
+    void erase(Page *pg) override {
+        _ring.erase(pg);
+    }
+    Page *victim(std::function<bool(Page *)> ok) override {
+        return clockVictim(_ring, ok);
+    }
+private:
+    List<Page> _ring{Page::repl_tag()};
+};
+
+// 2Q: a new page waits in a1in, only the pages hit again in a1in or come
+// back soon after leaving it enter am, so a scan never reaches am.
+class TwoQReplacer: public Replacer {
+public:
+    enum Queue: u8 { A1IN, AM };
+    TwoQReplacer(u32 capacity) {
+        _kin  = std::max(1u, capacity / 4);
+        _kout = std::max(1u, capacity / 2);
+    }
+    void insert(Page *pg) override {
+        pg->setRef(false);
+        if (_a1out.erase(pg->getId())) {
+            pg->setQueue(AM);
+            _am.push_back(pg);
+        } else {
+            pg->setQueue(A1IN);
+            _a1in.push_back(pg);
+        }
+    }
+    void touch(Page *pg) override {
+        if (!pg->ref()) {
+            pg->setRef(true);
+        }
+    }
+    void erase(Page *pg) override {
+        (pg->queue() == AM ? _am : _a1in).erase(pg);
+    }
+    Page *victim(std::function<bool(Page *)> ok) override {
+        Page *raw = nullptr;
+        if (_a1in.size() > _kin || _am.empty()) {
+            raw = fromA1in(ok);
+        }
+        if (!raw && !_am.empty()) {
+            raw = clockVictim(_am, ok);
+        }
+        if (!raw && !_a1in.empty()) {
+            raw = fromA1in(ok);
+        }
+        return raw;
+    }
+private:
+    Page *fromA1in(std::function<bool(Page *)> &ok) {
+        auto cnt = _a1in.size();
+        while (cnt--) {
+            auto raw = _a1in.pop_front();
+            // hit again while in a1in, it is hot already.
+            if (raw->ref()) {
+                raw->setRef(false);
+                raw->setQueue(AM);
+                _am.push_back(raw);
+                continue;
+            }
+            if (!ok(raw)) {
+                _a1in.push_back(raw);
+                continue;
+            }
+            _a1out.push(raw->getId());
+            if (_a1out.size() > _kout) {
+                _a1out.pop();
+            }
+            return raw;
+        }
+        return nullptr;
+    }
+    u32 _kin{0};
+    u32 _kout{0};
+    List<Page> _a1in{Page::repl_tag()};
+    List<Page> _am{Page::repl_tag()};
+    Ghost _a1out;
+};
+
+// ARC run on clocks (CAR), so a hit only sets the ref bit. t1 holds the
+// pages seen once lately, t2 the pages seen twice, b1 and b2 remember
+// what they evicted and move the target size p of t1.
+class ArcReplacer: public Replacer {
+public:
+    enum Queue: u8 { T1, T2 };
+    ArcReplacer(u32 capacity) {
+        _c = std::max(1u, capacity);
+    }
+    void insert(Page *pg) override {
+        auto id = pg->getId();
+        u32 b1 = _b1.size(), b2 = _b2.size();
+        pg->setRef(false);
+        if (_b1.erase(id)) {
+            _p = std::min(_p + std::max(1u, b2 / b1), _c);
+            pg->setQueue(T2);
+            _t2.push_back(pg);
+            return;
+        }
+        if (_b2.erase(id)) {
+            u32 delta = std::max(1u, b1 / b2);
+            _p = _p > delta ? _p - delta : 0;
+            pg->setQueue(T2);
+            _t2.push_back(pg);
+            return;
+        }
+        // keep the history no larger than the cache.
+        if (_t1.size() + b1 >= _c && b1 > 0) {
+            _b1.pop();
+        } else if (_t1.size() + _t2.size() + b1 + b2 >= 2 * _c && b2 > 0) {
+            _b2.pop();
+        }
+        pg->setQueue(T1);
+        _t1.push_back(pg);
+    }
+    void touch(Page *pg) override {
+        if (!pg->ref()) {
+            pg->setRef(true);
+        }
+    }
+    void erase(Page *pg) override {
+        (pg->queue() == T2 ? _t2 : _t1).erase(pg);
+    }
+    Page *victim(std::function<bool(Page *)> ok) override {
+        auto cnt = (_t1.size() + _t2.size()) * 2 + 1;
+        while (cnt--) {
+            if (!_t1.empty() && (_t1.size() >= std::max(1u, _p) || _t2.empty())) {
+                auto raw = _t1.pop_front();
+                // seen twice, promote it.
+                if (raw->ref()) {
+                    raw->setRef(false);
+                    raw->setQueue(T2);
+                    _t2.push_back(raw);
+                    continue;
+                }
+                if (!ok(raw)) {
+                    _t1.push_back(raw);
+                    continue;
+                }
+                _b1.push(raw->getId());
+                return raw;
+            }
+            if (_t2.empty()) {
+                return nullptr;
+            }
+            auto raw = _t2.pop_front();
+            if (raw->ref()) {
+                raw->setRef(false);
+            } else if (ok(raw)) {
+                _b2.push(raw->getId());
+                return raw;
+            }
+            _t2.push_back(raw);
+        }
+        return nullptr;
+    }
+private:
+    u32 _c{0};
+    u32 _p{0};
+    List<Page> _t1{Page::repl_tag()};
+    List<Page> _t2{Page::repl_tag()};
+    Ghost _b1;
+    Ghost _b2;
+};
+
+}// namespace
+
+std::unique_ptr<Replacer> newReplacer(CachePolicy policy, u32 capacity) {
+    switch (policy) {
+    case CachePolicy::lru:
+        return std::make_unique<LruReplacer>();
+    case CachePolicy::clock:
+        return std::make_unique<ClockReplacer>();
+    case CachePolicy::twoq:
+        return std::make_unique<TwoQReplacer>(capacity);
+    case CachePolicy::arc:
+        return std::make_unique<ArcReplacer>(capacity);
+    }
+    return std::make_unique<LruReplacer>();
+}
+
+}// namespace bptdb
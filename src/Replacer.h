@@ -0,0 +1,33 @@
+#ifndef __REPLACER_H
+#define __REPLACER_H
+
+#include <functional>
+#include <memory>
+#include "common.h"
+#include "Option.h"
+
+namespace bptdb {
+
+class Page;
+
+// replacement policy of a cache shard.
+//
+// insert, erase and victim are called under the exclusive lock of shard,
+// touch is called on every hit under the shared lock, so it must be safe
+// against other touch calls. one that mutates a list takes a lock of its
+// own for it, the others only set the reference bit.
+class Replacer {
+public:
+    virtual ~Replacer() = default;
+    virtual void insert(Page *pg) = 0;
+    virtual void touch(Page *pg) = 0;
+    virtual void erase(Page *pg) = 0;
+    // remove and return a page for which ok() holds, nullptr if none.
+    virtual Page *victim(std::function<bool(Page *)> ok) = 0;
+};
+
+std::unique_ptr<Replacer> newReplacer(CachePolicy policy, u32 capacity);
+
+}// namespace bptdb
+
+#endif
@@ -0,0 +1,403 @@
+#ifndef __SLOT_DIR_H
+#define __SLOT_DIR_H
+
+#include <algorithm>
+#include <functional>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "common.h"
+#include "KeySearch.h"
+
+namespace bptdb {
+
+// if cmp sorts keys as bytes, so a shared prefix can be left out.
+static inline bool bytewise(const comparator_t &cmp) {
+    return cmp && cmp.target<std::less<std::string_view>>();
+}
+
+// the comparators the search in nodes calls inline, by the type cmp holds.
+// a bucket takes any comparator_t, so the type is only known at run time.
+// std::less and std::greater are seen through it, a SearchCmp made by
+// createBucket<Cmp> brings its own search, any other is called through
+// std::function.
+enum class KeyOrder { other, bytes, reverse, custom };
+
+static inline KeyOrder keyOrder(const comparator_t &cmp) {
+    if(!cmp) {
+        return KeyOrder::other;
+    }
+    if(cmp.target<std::less<std::string_view>>()) {
+        return KeyOrder::bytes;
+    }
+    if(cmp.target<std::greater<std::string_view>>()) {
+        return KeyOrder::reverse;
+    }
+    if(cmp.target<SearchCmp>()) {
+        return KeyOrder::custom;
+    }
+    return KeyOrder::other;
+}
+
+// call fn with the comparator of order as its own type, so fn is made
+// once for each and inlines it. the KeySearch of a custom one, whose
+// searches fn calls, and cmp itself for any other.
+template <typename Fn>
+static inline auto withOrder(KeyOrder order, const comparator_t &cmp, 
+        Fn &&fn) {
+    switch(order) {
+    case KeyOrder::bytes:
+        return fn(std::less<std::string_view>());
+    case KeyOrder::reverse:
+        return fn(std::greater<std::string_view>());
+    case KeyOrder::custom:
+        return fn(cmp.target<SearchCmp>()->search());
+    default:
+        return fn(cmp);
+    }
+}
+
+// the first 4 bytes of key as a big endian number, 0 for bytes it lacks.
+// keys in the order of bytes have heads in order.
+static inline u32 keyHead(std::string_view key) {
+    u32 ret = 0;
+    for(u32 i = 0; i < 4; i++) {
+        ret = ret << 8 | (i < key.size() ? (u8)key[i] : 0);
+    }
+    return ret;
+}
+
+// in heads[0, n) sorted, lt is set to the count of those below h and le
+// of those not above it. it stops at the first block all above h.
+static inline void countHeads(const u32 *heads, u32 n, u32 h, 
+        u32 &lt, u32 &le) {
+    lt = le = 0;
+    u32 i = 0;
+#if defined(__AVX2__)
+    // no unsigned compare, flip the sign bit of both sides.
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    const __m256i key = _mm256_set1_epi32((int)(h ^ 0x80000000u));
+    for(; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_xor_si256(bias, 
+                _mm256_loadu_si256((const __m256i *)(heads + i)));
+        u32 below = _mm256_movemask_ps(
+                _mm256_castsi256_ps(_mm256_cmpgt_epi32(key, v)));
+        u32 above = _mm256_movemask_ps(
+                _mm256_castsi256_ps(_mm256_cmpgt_epi32(v, key)));
+        lt += __builtin_popcount(below);
+        le += 8 - __builtin_popcount(above);
+        if(above) {
+            return;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i key = _mm_set1_epi32((int)(h ^ 0x80000000u));
+    for(; i + 4 <= n; i += 4) {
+        __m128i v = _mm_xor_si128(bias, 
+                _mm_loadu_si128((const __m128i *)(heads + i)));
+        u32 below = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, key)));
+        u32 above = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, key)));
+        lt += __builtin_popcount(below);
+        le += 4 - __builtin_popcount(above);
+        if(above) {
+            return;
+        }
+    }
+#endif
+    for(; i < n && heads[i] <= h; i++) {
+        lt += heads[i] < h;
+        le++;
+    }
+}
+
+// a full node splits within size / SPLIT_WINDOW of its middle, where the
+// key going up is the shortest.
+constexpr u32 SPLIT_WINDOW = 8;
+
+// slotted layout shared by leaf and inner node.
+//
+// | PageHeader | node header | slot[0] ... slot[n-1] | free | records |
+//
+// slots are kept in key order and hold the offset of each record from the
+// start of node, records are packed from the end of node toward low. a
+// deleted record leaves a hole, holes are reclaimed by compact() once the
+// free gap is not enough. Elem must begin with keylen and provide size().
+//
+// a node may also keep a high key, a record out of slots, all keys in the
+// node are less than it. keys from it on have moved to the nodes right.
+//
+// keys of a node share a prefix, kept once as another record out of slots,
+// and records hold the rest of key only. a prefix is taken only under the
+// order of bytes, by which the rest of keys sort as the keys do. key() is
+// the rest, full() the whole key, valid till the next call of it.
+//
+// a dir of heads also keeps keyHead() of each rest in an array right after
+// the slots, so a search in the order of bytes narrows to the keys of the
+// same head without reading records. the owner sets the head of a record
+// by setHead() once its key is in.
+template <typename Elem>
+class SlotDir {
+public:
+    void reset(char *base, u32 cap, u32 *slots,
+            u32 *low, u32 *size, u32 *bytes, u32 *high, u32 *prefix,
+            bool heads = false) {
+        _base   = base;
+        _cap    = cap;
+        _slots  = slots;
+        _low    = low;
+        _size   = size;
+        _bytes  = bytes;
+        _high   = high;
+        _prefix = prefix;
+        _heads  = heads;
+    }
+
+    // empty the dir, the caller account the header in bytes.
+    void clear() {
+        *_size = 0;
+        *_low = _cap;
+        *_high = 0;
+        *_prefix = 0;
+    }
+
+    std::string_view prefix() {
+        return *_prefix ? offkey(*_prefix) : std::string_view();
+    }
+    // make room of recsize bytes for a new prefix, the caller fills it
+    // and makes the records fit.
+    Elem *setPrefix(u32 recsize) {
+        dropPrefix();
+        reserve(recsize);
+        *_low -= recsize;
+        *_prefix = *_low;
+        (*_bytes) += recsize;
+        return (Elem *)(_base + *_low);
+    }
+    void dropPrefix() {
+        if(*_prefix) {
+            (*_bytes) -= ((Elem *)(_base + *_prefix))->size();
+            *_prefix = 0;
+        }
+    }
+    // where key is to the keys of prefix, < 0 before all of them, > 0
+    // after all, 0 if it has the prefix, rest is the part after it then.
+    int locate(std::string_view key, std::string_view &rest) {
+        return locate(prefix(), key, rest);
+    }
+    static int locate(std::string_view pre, std::string_view key, 
+                      std::string_view &rest) {
+        u32 n = std::min(key.size(), pre.size());
+        int ret = n ? std::memcmp(key.data(), pre.data(), n) : 0;
+        if(ret == 0 && key.size() < pre.size()) {
+            ret = -1;
+        }
+        if(ret == 0) {
+            rest = key.substr(pre.size());
+        }
+        return ret;
+    }
+    std::string_view full(u32 pos) {
+        if(!*_prefix) {
+            return key(pos);
+        }
+        _buf.assign(prefix());
+        _buf.append(key(pos));
+        return _buf;
+    }
+    // the shortest key after a and not after b, a is less than b.
+    static std::string between(std::string_view a, std::string_view b) {
+        return std::string(b.substr(0, common(a, b) + 1));
+    }
+    // length of the prefix a and b share.
+    static u32 common(std::string_view a, std::string_view b) {
+        u32 n = std::min(a.size(), b.size());
+        return std::mismatch(a.begin(), a.begin() + n, b.begin()).first - 
+               a.begin();
+    }
+
+    bool hasHigh() {
+        return *_high != 0;
+    }
+    std::string_view high() {
+        return offkey(*_high);
+    }
+    // make room of recsize bytes for a new high key, the old one is gone.
+    Elem *setHigh(u32 recsize) {
+        dropHigh();
+        reserve(recsize);
+        *_low -= recsize;
+        *_high = *_low;
+        (*_bytes) += recsize;
+        return (Elem *)(_base + *_low);
+    }
+    void dropHigh() {
+        if(*_high) {
+            (*_bytes) -= ((Elem *)(_base + *_high))->size();
+            *_high = 0;
+        }
+    }
+
+    Elem *elem(u32 pos) {
+        return (Elem *)(_base + _slots[pos]);
+    }
+    std::string_view key(u32 pos) {
+        return offkey(_slots[pos]);
+    }
+    std::string_view offkey(u32 off) {
+        auto e = (Elem *)(_base + off);
+        return std::string_view((char *)(e + 1), e->keylen);
+    }
+    u32 *begin() { return _slots; }
+    u32 *end()   { return _slots + *_size; }
+    char *base() { return _base; }
+
+    u32 *heads() { return _slots + *_size; }
+    void setHead(u32 pos) {
+        heads()[pos] = keyHead(key(pos));
+    }
+    // the keys in [lo, hi) have the head of rest, those before are less
+    // and those after greater, in the order of bytes.
+    void headRange(std::string_view rest, u32 &lo, u32 &hi) {
+        countHeads(heads(), *_size, keyHead(rest), lo, hi);
+    }
+
+    // make room of recsize bytes for a new record at pos.
+    Elem *insert(u32 pos, u32 recsize) {
+        assert(pos <= *_size);
+        reserve(recsize + slotSize());
+        u32 n = *_size;
+        if(_heads) {
+            // heads after pos go two up, those before one up.
+            std::memmove(_slots + n + pos + 2, _slots + n + pos,
+                    (n - pos) * sizeof(u32));
+            std::memmove(_slots + n + 1, _slots + n, pos * sizeof(u32));
+            _slots[n + 1 + pos] = 0;
+        }
+        std::memmove(_slots + pos + 1, _slots + pos,
+                (n - pos) * sizeof(u32));
+        *_low -= recsize;
+        _slots[pos] = *_low;
+        (*_size)++;
+        (*_bytes) += recsize + slotSize();
+        return (Elem *)(_base + *_low);
+    }
+
+    void erase(u32 pos) {
+        assert(pos < *_size);
+        (*_bytes) -= elem(pos)->size() + slotSize();
+        u32 n = *_size;
+        std::memmove(_slots + pos, _slots + pos + 1,
+                (n - pos - 1) * sizeof(u32));
+        if(_heads) {
+            std::memmove(_slots + n - 1, _slots + n, pos * sizeof(u32));
+            std::memmove(_slots + n - 1 + pos, _slots + n + pos + 1,
+                    (n - pos - 1) * sizeof(u32));
+        }
+        (*_size)--;
+    }
+
+    // give the record at pos an area of recsize bytes, the content is
+    // kept only if it is updated in place.
+    Elem *replace(u32 pos, u32 recsize) {
+        auto old = elem(pos)->size();
+        if(recsize <= old) {
+            (*_bytes) -= old - recsize;
+            return elem(pos);
+        }
+        erase(pos);
+        return insert(pos, recsize);
+    }
+
+    // drop slots from pos to the end, their records become holes.
+    void truncate(u32 pos) {
+        for(u32 i = pos; i < *_size; i++) {
+            (*_bytes) -= elem(i)->size() + slotSize();
+        }
+        if(_heads) {
+            std::memmove(_slots + pos, heads(), pos * sizeof(u32));
+        }
+        *_size = pos;
+    }
+
+    // the buffer has grown from oldcap to cap, move records to the new end.
+    void grow(u32 oldcap) {
+        assert(_cap >= oldcap);
+        u32 delta = _cap - oldcap;
+        if(delta == 0) {
+            return;
+        }
+        std::memmove(_base + *_low + delta, _base + *_low, oldcap - *_low);
+        for(u32 i = 0; i < *_size; i++) {
+            _slots[i] += delta;
+        }
+        if(*_high) {
+            *_high += delta;
+        }
+        if(*_prefix) {
+            *_prefix += delta;
+        }
+        *_low += delta;
+    }
+
+    // pack all records to the end of node.
+    void compact() {
+        std::vector<u32 *> order;
+        for(u32 i = 0; i < *_size; i++) {
+            order.push_back(_slots + i);
+        }
+        if(*_high) {
+            order.push_back(_high);
+        }
+        if(*_prefix) {
+            order.push_back(_prefix);
+        }
+        // from the highest record down, every record only moves up.
+        std::sort(order.begin(), order.end(), [](u32 *a, u32 *b) {
+            return *a > *b;
+        });
+        u32 top = _cap;
+        for(auto off: order) {
+            u32 len = ((Elem *)(_base + *off))->size();
+            top -= len;
+            std::memmove(_base + top, _base + *off, len);
+            *off = top;
+        }
+        *_low = top;
+    }
+
+private:
+    u32 slotSize() {
+        return _heads ? 2 * sizeof(u32) : sizeof(u32);
+    }
+    u32 gap() {
+        return *_low - (u32)((char *)(_slots + *_size) - _base) - 
+            (_heads ? *_size * sizeof(u32) : 0);
+    }
+    void reserve(u32 need) {
+        if(gap() < need) {
+            compact();
+        }
+        assert(gap() >= need);
+    }
+
+    char *_base{nullptr};
+    u32  _cap{0};
+    u32  *_slots{nullptr};
+    u32  *_low{nullptr};
+    u32  *_size{nullptr};
+    u32  *_bytes{nullptr};
+    u32  *_high{nullptr};
+    u32  *_prefix{nullptr};
+    bool _heads{false};
+    std::string _buf;
+};
+
+}// namespace bptdb
+
+#endif
@@ -0,0 +1,9 @@
+#include "Snapshot.h"
+#include "SnapshotManager.h"
+
+namespace bptdb {
+
+Snapshot::Snapshot()  = default;
+Snapshot::~Snapshot() = default;
+
+}// namespace bptdb
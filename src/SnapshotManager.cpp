@@ -0,0 +1,188 @@
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include "PageCache.h"
+#include "SnapshotManager.h"
+
+namespace bptdb {
+
+std::unique_ptr<SnapshotManager> g_snap;
+
+thread_local u64 SnapshotManager::t_seq = 0;
+thread_local u32 SnapshotManager::t_depth = 0;
+
+SnapshotManager::SnapshotManager(std::string path): 
+    _shards(SHARDS), _path(std::move(path)) {}
+
+SnapshotManager::~SnapshotManager() {
+    if(_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+u64 SnapshotManager::take() {
+    // new changes hold off, the ones going on run to the end.
+    _taking.store(true);
+    std::unique_lock gate(_gate);
+    std::lock_guard lg(_mtx);
+    u64 seq = ++_seq;
+    _live.insert(seq);
+    _latest.store(seq, std::memory_order_release);
+    _taking.store(false);
+    return seq;
+}
+
+void SnapshotManager::release(u64 seq) {
+    std::lock_guard lg(_mtx);
+    _live.erase(_live.find(seq));
+    _latest.store(_live.empty() ? 0 : *_live.rbegin(),
+            std::memory_order_release);
+    collect();
+}
+
+// an image of tag t after tag p is read by snapshots in (p, t].
+void SnapshotManager::collect() {
+    for(auto &sh: _shards) {
+        std::lock_guard lg(sh.mtx);
+        for(auto it = sh.images.begin(); it != sh.images.end();) {
+            auto &imgs = it->second;
+            u64 prev = 0;
+            for(auto img = imgs.begin(); img != imgs.end();) {
+                auto reader = _live.upper_bound(prev);
+                prev = img->first;
+                if(reader == _live.end() || *reader > img->first) {
+                    drop(img->second);
+                    img = imgs.erase(img);
+                }else {
+                    ++img;
+                }
+            }
+            it = imgs.empty() ? sh.images.erase(it) : std::next(it);
+        }
+    }
+}
+
+void SnapshotManager::keep(pgid_t id, void *data, u64 &kept) {
+    u64 latest = _latest.load(std::memory_order_acquire);
+    if(!latest || kept >= latest) {
+        return;
+    }
+    kept = latest;
+    auto &sh = shard(id);
+    std::lock_guard lg(sh.mtx);
+    // a frame loaded again forgets its tag. an image not older than latest
+    // is the page before the first change since latest, it stays.
+    auto &imgs = sh.images[id];
+    if(!imgs.empty() && imgs.rbegin()->first >= latest) {
+        return;
+    }
+    imgs.emplace(latest, store(data));
+}
+
+SnapshotManager::Image SnapshotManager::store(void *data) {
+    Image img;
+    u64 size = g_option.page_size;
+    auto limit = g_option.snapshot_memory;
+    if(_bytes.fetch_add(size) + size <= limit) {
+        img.data.assign((char *)data, size);
+        return img;
+    }
+    _bytes.fetch_sub(size);
+    std::lock_guard lg(_spill_mtx);
+    if(_fd < 0) {
+        // no one else opens it, and it goes with the last close.
+        auto path = _path + "-snap";
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(_fd >= 0);
+        ::unlink(path.c_str());
+    }
+    if(_free.empty()) {
+        img.slot = _slots++;
+    }else {
+        img.slot = _free.back();
+        _free.pop_back();
+    }
+    auto n = ::pwrite(_fd, data, size, img.slot * size);
+    assert(n == (ssize_t)size);
+    (void)n;
+    return img;
+}
+
+void SnapshotManager::drop(Image &img) {
+    if(!img.data.empty()) {
+        _bytes.fetch_sub(img.data.size());
+        return;
+    }
+    std::lock_guard lg(_spill_mtx);
+    _free.push_back(img.slot);
+}
+
+void SnapshotManager::read(pgid_t id, u64 seq, char *buf) {
+    // a writer keeps the image and changes the page under the latch.
+    auto pg = g_pc->pin(id);
+    pg->latch().lock_shared();
+    if(!image(id, seq, buf)) {
+        std::memcpy(buf, pg->data(), g_option.page_size);
+    }
+    pg->latch().unlock_shared();
+    g_pc->unpin(pg);
+}
+
+bool SnapshotManager::image(pgid_t id, u64 seq, char *buf) {
+    auto &sh = shard(id);
+    std::lock_guard lg(sh.mtx);
+    auto it = sh.images.find(id);
+    if(it == sh.images.end()) {
+        return false;
+    }
+    auto img = it->second.lower_bound(seq);
+    if(img == it->second.end()) {
+        return false;
+    }
+    if(!img->second.data.empty()) {
+        std::memcpy(buf, img->second.data.data(), g_option.page_size);
+        return true;
+    }
+    auto n = ::pread(_fd, buf, g_option.page_size, 
+            img->second.slot * g_option.page_size);
+    assert(n == (ssize_t)g_option.page_size);
+    (void)n;
+    return true;
+}
+
+WriteScope::WriteScope() {
+    if(SnapshotManager::t_depth++ || !g_snap) {
+        return;
+    }
+    _mgr = g_snap.get();
+    while(_mgr->_taking.load()) {
+        std::this_thread::yield();
+    }
+    _mgr->_gate.lock_shared();
+}
+
+WriteScope::~WriteScope() {
+    SnapshotManager::t_depth--;
+    if(_mgr) {
+        _mgr->_gate.unlock_shared();
+    }
+}
+
+SnapshotScope::SnapshotScope(u64 seq) {
+    _prev = SnapshotManager::t_seq;
+    SnapshotManager::t_seq = seq;
+}
+
+SnapshotScope::~SnapshotScope() {
+    SnapshotManager::t_seq = _prev;
+}
+
+SnapshotRef::~SnapshotRef() {
+    if(g_snap) {
+        g_snap->release(_seq);
+    }
+}
+
+}// namespace bptdb
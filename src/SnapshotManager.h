@@ -0,0 +1,118 @@
+#ifndef __SNAPSHOT_MANAGER_H
+#define __SNAPSHOT_MANAGER_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+
+namespace bptdb {
+
+// snapshots by copy on write of pages. a snapshot is a sequence number,
+// taken when no change to any tree is halfway. the first write to a page
+// after a snapshot keeps the content before it, tagged with the newest
+// snapshot. a snapshot s reads the image of least tag not below s, or the
+// page itself if there is none, it is not changed since s then. images
+// over option.snapshot_memory go to a file beside the db, gone at close.
+class SnapshotManager {
+public:
+    SnapshotManager(std::string path);
+    ~SnapshotManager();
+    // a new snapshot, waits for the changes going on.
+    u64 take();
+    void release(u64 seq);
+    bool active() {
+        return _latest.load(std::memory_order_acquire) != 0;
+    }
+    // keep data of page id if no image is kept since the newest snapshot,
+    // kept is the tag kept last. caller holds the page latch exclusive.
+    void keep(pgid_t id, void *data, u64 &kept);
+    // page id as snapshot seq sees it.
+    void read(pgid_t id, u64 seq, char *buf);
+
+    // the snapshot read by this thread, 0 if none.
+    static u64 current() {
+        return t_seq;
+    }
+private:
+    friend class WriteScope;
+    friend class SnapshotScope;
+    // the page in data, or at slot of the file if data is empty.
+    struct Image {
+        std::string data;
+        u64 slot{0};
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<pgid_t, std::map<u64, Image>> images;
+    };
+    Shard &shard(pgid_t id) {
+        return _shards[id % SHARDS];
+    }
+    // the image of page id for snapshot seq, false if none.
+    bool image(pgid_t id, u64 seq, char *buf);
+    // drop images no snapshot reads.
+    void collect();
+    // image of data in memory, or in the file once over the limit.
+    Image store(void *data);
+    void drop(Image &img);
+
+    static constexpr u32 SHARDS = 64;
+    static thread_local u64 t_seq;
+    static thread_local u32 t_depth; // nested WriteScope
+
+    std::mutex _mtx;
+    u64 _seq{0};
+    std::multiset<u64> _live;
+    std::atomic<u64> _latest{0};    // newest live snapshot
+    std::shared_mutex _gate;        // shared by changes, exclusive by take
+    std::atomic_bool  _taking{false};
+    std::vector<Shard> _shards;
+
+    std::string _path;
+    std::atomic<u64> _bytes{0};     // of images in memory
+    std::mutex _spill_mtx;          // after the one of a shard, if both
+    int _fd{-1};                    // opened at the first spill
+    u64 _slots{0};
+    std::vector<u64> _free;
+};
+
+// held by each change to trees, no snapshot is taken halfway of it.
+class WriteScope {
+public:
+    WriteScope();
+    ~WriteScope();
+private:
+    SnapshotManager *_mgr{nullptr}; // gate held by the outmost one
+};
+
+// page reads of this thread in scope see snapshot seq, none if 0.
+class SnapshotScope {
+public:
+    SnapshotScope(u64 seq);
+    ~SnapshotScope();
+private:
+    u64 _prev{0};
+};
+
+// a live snapshot, released when the last user goes.
+class SnapshotRef {
+public:
+    SnapshotRef(u64 seq): _seq(seq) {}
+    ~SnapshotRef();
+    u64 seq() { return _seq; }
+private:
+    u64 _seq{0};
+};
+
+extern std::unique_ptr<SnapshotManager> g_snap;
+
+}// namespace bptdb
+
+#endif
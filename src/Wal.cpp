@@ -0,0 +1,454 @@
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "FileManager.h"
+#include "Page.h"
+#include "PageCache.h"
+#include "Wal.h"
+
+namespace bptdb {
+
+std::unique_ptr<Wal> g_wal;
+
+namespace {
+
+constexpr u32 WAL_MAGIC = 0x4c415742; // "BWAL"
+
+struct RecordHeader {
+    u32 magic;
+    u32 count;     ///< page images follow
+    u64 lsn;       ///< end of this record
+    u32 checksum;  ///< crc32 of page images
+    u32 pad;
+};
+
+u32 crc32(const char *data, std::size_t len) {
+    static u32 table[256] = {0};
+    static bool init = [] {
+        for (u32 i = 0; i < 256; i++) {
+            u32 c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)init;
+    u32 crc = 0xffffffff;
+    for (std::size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ (u8)data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+}
+
+// false if the log cannot be written.
+bool writeAll(int fd, const char *buf, std::size_t len) {
+    while (len > 0) {
+        auto n = ::write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+thread_local Wal::Txn t_txn;
+thread_local Wal::Txn t_top;
+thread_local Wal::Txn *t_cur = &t_txn; // where logPage goes
+
+}// namespace
+
+Wal::Wal(std::string path, CommitMode mode, u64 limit) {
+    _fd = ::open((path + "-wal").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    assert(_fd >= 0);
+    _mode = mode;
+    _limit = limit;
+}
+
+Wal::~Wal() {
+    ::close(_fd);
+}
+
+void Wal::replay(std::string path) {
+    auto logpath = path + "-wal";
+    int fd = ::open(logpath.c_str(), O_RDWR);
+    if (fd < 0) {
+        return;
+    }
+    std::string log;
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+        log.append(buf, n);
+    }
+
+    u32 imgsize = sizeof(pgid_t) + g_option.page_size;
+    std::size_t pos = 0;
+    u32 applied = 0;
+    while (pos + sizeof(RecordHeader) <= log.size()) {
+        auto rec = (RecordHeader *)(log.data() + pos);
+        auto body = log.data() + pos + sizeof(RecordHeader);
+        std::size_t len = (std::size_t)rec->count * imgsize;
+        // a torn record at the tail, drop it and all after.
+        if (rec->magic != WAL_MAGIC ||
+                pos + sizeof(RecordHeader) + len > log.size() ||
+                crc32(body, len) != rec->checksum) {
+            break;
+        }
+        for (u32 i = 0; i < rec->count; i++) {
+            auto id = *(pgid_t *)(body + i * imgsize);
+            g_fm->write(body + i * imgsize + sizeof(pgid_t),
+                    g_option.page_size, page2off(id));
+        }
+        pos += sizeof(RecordHeader) + len;
+        applied++;
+    }
+    DEBUGOUT("wal replay %u records", applied);
+    g_fm->sync();
+    int ret = ::ftruncate(fd, 0);
+    assert(ret == 0);
+    (void)ret;
+    ::close(fd);
+}
+
+void Wal::remove(std::string path) {
+    ::unlink((path + "-wal").c_str());
+}
+
+bool Wal::pending(std::string path) {
+    struct stat st;
+    return ::stat((path + "-wal").c_str(), &st) == 0 && st.st_size > 0;
+}
+
+void Wal::start() {
+    _f = std::async(std::launch::async, [this] { run(); });
+    _cf = std::async(std::launch::async, [this] { checkpointer(); });
+}
+
+void Wal::stop() {
+    // the checkpointer syncs by the flusher, it goes first.
+    {
+        std::lock_guard lg(_mtx);
+        _closing = true;
+    }
+    _full_cv.notify_one();
+    _cf.get();
+    {
+        std::lock_guard lg(_mtx);
+        _stop = true;
+    }
+    _cv.notify_one();
+    _f.get();
+    // pages of records not durable were never written, the log is kept
+    // for them, replay brings back all those durable.
+    if (_failed) {
+        return;
+    }
+    // every page is on disk by now.
+    g_fm->sync();
+    int ret = ::ftruncate(_fd, 0);
+    assert(ret == 0);
+    (void)ret;
+}
+
+void Wal::begin(bool alone) {
+    if (t_txn.depth == 0) {
+        alone ? _solo.lock() : _solo.lock_shared();
+        t_txn.alone = alone;
+    }
+    open(t_txn, true);
+}
+
+bool Wal::commit() {
+    bool last = t_txn.depth == 1;
+    bool alone = t_txn.alone;
+    bool ok = close(t_txn);
+    if (last) {
+        alone ? _solo.unlock() : _solo.unlock_shared();
+    }
+    return ok;
+}
+
+void Wal::beginTop() {
+    // the enclosing txn holds the gate already.
+    open(t_top, t_txn.depth == 0);
+    t_cur = &t_top;
+}
+
+void Wal::commitTop() {
+    close(t_top);
+    if (t_top.depth == 0) {
+        t_cur = &t_txn;
+    }
+}
+
+bool Wal::inTxn() {
+    return t_txn.depth > 0;
+}
+
+bool Wal::inRecord() {
+    return t_cur->depth > 0;
+}
+
+void Wal::afterCommit(std::function<void()> fn) {
+    assert(t_txn.depth > 0);
+    t_txn.after.push_back(std::move(fn));
+}
+
+void Wal::open(Txn &txn, bool gate) {
+    if (txn.depth++ > 0) {
+        return;
+    }
+    if (gate) {
+        while (_pausing.load()) {
+            std::this_thread::yield();
+        }
+        _gate.lock_shared();
+    }
+    txn.gated = gate;
+    txn.mark = std::make_shared<WalMark>();
+}
+
+bool Wal::close(Txn &txn) {
+    assert(txn.depth > 0);
+    if (--txn.depth > 0) {
+        return true;
+    }
+    u64 lsn = 0;
+    if (!txn.pages.empty()) {
+        // the txns wrote our pages before must come first in log.
+        if (!txn.deps.empty()) {
+            std::unique_lock lg(_mtx);
+            for (auto &dep: txn.deps) {
+                _done_cv.wait(lg, [&dep] { return dep->lsn.load() != 0; });
+            }
+        }
+        lsn = append(txn);
+    }
+    auto after = std::move(txn.after);
+    bool gated = txn.gated;
+    txn.pages.clear();
+    txn.deps.clear();
+    txn.after.clear();
+    txn.mark.reset();
+    if (!gated) {
+        return !_failed;
+    }
+    _gate.unlock_shared();
+
+    for (auto &fn: after) {
+        fn();
+    }
+    if (lsn && _mode == CommitMode::sync) {
+        return sync(lsn);
+    }
+    return !_failed;
+}
+
+void Wal::logPage(Page *pg) {
+    auto &txn = *t_cur;
+    // a write out of any txn, log it alone. it holds the gate too, or
+    // checkpoint may cut it off the log before the page is on disk.
+    if (txn.depth == 0) {
+        std::shared_lock gate(_gate);
+        Txn single;
+        single.mark = std::make_shared<WalMark>();
+        single.pages[pg->getId()].assign(
+                (char *)pg->data(), g_option.page_size);
+        pg->setWriter(single.mark);
+        append(single);
+        return;
+    }
+    txn.pages[pg->getId()].assign((char *)pg->data(), g_option.page_size);
+    auto prev = pg->writer();
+    if (prev && prev != txn.mark && prev->lsn.load() == 0) {
+        txn.deps.push_back(prev);
+    }
+    pg->setWriter(txn.mark);
+}
+
+u64 Wal::append(Txn &txn) {
+    // build the record out of lock.
+    std::string body;
+    body.reserve(txn.pages.size() * (sizeof(pgid_t) + g_option.page_size));
+    for (auto &[id, img]: txn.pages) {
+        body.append((char *)&id, sizeof(id));
+        body.append(img);
+    }
+    RecordHeader rec;
+    rec.magic = WAL_MAGIC;
+    rec.count = txn.pages.size();
+    rec.checksum = crc32(body.data(), body.size());
+    rec.pad = 0;
+
+    std::lock_guard lg(_mtx);
+    _end += sizeof(rec) + body.size();
+    rec.lsn = _end;
+    _buf.append((char *)&rec, sizeof(rec));
+    _buf.append(body);
+    txn.mark->lsn.store(_end);
+    _done_cv.notify_all();
+    if (_end - _base > _limit) {
+        _full_cv.notify_one();
+    }
+    return _end;
+}
+
+bool Wal::sync(u64 lsn) {
+    std::unique_lock lg(_mtx);
+    if (_durable >= lsn) {
+        return true;
+    }
+    _want = std::max(_want, lsn);
+    _cv.notify_one();
+    _done_cv.wait(lg, [this, lsn] { return _durable >= lsn || _failed; });
+    return _durable >= lsn;
+}
+
+bool Wal::syncAll() {
+    u64 end;
+    {
+        std::lock_guard lg(_mtx);
+        end = _end;
+    }
+    return sync(end);
+}
+
+bool Wal::failed() {
+    return _failed;
+}
+
+void Wal::checkpoint() {
+    // no txn in flight from here. new ones hold off meanwhile, or they
+    // may keep the gate shared for ever.
+    _pausing.store(true);
+    std::unique_lock gate(_gate);
+    _pausing.store(false);
+    u64 end = 0;
+    {
+        std::lock_guard lg(_mtx);
+        if (_end - _base <= _limit) {
+            return;
+        }
+        end = _end;
+    }
+    DEBUGOUT("wal checkpoint at %lu", end);
+    // the log is kept as it is once it fails, see run().
+    if (!sync(end)) {
+        return;
+    }
+    g_pc->flushAll();
+    g_fm->sync();
+
+    std::lock_guard lg(_mtx);
+    int ret = ::ftruncate(_fd, 0);
+    assert(ret == 0);
+    (void)ret;
+    _base = end;
+}
+
+void Wal::checkpointer() {
+    std::unique_lock lg(_mtx);
+    while (true) {
+        _full_cv.wait(lg, [this] {
+            return _closing || _end - _base > _limit;
+        });
+        if (_closing) {
+            break;
+        }
+        lg.unlock();
+        checkpoint();
+        lg.lock();
+    }
+}
+
+void Wal::run() {
+    DEBUGOUT("Wal start...");
+    std::unique_lock lg(_mtx);
+    while (true) {
+        // async commits are written at least every 10ms.
+        _cv.wait_for(lg, std::chrono::milliseconds(10),
+                [this] { return _stop || (_want > _durable && !_failed); });
+        if (_buf.empty()) {
+            if (_stop) {
+                break;
+            }
+            continue;
+        }
+        // take all records so far, one fsync for all of them.
+        std::string buf;
+        buf.swap(_buf);
+        u64 end = _end;
+        if (_failed) {
+            continue;
+        }
+        lg.unlock();
+        bool ok = writeAll(_fd, buf.data(), buf.size()) &&
+                ::fdatasync(_fd) == 0;
+        lg.lock();
+        // a record failed is never durable, nor any after it. the log
+        // stops here, commits fail from now on and pages of records not
+        // durable never go to the data file.
+        if (!ok) {
+            DEBUGOUT("wal write failed: %s", std::strerror(errno));
+            _failed = true;
+        } else {
+            _durable = end;
+        }
+        _done_cv.notify_all();
+    }
+    DEBUGOUT("Wal stop...");
+}
+
+WalTxn::WalTxn(bool alone) {
+    if (g_wal) {
+        g_wal->begin(alone);
+    }
+}
+
+WalTxn::~WalTxn() {
+    commit();
+}
+
+bool WalTxn::commit() {
+    if (_done) {
+        return _ok;
+    }
+    _done = true;
+    if (g_wal) {
+        _ok = g_wal->commit();
+    }
+    return _ok;
+}
+
+Status WalTxn::commit(Status stat) {
+    if (!commit() && stat.ok()) {
+        return Status(error::logFailed);
+    }
+    return stat;
+}
+
+WalTopAction::WalTopAction() {
+    if (g_wal) {
+        g_wal->beginTop();
+    }
+}
+
+WalTopAction::~WalTopAction() {
+    if (g_wal) {
+        g_wal->commitTop();
+    }
+}
+
+}// namespace bptdb
@@ -0,0 +1,144 @@
+#ifndef __WAL_H
+#define __WAL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "Status.h"
+
+namespace bptdb {
+
+class Page;
+
+// lsn of a txn, 0 until its record is appended to log.
+struct WalMark {
+    std::atomic<u64> lsn{0};
+};
+using WalMarkPtr = std::shared_ptr<WalMark>;
+
+// redo log of page images.
+//
+// all pages written between begin() and the outermost commit() go to log
+// as one record, so a split or merge is replayed all or nothing. records
+// are appended in memory and made durable by a background thread, which
+// fsync once for all the commits waiting at that time.
+//
+// a txn that writes a page last written by a txn not in log yet waits for
+// it at commit, so records of a page are in log as the order of writes.
+// page allocator changes are top actions, logged at once as their own
+// record, they wait only for each other.
+//
+// once log is over its limit a thread of its own checkpoints, it holds
+// no lock of any caller, and new txns hold off till it has the gate.
+//
+// a write or fsync of log failed poisons it, what is durable stays as it
+// is and every commit after fails, the db must be opened again.
+class Wal {
+public:
+    struct Txn {
+        u32 depth{0};
+        bool gated{false};
+        bool alone{false};                   // holds _solo exclusive
+        WalMarkPtr mark;
+        std::map<pgid_t, std::string> pages; // last image of each page
+        std::vector<WalMarkPtr> deps;        // txns wrote our pages before
+        std::vector<std::function<void()>> after; // run once in log
+    };
+
+    Wal(std::string path, CommitMode mode, u64 limit);
+    ~Wal();
+    // apply the records left in log of path to data file.
+    static void replay(std::string path);
+    static void remove(std::string path);
+    // if records may be left in log of path.
+    static bool pending(std::string path);
+    // alone: no other txn runs till commit, for a txn long enough that
+    // its writes may interleave with others' and wait on them in a cycle.
+    void begin(bool alone = false);
+    // false if the log failed, see sync().
+    bool commit();
+    void beginTop();
+    void commitTop();
+    // if the calling thread is in a txn.
+    bool inTxn();
+    // if page writes of the calling thread go to a txn or a top action.
+    bool inRecord();
+    // run fn after the current txn is in log.
+    void afterCommit(std::function<void()> fn);
+    // take image of page, caller must hold the latch exclusive. a write
+    // out of any txn should begin one before the latch, see
+    // PageCache::write.
+    void logPage(Page *pg);
+    // make log durable up to lsn, false if it never will be.
+    bool sync(u64 lsn);
+    // make all records appended so far durable.
+    bool syncAll();
+    bool failed();
+    // write all pages back and empty the log.
+    void checkpoint();
+    void start();
+    void stop();
+private:
+    void open(Txn &txn, bool gate);
+    bool close(Txn &txn);
+    u64 append(Txn &txn);
+    void run();
+    void checkpointer();
+
+    int               _fd{-1};
+    CommitMode        _mode;
+    u64               _limit{0};
+    std::string       _buf;       // records not written yet
+    u64               _end{0};    // lsn of the last record
+    u64               _durable{0};
+    u64               _want{0};   // lsn someone waits to be durable
+    u64               _base{0};   // lsn at offset 0 of log file
+    bool              _stop{false};
+    bool              _closing{false}; // stop the checkpointer
+    std::atomic_bool  _failed{false};  // a write of log failed
+    std::mutex        _mtx;
+    std::condition_variable _cv;       // wake up the flusher
+    std::condition_variable _done_cv;  // wake up the committers
+    std::condition_variable _full_cv;  // wake up the checkpointer
+    std::shared_mutex _gate;      // shared by txns, exclusive by checkpoint
+    std::atomic_bool  _pausing{false}; // checkpoint waits for the gate
+    std::shared_mutex _solo;      // shared by txns, exclusive by one alone
+    std::future<void> _f;
+    std::future<void> _cf;        // the checkpointer
+};
+
+// make the page writes in scope an atomic record of log.
+class WalTxn {
+public:
+    WalTxn(bool alone = false);
+    ~WalTxn();
+    // commit before the end of scope, false if the log failed.
+    bool commit();
+    // stat, or an error if it is ok but the commit failed.
+    Status commit(Status stat);
+private:
+    bool _done{false};
+    bool _ok{true};
+};
+
+// make the page writes in scope a record of log at once, whatever the
+// enclosing txn is.
+class WalTopAction {
+public:
+    WalTopAction();
+    ~WalTopAction();
+};
+
+extern std::unique_ptr<Wal> g_wal;
+
+}// namespace bptdb
+
+#endif
@@ -0,0 +1,21 @@
+#include "WriteBatch.h"
+
+namespace bptdb {
+
+void WriteBatch::put(Bucket &bucket, std::string key, std::string val) {
+    _ops.emplace_back(bucket._impl, Op{false, std::move(key), std::move(val)});
+}
+
+void WriteBatch::del(Bucket &bucket, std::string key) {
+    _ops.emplace_back(bucket._impl, Op{true, std::move(key), std::string()});
+}
+
+void WriteBatch::clear() {
+    _ops.clear();
+}
+
+std::size_t WriteBatch::size() {
+    return _ops.size();
+}
+
+}// namespace bptdb
@@ -0,0 +1,36 @@
+#ifndef __WRITE_BATCH_H
+#define __WRITE_BATCH_H
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "Bucket.h"
+
+namespace bptdb {
+
+class Bptree;
+
+// puts and dels on any buckets, applied as a whole by DB::write.
+// put overwrites the key if it is there, del of a key not there does
+// nothing, so a batch never fails half way.
+class WriteBatch {
+public:
+    struct Op {
+        bool del;
+        std::string key;
+        std::string val;
+    };
+    void put(Bucket &bucket, std::string key, std::string val);
+    void del(Bucket &bucket, std::string key);
+    void clear();
+    std::size_t size();
+private:
+    friend class DBImpl;
+    std::vector<std::tuple<std::shared_ptr<Bptree>, Op>> _ops;
+};
+
+}// namespace bptdb
+
+#endif
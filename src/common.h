@@ -34,6 +34,11 @@ namespace error {
     constexpr const char *DbCreatFailed = "DataBase create failed";
     constexpr const char *keyNotFind = "Key not find";
     constexpr const char *bucketTypeErr = "bucket keytype or valuetype error";
+    constexpr const char *keyNotSorted = "keys of bulk load not in order";
+    constexpr const char *readOnly = "bucket is read only";
+    constexpr const char *needWrite = "db needs recovery or upgrade, open it writable";
+    constexpr const char *noSnapshot = "snapshot not taken";
+    constexpr const char *logFailed = "write of log failed, open the db again";
 }// namespace error
 
 struct BptreeMeta {
@@ -47,5 +52,13 @@ static inline u32 byte2page(u32 bytes) {
     return (bytes + g_option.page_size - 1) / g_option.page_size;
 }
 
+// file offset of page, in 64 bits.
+static inline u64 page2off(pgid_t id) {
+    return (u64)id * g_option.page_size;
+}
+
+// alignment of buffers, lengths and offsets for O_DIRECT.
+constexpr u32 DIRECT_ALIGN = 4096;
+
 }// namespace bptdb
 #endif
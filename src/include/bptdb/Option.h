@@ -9,10 +9,70 @@ namespace bptdb {
 
 using comparator_t = std::function<bool(std::string_view, std::string_view)>;
 
+// the records of a bucket. a typed one has keys of keysize bytes and vals
+// of valsize, packed in leaves with no length of each, keys sort as bytes.
+// of any length if 0, the default.
+struct BucketType {
+    std::uint32_t keysize{0};
+    std::uint32_t valsize{0};
+    bool typed() const { return keysize != 0; }
+    bool operator==(const BucketType &t) const {
+        return keysize == t.keysize && valsize == t.valsize;
+    }
+};
+
+enum class CommitMode {
+    none,  ///< no log, dirty pages are written back every 10 seconds
+    async, ///< log is made durable in background, within about 10ms
+    sync,  ///< a write returns after its log is durable
+};
+
+// how PageCache picks the page to evict.
+enum class CachePolicy {
+    lru,   ///< strict lru, a scan flushes out the hot pages
+    clock, ///< second chance
+    twoq,  ///< 2Q, pages seen once never push out the hot ones
+    arc,   ///< ARC on clocks, adapts between recency and frequency
+};
+
+// how a lookup goes down the inner nodes of b+tree.
+enum class LatchMode {
+    pessimistic, ///< latch every node shared, release the parent after
+    optimistic,  ///< no latch, check the version of node and retry
+};
+
+// how put and del change the shape of b+tree.
+enum class SplitMode {
+    coupled, ///< latch from the root down to the highest node changed
+    blink,   ///< latch only the nodes changed, split nodes are found by
+             ///< their right link, del never merges
+};
+
+// how pages are read and written in batches, by prefetch and write back.
+enum class IoBackend {
+    threads, ///< a pool of threads, one blocking call each at a time
+    uring,   ///< io_uring, threads if the kernel has none
+};
+
 struct Option {
     std::uint32_t page_size{4096};
     std::uint32_t max_buffer_pages{8192};
     bool sync{false};
+    CommitMode commit_mode{CommitMode::none};
+    std::uint64_t wal_limit{64 << 20}; ///< checkpoint when log is larger
+    CachePolicy cache_policy{CachePolicy::lru};
+    LatchMode latch_mode{LatchMode::pessimistic};
+    SplitMode split_mode{SplitMode::coupled};
+    std::uint32_t scan_readahead{16}; ///< leaves an iterator reads ahead
+    bool read_only{false}; ///< map the file, nodes are read in place, no write
+    IoBackend io_backend{IoBackend::uring};
+    std::uint32_t io_depth{32}; ///< io in flight at most
+    bool direct_io{false}; ///< O_DIRECT for io aligned to 4096 bytes
+    std::uint32_t compact_batch{64}; ///< nodes compact moves at a time
+    std::uint32_t compact_pause{1}; ///< ms compact waits between batches
+    std::uint32_t blob_size{1024}; ///< longer values go to pages of their own, 0 never
+    std::uint32_t max_nodes{1 << 16}; ///< node objects a tree keeps, about
+    std::uint64_t snapshot_memory{64 << 20}; ///< images of snapshots in memory, more go to a file
 };
 
 }// namespace bptdb
@@ -0,0 +1,23 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <memory>
+
+namespace bptdb {
+
+class SnapshotRef;
+
+// a point in time view of db, see DB::snapshot(). copies share it, it
+// is released when the last one goes.
+class Snapshot {
+public:
+    Snapshot();
+    ~Snapshot();
+private:
+    friend class DBImpl;
+    std::shared_ptr<SnapshotRef> _ref;
+};
+
+}// namespace bptdb
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef __TYPED_BUCKET_H
+#define __TYPED_BUCKET_H
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "Option.h"
+#include "Status.h"
+#include "Bucket.h"
+
+namespace bptdb {
+
+// a bucket of keys of integer type K and vals of type V, copied as their
+// bytes. leaves keep records of fixed size with no length of each and
+// search keys as numbers, see BucketType. get one by DB::createBucket<K, V>
+// and DB::getBucket<K, V>, opening it by another type fails with
+// bucketTypeErr.
+template <typename K, typename V>
+class TypedBucket {
+    static_assert(std::is_integral_v<K> && !std::is_same_v<K, bool>, 
+                  "keys are integers");
+    static_assert(std::is_trivially_copyable_v<V>, "vals are copied as bytes");
+public:
+    class Iterator {
+    public:
+        Iterator() = default;
+        Iterator(std::shared_ptr<IteratorBase> it): _it(it) {}
+        K key() { return decode(_it->key()); }
+        V val() { return load(_it->val()); }
+        bool done() { return _it->done(); }
+        void next() { _it->next(); }
+        void prev() { _it->prev(); }
+    private:
+        std::shared_ptr<IteratorBase> _it;
+    };
+
+    TypedBucket() = default;
+    TypedBucket(Bucket bucket): _bucket(bucket) {}
+
+    static BucketType type() {
+        return BucketType{(std::uint32_t)sizeof(K), 
+                          (std::uint32_t)sizeof(V)};
+    }
+
+    std::tuple<Status, V> get(K key) {
+        auto k = encode(key);
+        auto [stat, val] = _bucket.get(k);
+        return std::make_tuple(stat, stat.ok() ? load(val) : V());
+    }
+    // results are in order of keys.
+    std::vector<std::tuple<Status, V>> multiGet(const std::vector<K> &keys) {
+        std::vector<std::string> ks;
+        for(auto key: keys) {
+            ks.push_back(encode(key));
+        }
+        std::vector<std::tuple<Status, V>> rets;
+        for(auto &[stat, val]: _bucket.multiGet(ks)) {
+            rets.emplace_back(stat, stat.ok() ? load(val) : V());
+        }
+        return rets;
+    }
+    Status put(K key, const V &val) {
+        auto k = encode(key);
+        auto v = bytes(val);
+        return _bucket.put(k, v);
+    }
+    Status update(K key, const V &val) {
+        auto k = encode(key);
+        auto v = bytes(val);
+        return _bucket.update(k, v);
+    }
+    Status del(K key) {
+        auto k = encode(key);
+        return _bucket.del(k);
+    }
+
+    Iterator begin() {
+        return Iterator(_bucket.begin());
+    }
+    // at the first key not less than key.
+    Iterator seek(K key) {
+        auto k = encode(key);
+        return Iterator(_bucket.seek(k));
+    }
+    Iterator last() {
+        return Iterator(_bucket.last());
+    }
+    // keys in [lower, upper), from the first, or from the last if reverse.
+    Iterator range(K lower, K upper, bool reverse = false) {
+        auto l = encode(lower), u = encode(upper);
+        return Iterator(_bucket.range(l, u, reverse));
+    }
+
+    // the bucket of bytes under it, for WriteBatch.
+    Bucket &bucket() {
+        return _bucket;
+    }
+
+    // key as big endian bytes, the sign bit flipped, which sort as the
+    // numbers do.
+    static std::string encode(K key) {
+        using U = std::make_unsigned_t<K>;
+        U u = (U)key;
+        if constexpr(std::is_signed_v<K>) {
+            u ^= U(1) << (sizeof(K) * 8 - 1);
+        }
+        std::string ret(sizeof(K), 0);
+        for(int i = sizeof(K) - 1; i >= 0; i--) {
+            ret[i] = (char)(u & 0xff);
+            u = U(u >> 8);
+        }
+        return ret;
+    }
+    static K decode(std::string_view bytes) {
+        using U = std::make_unsigned_t<K>;
+        U u = 0;
+        for(std::size_t i = 0; i < sizeof(K); i++) {
+            u = U(u << 8) | (unsigned char)bytes[i];
+        }
+        if constexpr(std::is_signed_v<K>) {
+            u ^= U(1) << (sizeof(K) * 8 - 1);
+        }
+        return (K)u;
+    }
+    static std::string bytes(const V &val) {
+        return std::string((const char *)&val, sizeof(V));
+    }
+    static V load(std::string_view bytes) {
+        V val;
+        std::memcpy((void *)&val, bytes.data(), sizeof(V));
+        return val;
+    }
+
+private:
+    Bucket _bucket;
+};
+
+}// namespace bptdb
+
+#endif
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TestHelper.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_blob_test.db";
+
+static string key(int i) {
+    return "key" + to_string(1000 + i);
+}
+
+// every other val is long enough to go to pages of its own.
+static string val(int i, int round) {
+    return string(i % 2 ? 30 : 3000 + i % 5 * 1000, 'a' + (i + round) % 26);
+}
+
+// put, update in place and with a new size, del, then reopen.
+static void putUpdateDel(uint32_t blob_size) {
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 64;
+    option.blob_size = blob_size;
+    map<string, string> ref;
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.createBucket("b");
+        ASSERT_TRUE(stat.ok());
+        for (int i = 0; i < 1000; i++) {
+            auto k = key(i), v = val(i, 0);
+            ASSERT_TRUE(bucket.put(k, v).ok());
+            ref[k] = v;
+        }
+        check(bucket, ref);
+        for (int i = 0; i < 1000; i++) {
+            auto k = key(i);
+            // every third val changes size, the rest keep theirs.
+            auto v = i % 3 ? val(i, 1) : val(i + 2, 1);
+            ASSERT_TRUE(bucket.update(k, v).ok());
+            ref[k] = v;
+        }
+        check(bucket, ref);
+        for (int i = 0; i < 1000; i += 4) {
+            auto k = key(i);
+            ASSERT_TRUE(bucket.del(k).ok());
+            ref.erase(k);
+        }
+        check(bucket, ref);
+    }
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket("b");
+    ASSERT_TRUE(stat.ok());
+    check(bucket, ref);
+    removeDb(path);
+}
+
+TEST(BlobTest, PutUpdateDel)
+{
+    putUpdateDel(1024);
+}
+
+TEST(BlobTest, NoBlobs)
+{
+    // 0 keeps every val in the leaves.
+    putUpdateDel(0);
+}
+
+TEST(BlobTest, DelFreesPages)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 64;
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+    auto [stat, bucket] = db.createBucket("b");
+    ASSERT_TRUE(stat.ok());
+    auto v = string(8000, 'x');
+    for (int i = 0; i < 500; i++) {
+        auto k = key(i);
+        ASSERT_TRUE(bucket.put(k, v).ok());
+    }
+    auto size = fileSize(path);
+    // the pages of deleted vals take the vals put after.
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < 500; i++) {
+            auto k = key(i);
+            ASSERT_TRUE(bucket.del(k).ok());
+        }
+        for (int i = 0; i < 500; i++) {
+            auto k = key(i);
+            ASSERT_TRUE(bucket.put(k, v).ok());
+        }
+    }
+    ASSERT_LT(fileSize(path), size * 3 / 2);
+    removeDb(path);
+}
+
+TEST(BlobTest, IterateWhileUpdating)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 512;
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+    auto [stat, bucket] = db.createBucket("b");
+    ASSERT_TRUE(stat.ok());
+    for (int i = 0; i < 500; i++) {
+        auto k = key(i), v = string(5000, 'a');
+        ASSERT_TRUE(bucket.put(k, v).ok());
+    }
+    // a val read by an iterator is one whole val, never parts of two.
+    atomic_bool stop{false};
+    vector<thread> writers;
+    for (int t = 0; t < 2; t++) {
+        writers.emplace_back([&, t] {
+            for (int round = 0; !stop; round++) {
+                size_t len = round % 3 ? 5000 : 9000 + round % 5000;
+                auto v = string(len, 'a' + round % 26);
+                for (int i = t; i < 500; i += 2) {
+                    auto k = key(i);
+                    ASSERT_TRUE(bucket.update(k, v).ok());
+                }
+            }
+        });
+    }
+    for (int n = 0; n < 30; n++) {
+        size_t count = 0;
+        for (auto it = bucket.begin(); !it->done(); it->next()) {
+            auto v = it->val();
+            ASSERT_GE(v.size(), 5000u);
+            ASSERT_EQ(v.find_first_not_of(v[0]), string::npos);
+            count++;
+        }
+        ASSERT_EQ(count, 500u);
+    }
+    stop = true;
+    for (auto &t: writers) {
+        t.join();
+    }
+    removeDb(path);
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include "TestHelper.h"
+#include "../src/common.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_bulk_test.db";
+
+static string key(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%07d", i);
+    return buf;
+}
+
+// every 10th val goes to pages of its own.
+static string val(int i) {
+    return string(i % 10 ? 10 + i % 90 : 2000 + i % 7 * 1500, 'a' + i % 26);
+}
+
+static BulkSource source(map<string, string> &ref) {
+    auto it = make_shared<map<string, string>::iterator>(ref.begin());
+    return [&ref, it](string &k, string &v) {
+        if (*it == ref.end()) {
+            return false;
+        }
+        k = (*it)->first;
+        v = (*it)->second;
+        ++*it;
+        return true;
+    };
+}
+
+TEST(BulkLoadTest, LongValsThenWrites)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 64;
+    map<string, string> ref;
+    for (int i = 0; i < 20000; i += 2) {
+        ref[key(i)] = val(i);
+    }
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.bulkLoadBucket("bulk", source(ref), 70);
+        ASSERT_TRUE(stat.ok());
+        check(bucket, ref);
+        // the nodes loaded split, shrink and have their vals moved.
+        for (int i = 1; i < 20000; i += 4) {
+            auto k = key(i), v = val(i);
+            ASSERT_TRUE(bucket.put(k, v).ok());
+            ref[k] = v;
+        }
+        for (int i = 0; i < 20000; i += 6) {
+            auto k = key(i);
+            ASSERT_TRUE(bucket.del(k).ok());
+            ref.erase(k);
+        }
+        for (int i = 10; i < 20000; i += 20) {
+            auto k = key(i), v = val(i + 3);
+            if (ref.count(k)) {
+                ASSERT_TRUE(bucket.update(k, v).ok());
+                ref[k] = v;
+            }
+        }
+        check(bucket, ref);
+    }
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket("bulk");
+    ASSERT_TRUE(stat.ok());
+    check(bucket, ref);
+    removeDb(path);
+}
+
+TEST(BulkLoadTest, KeysNotSorted)
+{
+    removeDb(path);
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE).ok());
+    int n = 0;
+    auto [stat, bucket] = db.bulkLoadBucket("bad", [&](string &k, string &v) {
+        if (n == 100) {
+            return false;
+        }
+        // one key out of place.
+        k = key(n == 50 ? 10 : n);
+        v = val(n++);
+        return true;
+    });
+    ASSERT_EQ(stat.getErrmsg(), error::keyNotSorted);
+    // no bucket is made.
+    ASSERT_FALSE(get<0>(db.getBucket("bad")).ok());
+    removeDb(path);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include "TestHelper.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_compact_test.db";
+
+static string key(int i) {
+    return "key" + to_string(i * 7919 % 100003);
+}
+
+// b0 has long vals on pages of their own, b1 is made after it. most of
+// b0 is deleted, so free pages lie before the nodes of b1.
+static void fill(DB &db, map<string, string> (&ref)[2]) {
+    for (int b = 0; b < 2; b++) {
+        auto [stat, bucket] = db.createBucket("b" + to_string(b));
+        ASSERT_TRUE(stat.ok());
+        for (int i = 0; i < (b ? 20000 : 2000); i++) {
+            auto k = key(i);
+            auto v = string(b ? 30 : 3000, 'a' + i % 26);
+            ASSERT_TRUE(bucket.put(k, v).ok());
+            ref[b][k] = v;
+        }
+    }
+    auto [stat, bucket] = db.getBucket("b0");
+    ASSERT_TRUE(stat.ok());
+    for (int i = 0; i < 2000; i++) {
+        if (i % 10) {
+            auto k = key(i);
+            ASSERT_TRUE(bucket.del(k).ok());
+            ref[0].erase(k);
+        }
+    }
+}
+
+TEST(CompactTest, ShrinkKeepsData)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 128;
+    option.commit_mode = CommitMode::async;
+    map<string, string> ref[2];
+    uint64_t before, after;
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        fill(db, ref);
+    }
+    before = fileSize(path);
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, false, option).ok());
+        auto [s0, b0] = db.getBucket("b0");
+        auto [s1, b1] = db.getBucket("b1");
+        ASSERT_TRUE(s0.ok() && s1.ok());
+        ASSERT_TRUE(db.compact(0, true).ok());
+        check(b0, ref[0]);
+        check(b1, ref[1]);
+        // writes after reuse the free pages left.
+        for (int i = 0; i < 20000; i += 10) {
+            auto k = key(i) + "x", v = string("new");
+            ASSERT_TRUE(b0.put(k, v).ok());
+            ref[0][k] = v;
+        }
+    }
+    after = fileSize(path);
+    ASSERT_LT(after, before / 2);
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    for (int b = 0; b < 2; b++) {
+        auto [stat, bucket] = db.getBucket("b" + to_string(b));
+        ASSERT_TRUE(stat.ok());
+        check(bucket, ref[b]);
+    }
+    removeDb(path);
+}
+
+TEST(CompactTest, BucketNotOpenedIsLeft)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 128;
+    map<string, string> ref[2];
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        fill(db, ref);
+    }
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    // b1 is never opened, its comparator is not known, it stays as it is.
+    auto [s0, b0] = db.getBucket("b0");
+    ASSERT_TRUE(s0.ok());
+    ASSERT_TRUE(db.compact(0, true).ok());
+    check(b0, ref[0]);
+    auto [s1, b1] = db.getBucket("b1");
+    ASSERT_TRUE(s1.ok());
+    check(b1, ref[1]);
+    removeDb(path);
+}
+
+TEST(CompactTest, InBudget)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 128;
+    option.compact_batch = 8;
+    option.compact_pause = 0;
+    map<string, string> ref[2];
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+    fill(db, ref);
+    auto [s0, b0] = db.getBucket("b0");
+    auto [s1, b1] = db.getBucket("b1");
+    ASSERT_TRUE(s0.ok() && s1.ok());
+    // a few nodes at a time, the data is whole after each.
+    for (int n = 0; n < 20; n++) {
+        ASSERT_TRUE(db.compact(10).ok());
+        auto k = key(n) + "y", v = string("y");
+        ASSERT_TRUE(b1.put(k, v).ok());
+        ref[1][k] = v;
+    }
+    check(b0, ref[0]);
+    check(b1, ref[1]);
+    removeDb(path);
+}
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "TestHelper.h"
+#include "../src/SlotDir.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_cmp_test.db";
+
+// numbers in decimal, shorter first, so not the order of bytes.
+struct ByLength {
+    bool operator()(string_view a, string_view b) const {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    }
+};
+
+using Ref = map<string, string, ByLength>;
+
+// keys of ref in [lower, upper) one way, then the other by prev().
+static void checkRange(Bucket &bucket, Ref &ref, string lower, string upper) {
+    auto lo = ref.lower_bound(lower), hi = ref.lower_bound(upper);
+    auto it = bucket.range(lower, upper);
+    for (auto i = lo; i != hi; ++i) {
+        ASSERT_FALSE(it->done()) << lower << " " << upper;
+        ASSERT_EQ(it->key(), i->first);
+        it->next();
+    }
+    ASSERT_TRUE(it->done()) << lower << " " << upper;
+    auto back = bucket.range(lower, upper, true);
+    for (auto i = hi; i != lo; ) {
+        --i;
+        ASSERT_FALSE(back->done()) << lower << " " << upper;
+        ASSERT_EQ(back->key(), i->first);
+        back->prev();
+    }
+    ASSERT_TRUE(back->done()) << lower << " " << upper;
+}
+
+// puts out of order over many leaves, dels that merge them, then reads
+// by get, iterating, range and seek.
+static void fill(Bucket &bucket, Ref &ref) {
+    vector<int> keys;
+    for (int i = 0; i < 30000; i++) {
+        keys.push_back(i * 7);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(11));
+    for (int k: keys) {
+        auto key = to_string(k), val = string(k % 40, 'v');
+        ASSERT_TRUE(bucket.put(key, val).ok());
+        ref[key] = val;
+    }
+    for (size_t i = 0; i < keys.size(); i += 3) {
+        auto key = to_string(keys[i]);
+        ASSERT_TRUE(bucket.del(key).ok());
+        ref.erase(key);
+    }
+}
+
+static void verify(Bucket &bucket, Ref &ref) {
+    check(bucket, ref);
+    for (int a = 0; a < 210000; a += 9973) {
+        checkRange(bucket, ref, to_string(a), to_string(a * 3 + 50));
+    }
+    for (int i = 1; i < 210000; i += 4999) {
+        auto key = to_string(i);
+        auto it = bucket.seek(key);
+        auto want = ref.lower_bound(key);
+        if (want == ref.end()) {
+            ASSERT_TRUE(it->done()) << key;
+            continue;
+        }
+        ASSERT_FALSE(it->done()) << key;
+        ASSERT_EQ(it->key(), want->first);
+    }
+}
+
+TEST(ComparatorTest, SearchedByItsType)
+{
+    // a comparator given by type is searched as one, std::less and
+    // std::greater stay what nodes know.
+    ASSERT_EQ(keyOrder(searchable(ByLength())), KeyOrder::custom);
+    ASSERT_EQ(keyOrder(searchable(less<string_view>())), KeyOrder::bytes);
+    ASSERT_EQ(keyOrder(searchable(greater<string_view>())),
+              KeyOrder::reverse);
+}
+
+TEST(ComparatorTest, TemplatedBucket)
+{
+    for (auto latch: {LatchMode::pessimistic, LatchMode::optimistic}) {
+        for (auto split: {SplitMode::coupled, SplitMode::blink}) {
+            removeDb(path);
+            Option option;
+            option.max_buffer_pages = 64;
+            option.latch_mode = latch;
+            option.split_mode = split;
+            Ref ref;
+            {
+                DB db;
+                ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+                auto [stat, bucket] = db.createBucket("b", ByLength());
+                ASSERT_TRUE(stat.ok());
+                fill(bucket, ref);
+                verify(bucket, ref);
+                auto snap = db.snapshot();
+                auto [sstat, old] = db.getBucket("b", snap, ByLength());
+                ASSERT_TRUE(sstat.ok());
+                check(old, ref);
+            }
+            DB db;
+            ASSERT_TRUE(db.open(path, false, option).ok());
+            auto [stat, bucket] = db.getBucket("b", ByLength());
+            ASSERT_TRUE(stat.ok());
+            verify(bucket, ref);
+        }
+    }
+    removeDb(path);
+}
+
+// the same order through std::function reads the same.
+TEST(ComparatorTest, FunctionFallback)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 64;
+    option.latch_mode = LatchMode::optimistic;
+    comparator_t cmp = ByLength();
+    ASSERT_EQ(keyOrder(cmp), KeyOrder::other);
+    Ref ref;
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.createBucket("b", cmp);
+        ASSERT_TRUE(stat.ok());
+        fill(bucket, ref);
+        verify(bucket, ref);
+    }
+    // written by one, read by the other.
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket("b", ByLength());
+    ASSERT_TRUE(stat.ok());
+    verify(bucket, ref);
+    removeDb(path);
+}
+
+TEST(ComparatorTest, BulkLoad)
+{
+    removeDb(path);
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE).ok());
+    Ref ref;
+    for (int i = 0; i < 20000; i++) {
+        ref[to_string(i * 3)] = to_string(i);
+    }
+    auto it = ref.begin();
+    auto [stat, bucket] = db.bulkLoadBucket("b", [&](string &k, string &v) {
+        if (it == ref.end()) {
+            return false;
+        }
+        k = it->first;
+        v = it->second;
+        ++it;
+        return true;
+    }, 80, ByLength());
+    ASSERT_TRUE(stat.ok());
+    verify(bucket, ref);
+    removeDb(path);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <functional>
+#include <map>
+#include <string>
+#include "TestHelper.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_range_test.db";
+
+static string key(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+// keys of ref in [lower, upper) one way, then the other by prev().
+template <typename Map>
+static void checkRange(Bucket &bucket, Map &ref, string lower, string upper) {
+    auto lo = ref.lower_bound(lower), hi = ref.lower_bound(upper);
+    if (ref.key_comp()(upper, lower)) {
+        hi = lo;
+    }
+    auto it = bucket.range(lower, upper);
+    for (auto i = lo; i != hi; ++i) {
+        ASSERT_FALSE(it->done()) << lower << " " << upper;
+        ASSERT_EQ(it->key(), i->first);
+        ASSERT_EQ(it->val(), i->second);
+        it->next();
+    }
+    ASSERT_TRUE(it->done()) << lower << " " << upper;
+    auto back = bucket.range(lower, upper, true);
+    for (auto i = hi; i != lo; ) {
+        --i;
+        ASSERT_FALSE(back->done()) << lower << " " << upper;
+        ASSERT_EQ(back->key(), i->first);
+        ASSERT_EQ(back->val(), i->second);
+        back->prev();
+    }
+    ASSERT_TRUE(back->done()) << lower << " " << upper;
+}
+
+// bounds on keys, between keys, past both ends and empty ranges, with
+// keys over many leaves.
+template <typename Map>
+static void bounds(Bucket &bucket, Map &ref) {
+    for (int i = 0; i < 6000; i += 3) {
+        auto k = key(i), v = to_string(i);
+        ASSERT_TRUE(bucket.put(k, v).ok());
+        ref[k] = v;
+    }
+    auto near = [](int i) { return key(i) + (i % 2 ? "" : "x"); };
+    for (int a = -300; a < 6300; a += 97) {
+        for (int len: {0, 1, 2, 50, 700, 7000}) {
+            checkRange(bucket, ref, near(a), near(a + len));
+        }
+    }
+    checkRange(bucket, ref, "", "zzz");
+    checkRange(bucket, ref, key(3000), key(10));
+}
+
+TEST(RangeTest, Bounds)
+{
+    for (auto split: {SplitMode::coupled, SplitMode::blink}) {
+        removeDb(path);
+        Option option;
+        option.max_buffer_pages = 64;
+        option.split_mode = split;
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.createBucket("b");
+        ASSERT_TRUE(stat.ok());
+        map<string, string> ref;
+        bounds(bucket, ref);
+    }
+    removeDb(path);
+}
+
+TEST(RangeTest, ReverseComparator)
+{
+    removeDb(path);
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE).ok());
+    auto [stat, bucket] = db.createBucket("b",
+            std::greater<std::string_view>());
+    ASSERT_TRUE(stat.ok());
+    // lower comes first in the order of the bucket.
+    map<string, string, greater<string>> ref;
+    bounds(bucket, ref);
+    removeDb(path);
+}
+
+TEST(RangeTest, SeekAndLast)
+{
+    removeDb(path);
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE).ok());
+    auto [stat, bucket] = db.createBucket("b");
+    ASSERT_TRUE(stat.ok());
+    ASSERT_TRUE(bucket.last()->done());
+    auto none = key(1);
+    ASSERT_TRUE(bucket.seek(none)->done());
+    map<string, string> ref;
+    for (int i = 0; i < 5000; i += 5) {
+        auto k = key(i), v = to_string(i);
+        ASSERT_TRUE(bucket.put(k, v).ok());
+        ref[k] = v;
+    }
+    for (int i = -3; i < 5010; i += 7) {
+        auto k = key(i);
+        auto it = bucket.seek(k);
+        auto want = ref.lower_bound(k);
+        if (want == ref.end()) {
+            ASSERT_TRUE(it->done()) << k;
+            continue;
+        }
+        ASSERT_FALSE(it->done()) << k;
+        ASSERT_EQ(it->key(), want->first);
+    }
+    // from the last back to the first.
+    auto it = bucket.last();
+    for (auto i = ref.rbegin(); i != ref.rend(); ++i) {
+        ASSERT_FALSE(it->done());
+        ASSERT_EQ(it->key(), i->first);
+        it->prev();
+    }
+    ASSERT_TRUE(it->done());
+    removeDb(path);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+#include "../src/Page.h"
+#include "../src/Replacer.h"
+using namespace std;
+
+using namespace bptdb;
+
+// run a hot set of pages, then a long scan, then count how many of the hot
+// pages are still in a cache of capacity pages.
+static int hotAfterScan(CachePolicy policy) {
+    const u32 capacity = 64;
+    auto repl = newReplacer(policy, capacity);
+    vector<unique_ptr<Page>> pages;
+    vector<bool> cached;
+    auto ok = [](Page *) { return true; };
+    auto access = [&](pgid_t id) {
+        if (cached[id]) {
+            repl->touch(pages[id].get());
+            return;
+        }
+        u32 count = 0;
+        for (auto c: cached) count += c;
+        if (count == capacity) {
+            auto victim = repl->victim(ok);
+            cached[victim->getId()] = false;
+        }
+        repl->insert(pages[id].get());
+        cached[id] = true;
+    };
+    for (pgid_t id = 0; id < 1000; id++) {
+        pages.push_back(make_unique<Page>(id));
+        cached.push_back(false);
+    }
+    // hot set, seen many times.
+    for (int round = 0; round < 10; round++) {
+        for (pgid_t id = 0; id < 32; id++) {
+            access(id);
+        }
+    }
+    for (pgid_t id = 100; id < 1000; id++) {
+        access(id);
+    }
+    int hot = 0;
+    for (pgid_t id = 0; id < 32; id++) {
+        hot += cached[id];
+    }
+    return hot;
+}
+
+TEST(ReplacerTest, LruIsFlushedByScan)
+{
+    ASSERT_EQ(hotAfterScan(CachePolicy::lru), 0);
+}
+
+TEST(ReplacerTest, TwoQResistsScan)
+{
+    ASSERT_EQ(hotAfterScan(CachePolicy::twoq), 32);
+}
+
+TEST(ReplacerTest, ArcResistsScan)
+{
+    ASSERT_EQ(hotAfterScan(CachePolicy::arc), 32);
+}
+
+TEST(ReplacerTest, VictimSkipsRejected)
+{
+    auto repl = newReplacer(CachePolicy::clock, 4);
+    Page a(1), b(2);
+    repl->insert(&a);
+    repl->insert(&b);
+    auto victim = repl->victim([](Page *pg) { return pg->getId() == 2; });
+    ASSERT_EQ(victim, &b);
+    ASSERT_EQ(repl->victim([](Page *) { return false; }), nullptr);
+}
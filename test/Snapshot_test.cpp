@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TestHelper.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_snapshot_test.db";
+
+static string key(int i) {
+    return "key" + to_string(i);
+}
+
+// writes after a snapshot, by put, update and del, never reach it.
+static void isolation(uint64_t memory) {
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 64;
+    option.snapshot_memory = memory;
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+    auto [stat, bucket] = db.createBucket("b");
+    ASSERT_TRUE(stat.ok());
+    map<string, string> before;
+    for (int i = 0; i < 5000; i += 2) {
+        auto k = key(i), v = "v" + to_string(i);
+        ASSERT_TRUE(bucket.put(k, v).ok());
+        before[k] = v;
+    }
+    auto snap = db.snapshot();
+    auto [sstat, old] = db.getBucket("b", snap);
+    ASSERT_TRUE(sstat.ok());
+
+    map<string, string> after = before;
+    for (int i = 0; i < 5000; i++) {
+        auto k = key(i), v = "w" + to_string(i) + string(i % 7 * 10, 'x');
+        if (i % 2) {
+            ASSERT_TRUE(bucket.put(k, v).ok());
+            after[k] = v;
+        } else if (i % 4 == 0) {
+            ASSERT_TRUE(bucket.update(k, v).ok());
+            after[k] = v;
+        } else {
+            ASSERT_TRUE(bucket.del(k).ok());
+            after.erase(k);
+        }
+    }
+    check(old, before);
+    check(bucket, after);
+
+    // a later snapshot sees the writes, the first one still does not.
+    auto snap2 = db.snapshot();
+    auto [sstat2, mid] = db.getBucket("b", snap2);
+    ASSERT_TRUE(sstat2.ok());
+    for (int i = 0; i < 5000; i += 3) {
+        auto k = key(i);
+        bucket.del(k);
+    }
+    check(old, before);
+    check(mid, after);
+
+    // no write through a snapshot.
+    auto k = key(1), v = string("v");
+    ASSERT_FALSE(old.put(k, v).ok());
+}
+
+TEST(SnapshotTest, IsolationInMemory)
+{
+    isolation(64 << 20);
+    removeDb(path);
+}
+
+TEST(SnapshotTest, IsolationSpilled)
+{
+    // every image goes to the file.
+    isolation(0);
+    removeDb(path);
+}
+
+TEST(SnapshotTest, ReadersWhileWriting)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 128;
+    option.snapshot_memory = 64 * 4096;
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+    auto [stat, bucket] = db.createBucket("b");
+    ASSERT_TRUE(stat.ok());
+    for (int i = 0; i < 20000; i++) {
+        auto k = key(i), v = string("0");
+        ASSERT_TRUE(bucket.put(k, v).ok());
+    }
+    // each round writes all keys, a snapshot sees one round only.
+    atomic_bool stop{false};
+    thread writer([&] {
+        for (int round = 1; !stop; round++) {
+            WriteBatch batch;
+            for (int i = 0; i < 20000; i++) {
+                batch.put(bucket, key(i), to_string(round));
+            }
+            ASSERT_TRUE(db.write(batch).ok());
+        }
+    });
+    for (int n = 0; n < 20; n++) {
+        auto snap = db.snapshot();
+        auto [sstat, view] = db.getBucket("b", snap);
+        ASSERT_TRUE(sstat.ok());
+        string first;
+        size_t count = 0;
+        for (auto it = view.begin(); !it->done(); it->next()) {
+            if (!count++) {
+                first = it->val();
+            }
+            ASSERT_EQ(it->val(), first);
+        }
+        ASSERT_EQ(count, 20000u);
+    }
+    stop = true;
+    writer.join();
+    removeDb(path);
+}
@@ -0,0 +1,47 @@
+#ifndef __TEST_HELPER_H
+#define __TEST_HELPER_H
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include "../src/DB.h"
+
+// remove a db file and its log.
+static inline void removeDb(const std::string &path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+}
+
+// 0 if there is no such file.
+static inline std::uint64_t fileSize(const std::string &path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+// the bucket holds just what ref holds, by get and by iterating. ref
+// sorts keys in the order of the bucket.
+template <typename Map = std::map<std::string, std::string>>
+static inline void check(bptdb::Bucket &bucket, Map &ref) {
+    for (auto &[k, v]: ref) {
+        std::string key = k;
+        auto [stat, got] = bucket.get(key);
+        ASSERT_TRUE(stat.ok()) << k;
+        ASSERT_EQ(got, v);
+    }
+    auto it = bucket.begin();
+    for (auto &[k, v]: ref) {
+        ASSERT_FALSE(it->done());
+        ASSERT_EQ(it->key(), k);
+        ASSERT_EQ(it->val(), v);
+        it->next();
+    }
+    ASSERT_TRUE(it->done());
+}
+
+#endif
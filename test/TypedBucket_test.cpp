@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "TestHelper.h"
+#include "../src/FixedDir.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_typed_test.db";
+
+struct Point {
+    int32_t x;
+    int32_t y;
+    uint64_t tag;
+};
+
+static Point point(int64_t k) {
+    return Point{(int32_t)k, (int32_t)(k * 3), (uint64_t)k * 7};
+}
+
+static bool same(const Point &a, const Point &b) {
+    return a.x == b.x && a.y == b.y && a.tag == b.tag;
+}
+
+// numbers in order, the bytes of them sort the same, and come back.
+template <typename K>
+static void encodeOrder() {
+    using T = TypedBucket<K, Point>;
+    using L = numeric_limits<K>;
+    vector<K> keys{L::min(), (K)(L::min() + 1), 0, 1, 255, 256,
+                   (K)(L::max() - 1), L::max()};
+    if (is_signed_v<K>) {
+        keys.insert(keys.end(), {(K)-300, (K)-256, (K)-1});
+    }
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQ(T::decode(T::encode(keys[i])), keys[i]);
+        if (i) {
+            ASSERT_LT(T::encode(keys[i - 1]), T::encode(keys[i])) << i;
+        }
+    }
+}
+
+TEST(TypedBucketTest, EncodeOrder)
+{
+    encodeOrder<int16_t>();
+    encodeOrder<int32_t>();
+    encodeOrder<int64_t>();
+    encodeOrder<uint32_t>();
+    encodeOrder<uint64_t>();
+}
+
+// lowerBound by numbers agrees with a search of the bytes.
+template <typename K>
+static void lowerBound() {
+    using T = TypedBucket<K, uint32_t>;
+    auto type = T::type();
+    string buf(64 * 1024, 0);
+    u32 size = 0, bytes = 0, high = 0;
+    FixedDir dir;
+    dir.reset(buf.data(), buf.size(), 0, &size, &bytes, &high, type);
+    vector<string> keys;
+    for (int i = -500; i < 500; i += 3) {
+        keys.push_back(T::encode((K)(i * 37)));
+    }
+    sort(keys.begin(), keys.end());
+    auto val = T::bytes(0);
+    for (u32 i = 0; i < keys.size(); i++) {
+        dir.insert(i, keys[i], val);
+    }
+    for (int i = -600; i < 600; i++) {
+        auto k = T::encode((K)(i * 37 + i % 2));
+        auto want = lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+        ASSERT_EQ(dir.lowerBound(k), (u32)want) << i;
+    }
+}
+
+TEST(TypedBucketTest, LowerBound)
+{
+    lowerBound<int16_t>();
+    lowerBound<int32_t>();
+    lowerBound<int64_t>();
+}
+
+// keys of both signs put out of order, read in order, by get, by
+// iterating, by range and from the last, also after a reopen.
+template <typename K>
+static void signedKeys() {
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 64;
+    vector<K> keys;
+    for (int64_t i = -10000; i < 10000; i++) {
+        keys.push_back((K)(i * 13));
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(7));
+    map<K, Point> ref;
+    auto verify = [&](TypedBucket<K, Point> &bucket) {
+        for (auto &[k, v]: ref) {
+            auto [stat, got] = bucket.get(k);
+            ASSERT_TRUE(stat.ok()) << k;
+            ASSERT_TRUE(same(got, v)) << k;
+        }
+        auto it = bucket.begin();
+        for (auto &[k, v]: ref) {
+            ASSERT_FALSE(it.done());
+            ASSERT_EQ(it.key(), k);
+            ASSERT_TRUE(same(it.val(), v));
+            it.next();
+        }
+        ASSERT_TRUE(it.done());
+        auto last = bucket.last();
+        ASSERT_FALSE(last.done());
+        ASSERT_EQ(last.key(), ref.rbegin()->first);
+        // a range across 0, both ways.
+        auto lo = ref.lower_bound(-1000), hi = ref.lower_bound(2000);
+        auto fwd = bucket.range(-1000, 2000);
+        for (auto i = lo; i != hi; ++i) {
+            ASSERT_FALSE(fwd.done());
+            ASSERT_EQ(fwd.key(), i->first);
+            fwd.next();
+        }
+        ASSERT_TRUE(fwd.done());
+        auto back = bucket.range(-1000, 2000, true);
+        for (auto i = hi; i != lo; ) {
+            --i;
+            ASSERT_FALSE(back.done());
+            ASSERT_EQ(back.key(), i->first);
+            back.prev();
+        }
+        ASSERT_TRUE(back.done());
+    };
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.createBucket<K, Point>("points");
+        ASSERT_TRUE(stat.ok());
+        for (auto k: keys) {
+            ASSERT_TRUE(bucket.put(k, point(k)).ok());
+            ref[k] = point(k);
+        }
+        verify(bucket);
+        // most go, leaves get empty and merge.
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (i % 10) {
+                ASSERT_TRUE(bucket.del(keys[i]).ok());
+                ref.erase(keys[i]);
+            } else {
+                ASSERT_TRUE(bucket.update(keys[i], point(keys[i] + 1)).ok());
+                ref[keys[i]] = point(keys[i] + 1);
+            }
+        }
+        verify(bucket);
+    }
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket<K, Point>("points");
+    ASSERT_TRUE(stat.ok());
+    verify(bucket);
+    removeDb(path);
+}
+
+TEST(TypedBucketTest, SignedKeys32)
+{
+    signedKeys<int32_t>();
+}
+
+TEST(TypedBucketTest, SignedKeys64)
+{
+    signedKeys<int64_t>();
+}
+
+// a typed bucket opened by another type or by none, an untyped one
+// opened by a type.
+static void mismatch(DB &db) {
+    auto [s1, b1] = db.getBucket<int64_t, Point>("typed");
+    ASSERT_EQ(s1.getErrmsg(), error::bucketTypeErr);
+    auto [s2, b2] = db.getBucket("typed");
+    ASSERT_EQ(s2.getErrmsg(), error::bucketTypeErr);
+    auto [s3, b3] = db.getBucket<int32_t, Point>("plain");
+    ASSERT_EQ(s3.getErrmsg(), error::bucketTypeErr);
+}
+
+TEST(TypedBucketTest, TypeMismatch)
+{
+    removeDb(path);
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE).ok());
+        auto [stat, bucket] = db.createBucket<int32_t, Point>("typed");
+        ASSERT_TRUE(stat.ok());
+        ASSERT_TRUE(bucket.put(1, point(1)).ok());
+        // bytes of another size are refused.
+        string k = "k", v = "v";
+        ASSERT_EQ(bucket.bucket().put(k, v).getErrmsg(), error::bucketTypeErr);
+        auto [pstat, plain] = db.createBucket("plain");
+        ASSERT_TRUE(pstat.ok());
+        mismatch(db);
+    }
+    // the type is kept in the file.
+    DB db;
+    ASSERT_TRUE(db.open(path).ok());
+    mismatch(db);
+    auto [stat, bucket] = db.getBucket<int32_t, Point>("typed");
+    ASSERT_TRUE(stat.ok());
+    auto [gstat, got] = bucket.get(1);
+    ASSERT_TRUE(gstat.ok());
+    ASSERT_TRUE(same(got, point(1)));
+    removeDb(path);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "TestHelper.h"
+#include "../src/common.h"
+using namespace std;
+
+using namespace bptdb;
+
+// files made by older versions, buckets a and b each with keys
+// user:000000 to user:001499 but every 7th from 3 on, val of key i in
+// bucket x is x followed by i * 31.
+static const string dir = [] {
+    string file = __FILE__;
+    return file.substr(0, file.rfind('/') + 1) + "data/";
+}();
+static const string path = "/tmp/bptdb_upgrade_test.db";
+
+static void copyFrom(string name) {
+    removeDb(path);
+    ifstream in(dir + name, ios::binary);
+    ASSERT_TRUE(in.is_open()) << dir + name;
+    ofstream out(path, ios::binary);
+    out << in.rdbuf();
+}
+
+static string key(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "user:%06d", i);
+    return buf;
+}
+
+static map<string, string> oldData(string name) {
+    map<string, string> ref;
+    for (int i = 0; i < 1500; i++) {
+        if (i % 7 != 3) {
+            ref[key(i)] = name + to_string(i * 31);
+        }
+    }
+    return ref;
+}
+
+// open a file of an old format, read it, change it and read it again.
+static void upgrade(string name) {
+    copyFrom(name);
+    Option option;
+    option.max_buffer_pages = 64;
+    {
+        // a mapped file is never written, so never upgraded.
+        Option ro = option;
+        ro.read_only = true;
+        DB db;
+        ASSERT_EQ(db.open(path, false, ro).getErrmsg(), error::needWrite);
+    }
+    map<string, string> ref[2] = {oldData("a"), oldData("b")};
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, false, option).ok());
+        for (int b = 0; b < 2; b++) {
+            auto [stat, bucket] = db.getBucket(b ? "b" : "a");
+            ASSERT_TRUE(stat.ok());
+            check(bucket, ref[b]);
+            // splits and merges on nodes upgraded.
+            for (int i = 3; i < 3000; i += 7) {
+                auto k = key(i), v = "new" + to_string(i);
+                ASSERT_TRUE(bucket.put(k, v).ok());
+                ref[b][k] = v;
+            }
+            for (int i = 0; i < 1500; i += 5) {
+                auto k = key(i);
+                if (ref[b].erase(k)) {
+                    ASSERT_TRUE(bucket.del(k).ok());
+                }
+            }
+            check(bucket, ref[b]);
+        }
+    }
+    // upgraded for good, it opens mapped now too.
+    for (bool ro: {false, true}) {
+        Option again = option;
+        again.read_only = ro;
+        DB db;
+        ASSERT_TRUE(db.open(path, false, again).ok());
+        for (int b = 0; b < 2; b++) {
+            auto [stat, bucket] = db.getBucket(b ? "b" : "a");
+            ASSERT_TRUE(stat.ok());
+            check(bucket, ref[b]);
+        }
+    }
+    removeDb(path);
+}
+
+// format 1, slots but no shared prefix.
+TEST(UpgradeTest, FromSlotsWithoutPrefix)
+{
+    upgrade("format1.db");
+}
+
+// format 2, a shared prefix but no key heads.
+TEST(UpgradeTest, FromPrefixWithoutHeads)
+{
+    upgrade("format2.db");
+}
+
+// killed in the middle of an upgrade, it goes on when opened again.
+TEST(UpgradeTest, Restart)
+{
+    Option option;
+    option.max_buffer_pages = 64;
+    option.commit_mode = CommitMode::sync;
+    for (int delay: {1, 3, 10, 30}) {
+        copyFrom("format1.db");
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            DB db;
+            db.open(path, false, option);
+            _exit(0);
+        }
+        this_thread::sleep_for(chrono::milliseconds(delay));
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        map<string, string> ref[2] = {oldData("a"), oldData("b")};
+        DB db;
+        ASSERT_TRUE(db.open(path, false, option).ok());
+        for (int b = 0; b < 2; b++) {
+            auto [stat, bucket] = db.getBucket(b ? "b" : "a");
+            ASSERT_TRUE(stat.ok());
+            check(bucket, ref[b]);
+        }
+    }
+    removeDb(path);
+}
@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "TestHelper.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_wal_test.db";
+static const string logPath = path + "-wal";
+
+static string key(int t, int i) {
+    return "t" + to_string(t) + "k" + to_string(i);
+}
+
+// every 3rd key is deleted, every 50th val goes to pages of its own.
+static string val(int t, int i) {
+    return string(i % 50 ? 20 + i % 40 : 3000, 'a' + t);
+}
+
+static void writeAll(Bucket &bucket, int threads, int n) {
+    vector<thread> ts;
+    for (int t = 0; t < threads; t++) {
+        ts.emplace_back([&bucket, t, n] {
+            for (int i = 0; i < n; i++) {
+                auto k = key(t, i), v = val(t, i);
+                ASSERT_TRUE(bucket.put(k, v).ok());
+            }
+            for (int i = 0; i < n; i += 3) {
+                auto k = key(t, i);
+                ASSERT_TRUE(bucket.del(k).ok());
+            }
+        });
+    }
+    for (auto &t: ts) {
+        t.join();
+    }
+}
+
+static void checkAll(Bucket &bucket, int threads, int n) {
+    size_t count = 0;
+    for (int t = 0; t < threads; t++) {
+        for (int i = 0; i < n; i++) {
+            auto k = key(t, i);
+            auto [stat, v] = bucket.get(k);
+            if (i % 3 == 0) {
+                ASSERT_FALSE(stat.ok()) << k;
+                continue;
+            }
+            ASSERT_TRUE(stat.ok()) << k;
+            ASSERT_EQ(v, val(t, i));
+            count++;
+        }
+    }
+    size_t seen = 0;
+    for (auto it = bucket.begin(); !it->done(); it->next()) {
+        seen++;
+    }
+    ASSERT_EQ(seen, count);
+}
+
+// write in a child that dies without closing db, the log brings it back.
+static void crashAfter(Option option, int threads, int n) {
+    removeDb(path);
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        DB db;
+        if (!db.open(path, DB_CREATE, option).ok()) {
+            _exit(1);
+        }
+        auto [stat, bucket] = db.createBucket("b");
+        if (!stat.ok()) {
+            _exit(1);
+        }
+        writeAll(bucket, threads, n);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+TEST(WalTest, ReplayAfterCrash)
+{
+    Option option;
+    option.max_buffer_pages = 64;
+    option.commit_mode = CommitMode::sync;
+    crashAfter(option, 4, 2000);
+    ASSERT_GT(fileSize(logPath), 0);
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, false, option).ok());
+        auto [stat, bucket] = db.getBucket("b");
+        ASSERT_TRUE(stat.ok());
+        checkAll(bucket, 4, 2000);
+    }
+    // closed cleanly, nothing is left to replay.
+    ASSERT_EQ(fileSize(logPath), 0);
+    removeDb(path);
+}
+
+TEST(WalTest, GroupCommit)
+{
+    removeDb(path);
+    Option option;
+    option.commit_mode = CommitMode::sync;
+    {
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.createBucket("b");
+        ASSERT_TRUE(stat.ok());
+        // many txns wait on one flush, none is lost or waits for ever.
+        writeAll(bucket, 16, 500);
+        checkAll(bucket, 16, 500);
+    }
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket("b");
+    ASSERT_TRUE(stat.ok());
+    checkAll(bucket, 16, 500);
+    removeDb(path);
+}
+
+TEST(WalTest, CheckpointBoundsLog)
+{
+    Option option;
+    option.max_buffer_pages = 128;
+    option.commit_mode = CommitMode::async;
+    option.wal_limit = 1 << 20;
+    {
+        removeDb(path);
+        DB db;
+        ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+        auto [stat, bucket] = db.createBucket("b");
+        ASSERT_TRUE(stat.ok());
+        writeAll(bucket, 8, 3000);
+        // the log is cut by the checkpointer, not by the writers.
+        auto limit = 4 * option.wal_limit;
+        for (int i = 0; i < 200 && fileSize(logPath) > limit; i++) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        ASSERT_LE(fileSize(logPath), limit);
+        checkAll(bucket, 8, 3000);
+    }
+    // and what is committed around checkpoints survives a crash.
+    option.commit_mode = CommitMode::sync;
+    crashAfter(option, 8, 3000);
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket("b");
+    ASSERT_TRUE(stat.ok());
+    checkAll(bucket, 8, 3000);
+    removeDb(path);
+}
+
+TEST(WalTest, ConcurrentWriters)
+{
+    for (auto split: {SplitMode::coupled, SplitMode::blink}) {
+        removeDb(path);
+        Option option;
+        option.max_buffer_pages = 256;
+        option.commit_mode = CommitMode::async;
+        option.split_mode = split;
+        // small enough to checkpoint many times under the writers.
+        option.wal_limit = 1 << 20;
+        {
+            DB db;
+            ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+            auto [stat, bucket] = db.createBucket("b");
+            ASSERT_TRUE(stat.ok());
+            writeAll(bucket, 32, 1000);
+            checkAll(bucket, 32, 1000);
+        }
+        DB db;
+        ASSERT_TRUE(db.open(path, false, option).ok());
+        auto [stat, bucket] = db.getBucket("b");
+        ASSERT_TRUE(stat.ok());
+        checkAll(bucket, 32, 1000);
+    }
+    removeDb(path);
+}
+
+TEST(WalTest, FailedLogWrite)
+{
+    removeDb(path);
+    Option option;
+    option.max_buffer_pages = 1024;
+    option.commit_mode = CommitMode::sync;
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // the log grows past the limit of file size, its writes fail.
+        signal(SIGXFSZ, SIG_IGN);
+        struct rlimit lim{1 << 20, 1 << 20};
+        setrlimit(RLIMIT_FSIZE, &lim);
+        int n = 0;
+        {
+            DB db;
+            if (!db.open(path, DB_CREATE, option).ok()) {
+                _exit(1);
+            }
+            auto [stat, bucket] = db.createBucket("b");
+            if (!stat.ok()) {
+                _exit(1);
+            }
+            for (; n < 100000; n++) {
+                auto k = key(0, n), v = val(0, n);
+                if (!bucket.put(k, v).ok()) {
+                    break;
+                }
+            }
+            // it never comes back.
+            auto k = key(1, 0), v = val(1, 0);
+            if (n == 100000 || bucket.put(k, v).ok()) {
+                _exit(1);
+            }
+        }
+        if (::write(fds[1], &n, sizeof(n)) != sizeof(n)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    ::close(fds[1]);
+    int status = 0, n = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    ASSERT_EQ(::read(fds[0], &n, sizeof(n)), (ssize_t)sizeof(n));
+    ::close(fds[0]);
+    ASSERT_GT(n, 0);
+    // each put reported ok is there, none after the log failed.
+    DB db;
+    ASSERT_TRUE(db.open(path, false, option).ok());
+    auto [stat, bucket] = db.getBucket("b");
+    ASSERT_TRUE(stat.ok());
+    for (int i = 0; i < n; i++) {
+        auto k = key(0, i);
+        auto [gstat, v] = bucket.get(k);
+        ASSERT_TRUE(gstat.ok()) << k;
+        ASSERT_EQ(v, val(0, i));
+    }
+    auto k = key(1, 0);
+    ASSERT_FALSE(std::get<0>(bucket.get(k)).ok());
+    removeDb(path);
+}
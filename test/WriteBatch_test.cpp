@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <csignal>
+#include <map>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "TestHelper.h"
+using namespace std;
+
+using namespace bptdb;
+
+static const string path = "/tmp/bptdb_batch_test.db";
+
+static string key(int i) {
+    return "key" + to_string(i);
+}
+
+TEST(WriteBatchTest, LastOpWins)
+{
+    removeDb(path);
+    DB db;
+    ASSERT_TRUE(db.open(path, DB_CREATE).ok());
+    auto [s1, a] = db.createBucket("a");
+    auto [s2, b] = db.createBucket("b");
+    ASSERT_TRUE(s1.ok() && s2.ok());
+    map<string, string> ra, rb;
+    for (int i = 0; i < 100; i++) {
+        auto k = key(i), v = string("old");
+        ASSERT_TRUE(a.put(k, v).ok());
+        ra[k] = v;
+    }
+    WriteBatch batch;
+    // put then put, del then put, put then del, and a del of nothing.
+    batch.put(a, key(1), "x");
+    batch.put(a, key(1), "y");
+    ra[key(1)] = "y";
+    batch.del(a, key(2));
+    batch.put(a, key(2), "back");
+    ra[key(2)] = "back";
+    batch.put(a, key(3), "gone");
+    batch.del(a, key(3));
+    ra.erase(key(3));
+    batch.del(a, key(1000));
+    // the same key in another bucket is another key.
+    batch.put(b, key(1), "b1");
+    batch.put(b, key(500), "b2");
+    batch.del(b, key(500));
+    rb[key(1)] = "b1";
+    ASSERT_EQ(batch.size(), 10u);
+    ASSERT_TRUE(db.write(batch).ok());
+    check(a, ra);
+    check(b, rb);
+    removeDb(path);
+}
+
+// a child writes batches over two buckets, each round puts the same
+// val to all keys of both, and is killed at some time. what the log
+// brings back is one round whole, never parts of two.
+TEST(WriteBatchTest, AllOrNoneAfterCrash)
+{
+    Option option;
+    option.max_buffer_pages = 64;
+    option.commit_mode = CommitMode::async;
+    for (int delay: {20, 60, 150}) {
+        removeDb(path);
+        {
+            DB db;
+            ASSERT_TRUE(db.open(path, DB_CREATE, option).ok());
+            ASSERT_TRUE(get<0>(db.createBucket("a")).ok());
+            ASSERT_TRUE(get<0>(db.createBucket("b")).ok());
+        }
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            DB db;
+            if (!db.open(path, false, option).ok()) {
+                _exit(1);
+            }
+            auto [s1, a] = db.getBucket("a");
+            auto [s2, b] = db.getBucket("b");
+            for (int round = 1; ; round++) {
+                WriteBatch batch;
+                for (int i = 0; i < 300; i++) {
+                    auto v = to_string(round) + string(i % 50, 'v');
+                    batch.put(a, key(i), v);
+                    batch.put(b, key(i), v);
+                }
+                if (!db.write(batch).ok()) {
+                    _exit(1);
+                }
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(delay));
+        kill(pid, SIGKILL);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ASSERT_TRUE(WIFSIGNALED(status));
+
+        DB db;
+        ASSERT_TRUE(db.open(path, false, option).ok());
+        auto [s1, a] = db.getBucket("a");
+        auto [s2, b] = db.getBucket("b");
+        ASSERT_TRUE(s1.ok() && s2.ok());
+        auto first = a.begin();
+        if (first->done()) {
+            // no batch was in log yet.
+            ASSERT_TRUE(b.begin()->done());
+            continue;
+        }
+        auto round = to_string(stoi(string(first->val())));
+        map<string, string> ref;
+        for (int i = 0; i < 300; i++) {
+            ref[key(i)] = round + string(i % 50, 'v');
+        }
+        check(a, ref);
+        check(b, ref);
+    }
+    removeDb(path);
+}